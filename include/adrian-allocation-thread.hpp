@@ -4,12 +4,216 @@
 
 namespace adrian::detail::allocation_thread {
 
+// paging of disk-backed chains ----------------------------------------------------
+[[nodiscard]] inline
+auto is_still_valid(const model& m, const page_op& op) -> bool {
+	const auto chain = m.chains.find(op.chain);
+	if (!chain || !chain->buffers || op.slot >= chain->buffers->size()) {
+		return false;
+	}
+	return is_hot(*chain, op.slot) == op.page_in && is_resident(*chain, op.slot) != op.page_in;
+}
+
+[[nodiscard]] inline
+auto page_in(model x, const page_op& op) -> model {
+	const auto chain  = x.chains.at(op.chain);
+	const auto offset = get_backing_file_offset(chain.channel_count, op.slot);
+	const auto src    = reinterpret_cast<const float*>(chain.file->data + offset);
+	buffer_idx idx;
+	std::tie(x, idx) = find_unused_or_create_new_buffer(ez::nort, std::move(x), chain.channel_count);
+	x = set_as_in_use(std::move(x), chain.channel_count, idx);
+	const auto service = get_buffer_service(x, chain.channel_count, idx);
+	auto copy_from_file = [src](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
+		const auto channel_src = src + (ch.value * BUFFER_SIZE) + start.value;
+		std::copy(channel_src, channel_src + frame_count.value, buffer);
+		return frame_count;
+	};
+	const auto frames_written = get_storage(service->critical)->write(ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, copy_from_file);
+	assert (frames_written.value == BUFFER_SIZE);
+	x = attach_dirty_mipmap(std::move(x), chain, idx);
+	x = update_chain(std::move(x), op.chain, chain::fn::set_buffer(op.slot, idx));
+	return x;
+}
+
+// The sub-buffer is written back to the backing file and returned
+// to the pool. Only sub-buffers which are outside of the hot regions
+// are ever paged out, but a writer could still be working with an
+// older snapshot of the model in which it was resident, so it is
+// shut off from writers before it is copied.
+[[nodiscard]] inline
+auto page_out(model x, const page_op& op) -> model {
+	const auto chain   = x.chains.at(op.chain);
+	const auto idx     = (*chain.buffers)[op.slot];
+	const auto offset  = get_backing_file_offset(chain.channel_count, op.slot);
+	const auto dest    = reinterpret_cast<float*>(chain.file->data + offset);
+	const auto service = get_buffer_service(x, chain.channel_count, idx);
+	shut_out_writers(ez::nort, &service->critical);
+	for (auto ch = ads::channel_idx{}; ch < chain.channel_count; ch++) {
+		auto copy_to_file = [dest, ch](const float* buffer, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
+			std::copy(buffer, buffer + frame_count.value, dest + (ch.value * BUFFER_SIZE) + start.value);
+			return frame_count;
+		};
+		const auto frames_read = get_storage(service->critical)->read(ch, ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, copy_to_file);
+		assert (frames_read.value == BUFFER_SIZE);
+	}
+	x = update_chain(std::move(x), op.chain, chain::fn::set_buffer(op.slot, buffer_idx{}));
+	x = release(std::move(x), chain.channel_count, idx);
+	return x;
+}
+
+inline
+auto do_one_page_op(th::alloc_t thread, detail::service::model* service) -> bool {
+	const auto m  = service->model.read(thread);
+	const auto op = get_next_page_op(m);
+	if (!op) {
+		return false;
+	}
+	if (!is_still_valid(m, *op)) {
+		service->model.update(thread, [op](model&& x){ return pop_page_op(std::move(x), *op); });
+		return true;
+	}
+	const auto chain = m.chains.at(op->chain);
+	const auto file  = chain.file;
+	const auto bytes = get_backing_file_offset(chain.channel_count, 1);
+	const auto offset = get_backing_file_offset(chain.channel_count, op->slot);
+	if (op->page_in) {
+		// Read ahead the rest of the hot region while we're at it.
+		const auto readahead_slots = std::min(PAGING_READAHEAD + 1, chain.buffers->size() - op->slot);
+		mapped_file::prefetch(*file, offset, bytes * readahead_slots);
+	}
+	service->model.update_publish(thread, [op](model&& x){
+		x = pop_page_op(std::move(x), *op);
+		if (!is_still_valid(x, *op)) {
+			return std::move(x);
+		}
+		return op->page_in ? page_in(std::move(x), *op) : page_out(std::move(x), *op);
+	});
+	if (op->page_in) { push_dirty_mipmap(thread, service->model.read(thread), op->chain, op->slot); }
+	else             { mapped_file::evict(*file, offset, bytes); }
+	return true;
+}
+
+[[nodiscard]] inline
+auto has_paging_work(const model& m) -> bool {
+	return get_next_page_op(m).has_value();
+}
+
+// A sub-buffer which was given a mipmap by maintain_mipmaps.
+struct created_mipmap {
+	ads::channel_count channel_count;
+	mipmap::dirty_buffer dirty;
+	buffer::service::ptr service;
+};
+
+// Sub-buffers of chains which generate mipmaps get a mipmap and the rest
+// give theirs up. New mipmaps are marked invalid so that the audio thread
+// publishes the whole sub-buffer for the UI thread to encode. Chains which
+// are being rebuilt in bulk are skipped.
+[[nodiscard]] inline
+auto maintain_mipmaps(model x, const std::vector<chain_id>& rebuilding, std::vector<created_mipmap>* created) -> model {
+	const auto chains = x.chains;
+	for (const auto& c : chains) {
+		if (!c.buffers || std::ranges::find(rebuilding, c.id) != rebuilding.end()) {
+			continue;
+		}
+		for (size_t slot = 0; slot < c.buffers->size(); slot++) {
+			const auto idx = (*c.buffers)[slot];
+			if (!idx) {
+				continue;
+			}
+			if (!should_generate_mipmaps(c)) {
+				x = detach_mipmap(std::move(x), c.channel_count, idx);
+				continue;
+			}
+			bool was_created;
+			std::tie(x, was_created) = attach_mipmap(std::move(x), c.channel_count, idx, c.mipmap_format);
+			if (was_created) {
+				created->push_back({c.channel_count, {c.id, idx, slot}, get_buffer_service(x, c.channel_count, idx)});
+			}
+		}
+	}
+	return x;
+}
+
+// True if any of the chain's resident sub-buffers are
+// missing a mipmap in the chain's format.
+[[nodiscard]] inline
+auto is_missing_mipmaps(const model& m, const chain::model& c) -> bool {
+	if (!c.buffers || !should_generate_mipmaps(c)) {
+		return false;
+	}
+	return std::ranges::any_of(*c.buffers, [&m, &c](buffer_idx idx) {
+		if (!idx) {
+			return false;
+		}
+		const auto mipmap = get_mipmap(m, c.channel_count, idx);
+		return !mipmap || mipmap->format != c.mipmap_format;
+	});
+}
+
+// Runs in the worker pool so that the allocation thread can get on with
+// paging and allocating. Once it's done the allocation thread takes
+// another look, which picks up anything the rebuild missed (e.g. because
+// the chain was edited in the meantime).
+inline
+auto start_mipmap_rebuild(detail::service::model* service, chain_id id) -> void {
+	service->workers.submit([service, id] {
+		std::ignore = rebuild_mipmaps(ez::nort, service, id);
+		{
+			auto lock = std::lock_guard{service->critical.mut_mipmap_rebuilds};
+			std::erase(service->critical.mipmap_rebuilds, id);
+		}
+		service->critical.cv_mipmap_rebuilds.notify_all();
+		service->critical.mipmaps_need_maintenance = true;
+		service->critical.cv_allocation_thread_wait.notify_one();
+	});
+}
+
+inline
+auto wait_for_mipmap_rebuilds(ez::nort_t, detail::service::model* service) -> void {
+	auto lock = std::unique_lock{service->critical.mut_mipmap_rebuilds};
+	service->critical.cv_mipmap_rebuilds.wait(lock, [service] { return service->critical.mipmap_rebuilds.empty(); });
+}
+
+inline
+auto maintain_mipmaps(th::alloc_t thread, detail::service::model* service) -> void {
+	if (!service->critical.mipmaps_need_maintenance.exchange(false)) {
+		return;
+	}
+	// Chains which have just had their mipmaps enabled, or their format
+	// changed, are rebuilt in bulk.
+	const auto m = service->model.read(thread);
+	auto rebuilding = std::vector<chain_id>{};
+	{
+		auto lock = std::lock_guard{service->critical.mut_mipmap_rebuilds};
+		auto& rebuilds = service->critical.mipmap_rebuilds;
+		for (const auto& c : m.chains) {
+			if (std::ranges::find(rebuilds, c.id) == rebuilds.end() && is_missing_mipmaps(m, c)) {
+				rebuilds.push_back(c.id);
+				start_mipmap_rebuild(service, c.id);
+			}
+		}
+		rebuilding = rebuilds;
+	}
+	auto created = std::vector<created_mipmap>{};
+	service->model.update_publish(thread, [&rebuilding, &created](model&& x){
+		created.clear();
+		return maintain_mipmaps(std::move(x), rebuilding, &created);
+	});
+	const auto published = service->model.read(thread);
+	for (const auto& c : created) {
+		c.service->critical.mipmap_invalid = true;
+		push_dirty_mipmap(thread, published, c.channel_count, c.dirty);
+	}
+}
+
 namespace fn {
 
 inline
 auto work_or_stop(th::alloc_t, detail::service::model* service, std::stop_token stop) {
 	return [service, stop] {
-		return stop.stop_requested() || !service->model.read(th::alloc).loading_chains.empty();
+		const auto m = service->model.read(th::alloc);
+		return stop.stop_requested() || !m.loading_chains.empty() || has_paging_work(m) || reserves_need_maintenance(m) || service->critical.mipmaps_need_maintenance;
 	};
 }
 
@@ -31,6 +235,7 @@ auto do_one_allocation(model x, loading_chain lc, const chain::model& chain) ->
 	buffer_idx idx;
 	std::tie(x, idx) = find_unused_or_create_new_buffer(ez::nort, std::move(x), chain.channel_count);
 	x = set_as_in_use(std::move(x), chain.channel_count, idx);
+	x = attach_silent_mipmap(std::move(x), chain, idx);
 	lc.buffers = lc.buffers.push_back(idx);
 	if (lc.buffers.size() < required_buffer_count) {
 		const auto load_progress = float(lc.buffers.size()) / float(required_buffer_count);
@@ -81,7 +286,11 @@ auto func(std::stop_token stop, detail::service::model* service) -> void {
 			if (stop.stop_requested()) {
 				return;
 			}
-			do_one_allocation(th::alloc, service);
+			maintain_reserves(th::alloc, service->model.read(th::alloc));
+			maintain_mipmaps(th::alloc, service);
+			if (!do_one_allocation(th::alloc, service)) {
+				do_one_page_op(th::alloc, service);
+			}
 		}
 		else {
 			wait_for_work_or_stop(th::alloc, service, stop);
@@ -1,15 +1,32 @@
 #pragma once
 
-#include "adrian-model.hpp"
+#include "adrian-mipmap.hpp"
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace adrian::detail {
 
 [[nodiscard]] inline
-auto make_buffer_service(ads::channel_count channel_count) -> buffer::service::ptr {
+auto make_storage(ads::channel_count channel_count) -> buffer::storage_ptr {
+	return std::make_shared<buffer::storage>(ads::make<float, BUFFER_SIZE>(channel_count));
+}
+
+[[nodiscard]] inline
+auto is_shared(const buffer::service::critical& critical) -> bool {
+	return critical.shared.load(std::memory_order_acquire);
+}
+
+[[nodiscard]] inline
+auto get_storage(const buffer::service::critical& critical) -> buffer::storage* {
+	return critical.storage.load(std::memory_order_acquire);
+}
+
+[[nodiscard]] inline
+auto make_buffer_service(const buffer::storage_ptr& storage, bool shared) -> buffer::service::ptr {
 	auto ptr = std::make_shared<buffer::service::model>();
-	ptr->critical.storage               = ads::make<float, BUFFER_SIZE>(channel_count);
-	ptr->critical.mipmap_staging_buffer = ads::make<uint8_t, BUFFER_SIZE>(channel_count);
-	ptr->ui.mipmap                      = ads::mipmap<uint8_t, ads::DYNAMIC_EXTENT, BUFFER_SIZE>{channel_count, {}, {}};
+	ptr->critical.storage.store(storage.get(), std::memory_order_release);
+	ptr->critical.shared.store(shared, std::memory_order_release);
 	return ptr;
 }
 
@@ -30,11 +47,151 @@ auto get_buffer_service(const model& m, ads::channel_count channel_count, buffer
 	return m.buffers.at(channel_count.value).service.at(buffer_idx.value);
 }
 
+// Null if the sub-buffer doesn't belong to a chain which generates mipmaps.
+[[nodiscard]] inline
+auto get_mipmap(const model& m, ads::channel_count channel_count, buffer_idx buffer_idx) -> buffer::mipmap_ptr {
+	return m.buffers.at(channel_count.value).info.at(buffer_idx.value).mipmap;
+}
+
+[[nodiscard]] inline
+auto set_mipmap(model m, ads::channel_count channel_count, buffer_idx idx, buffer::mipmap_ptr mipmap) -> model {
+	m.buffers = std::move(m.buffers).update(channel_count.value, [idx, mipmap](buffer::table x){
+		x.info = std::move(x.info).update(idx.value, [mipmap](buffer::info x){
+			x.mipmap = mipmap;
+			return x;
+		});
+		return x;
+	});
+	return m;
+}
+
+// Returns true if the mipmap was created. A mipmap
+// in the wrong format is replaced with a new one.
+[[nodiscard]] inline
+auto attach_mipmap(model m, ads::channel_count channel_count, buffer_idx idx, mipmap_format format) -> std::tuple<model, bool> {
+	if (const auto mipmap = get_mipmap(m, channel_count, idx); mipmap && mipmap->format == format) {
+		return std::make_tuple(std::move(m), false);
+	}
+	m = set_mipmap(std::move(m), channel_count, idx, make_mipmap(channel_count, format));
+	return std::make_tuple(std::move(m), true);
+}
+
+[[nodiscard]] inline
+auto detach_mipmap(model m, ads::channel_count channel_count, buffer_idx idx) -> model {
+	if (!get_mipmap(m, channel_count, idx)) {
+		return m;
+	}
+	return set_mipmap(std::move(m), channel_count, idx, nullptr);
+}
+
+[[nodiscard]] inline
+auto get_storage_ptr(const model& m, ads::channel_count channel_count, buffer_idx idx) -> buffer::storage_ptr {
+	return m.buffers.at(channel_count.value).info.at(idx.value).storage;
+}
+
+// A storage reference given up by a non-realtime thread. A mipmap
+// record might still be pointing at the storage so it's up to the
+// UI thread to actually release it.
 inline
-auto clear(ez::nort_t, model m, ads::channel_count channel_count, buffer_idx idx) -> void {
+auto retire(ez::nort_t, const model& m, ads::channel_count channel_count, buffer::storage_ptr storage) -> void {
+	if (!storage) {
+		return;
+	}
+	if (const auto& reserve = m.buffers.at(channel_count.value).reserve) {
+		auto lock = std::lock_guard{reserve->mut_retired};
+		reserve->retired.push_back(std::move(storage));
+	}
+}
+
+// The model's reference is replaced and the service is pointed at
+// the new storage. The old reference is retired.
+[[nodiscard]] inline
+auto set_storage(ez::nort_t th, model m, ads::channel_count channel_count, buffer_idx idx, buffer::storage_ptr storage) -> model {
+	get_buffer_service(m, channel_count, idx)->critical.storage.store(storage.get(), std::memory_order_release);
+	retire(th, m, channel_count, get_storage_ptr(m, channel_count, idx));
+	m.buffers = std::move(m.buffers).update(channel_count.value, [idx, storage = std::move(storage)](buffer::table x){
+		x.info = std::move(x.info).update(idx.value, [storage](buffer::info x){
+			x.storage = storage;
+			return x;
+		});
+		return x;
+	});
+	return m;
+}
+
+// If a writer has swapped in its own copy of the storage then
+// the model takes over the reference to it.
+[[nodiscard]] inline
+auto settle_storage(ez::nort_t th, model m, ads::channel_count channel_count, buffer_idx idx) -> model {
+	auto& critical = get_buffer_service(m, channel_count, idx)->critical;
+	if (!critical.incoming_full.load(std::memory_order_acquire)) {
+		return m;
+	}
+	auto storage = std::move(critical.incoming);
+	critical.incoming_full.store(false, std::memory_order_release);
+	return set_storage(th, std::move(m), channel_count, idx, std::move(storage));
+}
+
+// Called by the UI thread with the model lock held. Writers which
+// swapped in their own copy of a shared storage left the index of
+// the sub-buffer in the settle queue, and if that overflowed then
+// every sub-buffer is checked.
+[[nodiscard]] inline
+auto settle_storage(ez::nort_t th, model m) -> model {
+	const auto buffers = m.buffers;
+	for (const auto& [channel_count, table] : buffers) {
+		if (!table.reserve) {
+			continue;
+		}
+		const auto cc = ads::channel_count{channel_count};
+		buffer_idx idx;
+		while (table.reserve->settle.try_dequeue(idx)) {
+			m = settle_storage(th, std::move(m), cc, idx);
+		}
+		if (table.reserve->settle_overflowed.exchange(false)) {
+			for (int32_t i = 0; i < static_cast<int32_t>(table.service.size()); i++) {
+				m = settle_storage(th, std::move(m), cc, buffer_idx{i});
+			}
+		}
+	}
+	return m;
+}
+
+[[nodiscard]] inline
+auto storage_needs_settling(const model& m) -> bool {
+	for (const auto& [_, table] : m.buffers) {
+		if (table.reserve && (table.reserve->settle.size_approx() > 0 || table.reserve->settle_overflowed)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+inline
+auto clear(ez::nort_t, const model& m, ads::channel_count channel_count, buffer_idx idx) -> void {
 	const auto& service = get_buffer_service(m, channel_count, idx);
-	service->critical.storage.fill(0.0f);
-	service->ui.mipmap.clear();
+	get_storage(service->critical)->fill(0.0f);
+	service->critical.evicted.store(false, std::memory_order_release);
+	// The buffer isn't visible to the audio thread so it's safe to touch
+	// the audio state here. A stale dirty region would stop the next
+	// writer from adding the buffer to the dirty list.
+	service->audio.mipmap_dirty_region = {};
+}
+
+[[nodiscard]] inline
+auto create_new_buffer(model m, ads::channel_count channel_count, buffer::storage_ptr storage, bool shared) -> std::tuple<model, buffer_idx> {
+	if (m.buffers.count(channel_count.value) == 0) {
+		m.buffers = std::move(m.buffers).set(channel_count.value, {});
+	}
+	m.buffers = std::move(m.buffers).update(channel_count.value, [storage, shared](buffer::table x){
+		auto info    = buffer::info{};
+		info.storage = storage;
+		x.info    = x.info.push_back(std::move(info));
+		x.service = x.service.push_back(make_buffer_service(storage, shared));
+		return x;
+	});
+	const auto idx = buffer_idx{int32_t(m.buffers.at(channel_count.value).info.size() - 1)};
+	return std::make_tuple(std::move(m), idx);
 }
 
 [[nodiscard]] inline
@@ -43,16 +200,184 @@ auto find_unused_or_create_new_buffer(ez::nort_t thread, model m, ads::channel_c
 		clear(thread, m, channel_count, *idx);
 		return std::make_tuple(std::move(m), *idx);
 	}
+	return create_new_buffer(std::move(m), channel_count, make_storage(channel_count), false);
+}
+
+// Get a buffer which shares its storage with an existing one. Both
+// are flagged as shared so that whichever is written to first makes
+// its own copy.
+[[nodiscard]] inline
+auto find_unused_or_create_new_shared_buffer(ez::nort_t th, model m, ads::channel_count channel_count, buffer_idx src) -> std::tuple<model, buffer_idx> {
+	m = settle_storage(th, std::move(m), channel_count, src);
+	const auto storage = get_storage_ptr(m, channel_count, src);
+	get_buffer_service(m, channel_count, src)->critical.shared.store(true, std::memory_order_release);
+	if (const auto idx = find_unused_buffer(m, channel_count)) {
+		get_buffer_service(m, channel_count, *idx)->critical.shared.store(true, std::memory_order_release);
+		m = set_storage(th, std::move(m), channel_count, *idx, storage);
+		return std::make_tuple(std::move(m), *idx);
+	}
+	return create_new_buffer(std::move(m), channel_count, storage, true);
+}
+
+[[nodiscard]] inline
+auto enable_reserve(model m, ads::channel_count channel_count) -> model {
 	if (m.buffers.count(channel_count.value) == 0) {
 		m.buffers = std::move(m.buffers).set(channel_count.value, {});
 	}
-	m.buffers = std::move(m.buffers).update(channel_count.value, [channel_count](buffer::table x){
-		x.info    = x.info.push_back({});
-		x.service = x.service.push_back(make_buffer_service(channel_count));
+	if (m.buffers.at(channel_count.value).reserve) {
+		return m;
+	}
+	m.buffers = std::move(m.buffers).update(channel_count.value, [](buffer::table x){
+		x.reserve = std::make_shared<buffer::reserve>();
 		return x;
 	});
-	const auto idx = buffer_idx{int32_t(m.buffers.at(channel_count.value).info.size() - 1)};
-	return std::make_tuple(std::move(m), idx);
+	return m;
+}
+
+[[nodiscard]] inline
+auto reserve_needs_maintenance(const buffer::reserve& reserve) -> bool {
+	return reserve.spare.size_approx() < buffer::reserve::SIZE;
+}
+
+[[nodiscard]] inline
+auto reserves_need_maintenance(const model& m) -> bool {
+	for (const auto& [_, table] : m.buffers) {
+		if (table.reserve && reserve_needs_maintenance(*table.reserve)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Top up the spare storage.
+inline
+auto maintain_reserves(ez::nort_t, const model& m) -> void {
+	for (const auto& [channel_count, table] : m.buffers) {
+		if (!table.reserve) {
+			continue;
+		}
+		while (table.reserve->spare.size_approx() < buffer::reserve::SIZE) {
+			if (!table.reserve->spare.try_enqueue(make_storage(ads::channel_count{channel_count}))) {
+				break;
+			}
+		}
+	}
+}
+
+struct graveyard_mark {
+	std::shared_ptr<buffer::reserve> reserve;
+	size_t retired = 0;
+};
+
+using graveyard_marks = std::vector<graveyard_mark>;
+
+// Mipmap records are published by the audio thread before the storage they
+// point at is swapped out and settled, and references are only retired after
+// that. So once the mipmap records have been processed it's safe to release
+// everything which was retired *before* the records were received.
+[[nodiscard]] inline
+auto mark_graveyards(ez::ui_t, const model& m) -> graveyard_marks {
+	auto out = graveyard_marks{};
+	for (const auto& [_, table] : m.buffers) {
+		if (table.reserve) {
+			auto lock = std::lock_guard{table.reserve->mut_retired};
+			out.push_back({table.reserve, table.reserve->retired.size()});
+		}
+	}
+	return out;
+}
+
+inline
+auto empty_graveyards(ez::ui_t, const graveyard_marks& marks) -> void {
+	for (const auto& mark : marks) {
+		auto lock = std::lock_guard{mark.reserve->mut_retired};
+		auto& retired = mark.reserve->retired;
+		retired.erase(retired.begin(), retired.begin() + mark.retired);
+	}
+}
+
+[[nodiscard]] inline
+auto get_cow_underruns(const model& m) -> uint64_t {
+	uint64_t total = 0;
+	for (const auto& [_, table] : m.buffers) {
+		if (table.reserve) {
+			total += table.reserve->underruns.load(std::memory_order_relaxed);
+		}
+	}
+	return total;
+}
+
+// Called by the writer before writing to a sub-buffer.
+// If the storage is shared with another buffer then it is copied
+// into spare storage from the reserve first. Returns false if the
+// reserve has run dry, in which case the write must be dropped.
+// Nothing is ever released here: the copy is handed over to the
+// UI thread, which moves it into the model.
+[[nodiscard]] inline
+auto make_writable(const model& m, ads::channel_count channel_count, buffer_idx idx, buffer::service::model* service) -> bool {
+	auto& critical = service->critical;
+	if (!is_shared(critical)) {
+		return true;
+	}
+	if (critical.incoming_full.load(std::memory_order_acquire)) {
+		// The storage is already our own copy. It just
+		// hasn't been settled by the UI thread yet.
+		return true;
+	}
+	const auto& reserve = m.buffers.at(channel_count.value).reserve;
+	buffer::storage_ptr spare;
+	if (!reserve || !reserve->spare.try_dequeue(spare)) {
+		if (reserve) {
+			reserve->underruns.fetch_add(1, std::memory_order_relaxed);
+		}
+		return false;
+	}
+	auto copy = [&critical](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
+		auto transfer = [buffer](const float* shared, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
+			std::copy(shared, shared + frame_count.value, buffer);
+			return frame_count;
+		};
+		return get_storage(critical)->read(ch, start, frame_count, transfer);
+	};
+	const auto frames_copied = spare->write(ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, copy);
+	assert (frames_copied.value == BUFFER_SIZE);
+	// The copy is only handed over once the flag is cleared, so that
+	// if a non-realtime thread shares it again straight after settling
+	// it then its own flag isn't overwritten.
+	critical.incoming = std::move(spare);
+	critical.storage.store(critical.incoming.get(), std::memory_order_release);
+	critical.shared.store(false, std::memory_order_release);
+	critical.incoming_full.store(true, std::memory_order_release);
+	if (!reserve->settle.try_enqueue(idx)) {
+		reserve->settle_overflowed = true;
+	}
+	return true;
+}
+
+// Writers to sub-buffers of disk-backed chains go through these so
+// that a sub-buffer can't be paged out in the middle of a write.
+[[nodiscard]] inline
+auto begin_write(buffer::service::critical* critical) -> bool {
+	critical->writers.fetch_add(1, std::memory_order_seq_cst);
+	if (critical->evicted.load(std::memory_order_seq_cst)) {
+		critical->writers.fetch_sub(1, std::memory_order_release);
+		return false;
+	}
+	return true;
+}
+
+inline
+auto end_write(buffer::service::critical* critical) -> void {
+	critical->writers.fetch_sub(1, std::memory_order_release);
+}
+
+// Writes are only ever a few frames long, so this doesn't wait for long.
+inline
+auto shut_out_writers(ez::nort_t, buffer::service::critical* critical) -> void {
+	critical->evicted.store(true, std::memory_order_seq_cst);
+	while (critical->writers.load(std::memory_order_seq_cst) > 0) {
+		std::this_thread::yield();
+	}
 }
 
 [[nodiscard]] inline
@@ -72,11 +397,32 @@ auto set_as_in_use(model m, ads::channel_count channel_count, buffer_idx idx) ->
 	return m;
 }
 
+// If the storage is shared then this buffer gets a fresh storage of
+// its own so that the other sharers don't have to make a copy when
+// they write to it.
 [[nodiscard]] inline
 auto release(model m, ads::channel_count channel_count, buffer_idx idx) -> model {
+	m = settle_storage(ez::nort, std::move(m), channel_count, idx);
+	if (auto& critical = get_buffer_service(m, channel_count, idx)->critical; is_shared(critical)) {
+		const auto storage = get_storage_ptr(m, channel_count, idx);
+		m = set_storage(ez::nort, std::move(m), channel_count, idx, make_storage(channel_count));
+		critical.shared.store(false, std::memory_order_release);
+		// If only one sharer is left then it doesn't need to copy.
+		const auto& table = m.buffers.at(channel_count.value);
+		auto sharers = std::vector<buffer_idx>{};
+		for (int32_t i = 0; i < static_cast<int32_t>(table.info.size()); i++) {
+			if (table.info[i].storage == storage) {
+				sharers.push_back(buffer_idx{i});
+			}
+		}
+		if (sharers.size() == 1) {
+			get_buffer_service(m, channel_count, sharers.front())->critical.shared.store(false, std::memory_order_release);
+		}
+	}
 	m.buffers = std::move(m.buffers).update(channel_count.value, [idx](buffer::table x){
 		x.info = std::move(x.info).update(idx.value, [](buffer::info x){
 			x.in_use = false;
+			x.mipmap = nullptr;
 			return x;
 		});
 		return x;
@@ -84,49 +430,47 @@ auto release(model m, ads::channel_count channel_count, buffer_idx idx) -> model
 	return m;
 }
 
+// Called after each write to the sub-buffer's storage, so that a bulk
+// mipmap rebuild can tell whether it saw the write or not.
 inline
-auto update_mipmap(ez::audio_t, buffer::service::model* service) -> void {
-	auto& critical              = service->critical;
-	auto& storage               = critical.storage;
-	auto& mipmap_staging_buffer = critical.mipmap_staging_buffer;
-	auto& audio                 = service->audio;
-	if (audio.mipmap_dirty_region.is_empty()) {
-		return;
-	}
-	const auto local_start = audio.mipmap_dirty_region.beg;
-	const auto local_end   = audio.mipmap_dirty_region.end;
-	const auto frame_count = ads::frame_count{static_cast<uint64_t>((local_end - local_start).value)};
-	auto write_mipmap = [&storage](uint8_t* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
-		for (ads::frame_idx i = {0}; i < frame_count; i++) {
-			const auto storage_frame = ads::frame_idx{start.value + i.value};
-			const auto storage_value = storage.at(ch, storage_frame);
-			buffer[i.value] = ads::encode<uint8_t>(storage_value);
-		}
-		return frame_count;
-	};
-	const auto frames_written = mipmap_staging_buffer.write(local_start, frame_count, write_mipmap);
-	assert (frames_written.value == frame_count.value);
-	critical.mipmap_dirty_region = audio.mipmap_dirty_region;
-	audio.mipmap_dirty_region   = {};
+auto count_mipmap_write(buffer::service::critical* critical) -> void {
+	critical->mipmap_writes.fetch_add(1, std::memory_order_release);
 }
 
+// Read before the storage is read for a bulk mipmap rebuild.
 [[nodiscard]] inline
-auto update_mipmap(ez::ui_t, buffer::service::model* service) -> bool {
-	auto& critical = service->critical;
-	auto& ui       = service->ui;
-	if (critical.mipmap_dirty_region.is_empty()) {
+auto get_mipmap_writes(const buffer::service::critical& critical) -> uint64_t {
+	return critical.mipmap_writes.load(std::memory_order_acquire);
+}
+
+// The audio thread only publishes the region which it has written to.
+// Returns false if the queue is full, in which case the region stays
+// dirty and is published next time.
+[[nodiscard]] inline
+auto publish_mipmap_record(ez::audio_t, mipmap::record_queue* queue, ads::channel_count channel_count, mipmap::dirty_buffer dirty, buffer::service::model* service) -> bool {
+	auto& audio = service->audio;
+	if (const auto cached = service->critical.mipmap_cached.exchange(0); cached != 0) {
+		if (cached - 1 == service->critical.mipmap_writes.load(std::memory_order_acquire)) {
+			audio.mipmap_dirty_region = {};
+		}
+	}
+	if (service->critical.mipmap_invalid.exchange(false)) {
+		audio.mipmap_dirty_region = grow_dirty_region(audio.mipmap_dirty_region, ads::frame_idx{0}, ads::frame_idx{static_cast<int64_t>(BUFFER_SIZE)});
+	}
+	if (audio.mipmap_dirty_region.is_empty()) {
+		return true;
+	}
+	const auto storage = get_storage(service->critical);
+	if (!storage) {
+		// The buffer was released.
+		audio.mipmap_dirty_region = {};
+		return true;
+	}
+	const auto record = mipmap::record{dirty.chain, channel_count, dirty.buffer, dirty.slot, storage, audio.mipmap_dirty_region};
+	if (!queue->v.try_enqueue(record)) {
 		return false;
 	}
-	auto get_value_from_staging_buffer = [&critical](ads::channel_idx ch, ads::frame_idx fr) {
-		return critical.mipmap_staging_buffer.at(ch, fr);
-	};
-	const auto beg = critical.mipmap_dirty_region.beg;
-	const auto end = critical.mipmap_dirty_region.end;
-	assert (beg <= end);
-	const auto size = ads::frame_count{static_cast<uint64_t>((end - beg).value)};
-	ui.mipmap.write(beg, size, get_value_from_staging_buffer);
-	ui.mipmap.update(critical.mipmap_dirty_region);
-	critical.mipmap_dirty_region = {};
+	audio.mipmap_dirty_region = {};
 	return true;
 }
 
@@ -1,27 +1,64 @@
 #pragma once
 
-#include "adrian-chain.hpp"
+#include "adrian-chain-edit.hpp"
 
 namespace adrian::detail {
 
 [[nodiscard]] inline
-auto make_catch_buffer(ez::nort_t th, model m, ads::channel_count channel_count, ads::frame_count frame_count, chain_options options, std::any client_data) -> std::tuple<model, catch_buffer_id> {
+auto make_service(ads::channel_count channel_count, const gate_options& options) -> catch_buffer::service::ptr {
+	auto service = std::make_shared<catch_buffer::service::model>();
+	service->audio.gate = gate::make(channel_count, options);
+	service->audio.pending_input.resize(channel_count.value * kFloatsPerDSPVector);
+	return service;
+}
+
+// With the single ring layout, how far ahead of the write marker the
+// oldest frames stop being readable, unless a different guard is asked for.
+// One sub-buffer, which is what the chain is allocated in anyway.
+static constexpr auto CATCH_BUFFER_GUARD_SIZE = BUFFER_SIZE;
+
+// The guard actually used. The writer may be part way through the vector
+// after the write marker, so it's at least one vector, and it's rounded up
+// to whole vectors because the write marker moves a vector at a time.
+[[nodiscard]] inline
+auto get_catch_buffer_guard(catch_buffer_layout layout, ads::frame_count guard) -> ads::frame_count {
+	if (layout != catch_buffer_layout::single_ring) {
+		return {0};
+	}
+	const auto vectors = std::max((guard.value + kFloatsPerDSPVector - 1) / kFloatsPerDSPVector, uint64_t{1});
+	return {vectors * kFloatsPerDSPVector};
+}
+
+// The length of the underlying chain for a catch buffer which can hold `frame_count` frames.
+[[nodiscard]] inline
+auto get_chain_frame_count(catch_buffer_layout layout, ads::frame_count guard, ads::frame_count frame_count) -> ads::frame_count {
+	if (layout == catch_buffer_layout::single_ring) {
+		return frame_count + guard;
+	}
+	return frame_count * 2;
+}
+
+[[nodiscard]] inline
+auto make_catch_buffer(ez::nort_t th, model m, ads::channel_count channel_count, ads::frame_count frame_count, chain_options options, std::any client_data, catch_buffer_layout layout, ads::frame_count guard) -> std::tuple<model, catch_buffer_id> {
 	catch_buffer::model cbuf;
 	cbuf.id            = {++m.next_id};
-	cbuf.service       = std::make_shared<catch_buffer::service::model>();
+	cbuf.layout        = layout;
+	cbuf.guard         = get_catch_buffer_guard(layout, guard);
+	cbuf.service       = make_service(channel_count, cbuf.gate);
+	// The ring is always being written to so it is never disk-backed.
+	options.backing_file.clear();
 	cbuf.chain_options = options;
 	cbuf.client_data   = client_data;
-	peak_gate::init(&cbuf.service->audio.peak_gate, channel_count, kFloatsPerDSPVector * 128.0f);
-	std::tie(m, cbuf.chain) = make_chain(th, std::move(m), channel_count, frame_count * 2, options, client_data);
+	std::tie(m, cbuf.chain) = make_chain(th, std::move(m), channel_count, get_chain_frame_count(layout, cbuf.guard, frame_count), options, client_data);
 	m.catch_buffers = std::move(m.catch_buffers).insert(cbuf);
 	return std::make_tuple(std::move(m), cbuf.id);
 }
 
 [[nodiscard]] inline
-auto make_catch_buffer(ez::nort_t th, service::model* service, ads::channel_count channel_count, ads::frame_count frame_count, chain_options options, std::any client_data) -> catch_buffer_id {
+auto make_catch_buffer(ez::nort_t th, service::model* service, ads::channel_count channel_count, ads::frame_count frame_count, chain_options options, std::any client_data, catch_buffer_layout layout, ads::frame_count guard) -> catch_buffer_id {
 	catch_buffer_id id;
-	service->model.update_publish(th, [channel_count, frame_count, options, client_data, &id](detail::model&& m) mutable {
-		std::tie(m, id) = detail::make_catch_buffer(ez::nort, std::move(m), channel_count, frame_count, options, client_data);
+	service->model.update_publish(th, [channel_count, frame_count, options, client_data, layout, guard, &id](detail::model&& m) mutable {
+		std::tie(m, id) = detail::make_catch_buffer(ez::nort, std::move(m), channel_count, frame_count, options, client_data, layout, guard);
 		return std::move(m);
 	});
 	return id;
@@ -35,11 +72,29 @@ auto erase(model m, catch_buffer_id id) -> model {
 	return m;
 }
 
+inline
+auto retire(ez::nort_t, service::model* service, catch_buffer::service::ptr cbuf_service) -> void {
+	auto lock = std::lock_guard{service->critical.mut_retired_catch_buffers};
+	service->critical.retired_catch_buffers.push_back(std::move(cbuf_service));
+}
+
+// Free the retired catch buffer services which no model refers to any more.
+inline
+auto free_retired_catch_buffers(ez::ui_t, service::model* service) -> void {
+	auto lock = std::lock_guard{service->critical.mut_retired_catch_buffers};
+	std::erase_if(service->critical.retired_catch_buffers, [](const catch_buffer::service::ptr& x) {
+		return x.use_count() == 1;
+	});
+}
+
 inline
 auto erase(ez::nort_t th, service::model* service, catch_buffer_id id) -> void {
-	service->model.update_publish(th, [id](detail::model x){
+	auto retired = catch_buffer::service::ptr{};
+	service->model.update_publish(th, [id, &retired](detail::model x){
+		retired = x.catch_buffers.at(id).service;
 		return erase(std::move(x), id);
 	});
+	retire(th, service, std::move(retired));
 }
 
 [[nodiscard]] inline
@@ -52,9 +107,11 @@ auto advance_marker_by_64(ads::frame_count frame_count, uint64_t current_marker)
 	return current_marker;
 }
 
+// Only called by the writer, after the frames were written.
 inline
 auto advance_write_marker(catch_buffer::service::critical* critical, ads::frame_count frame_count, uint64_t current_marker) -> void {
 	critical->write_marker.store(advance_marker_by_64(frame_count, current_marker), std::memory_order_release);
+	critical->write_generation.store(critical->write_generation.load(std::memory_order_relaxed) + kFloatsPerDSPVector, std::memory_order_release);
 }
 
 [[nodiscard]] inline
@@ -67,32 +124,74 @@ auto get_partition_size(const chain::model& chain) -> ads::frame_count {
 	return get_partition_size(chain.actual_frame_count);
 }
 
+// The range of frame positions which the catch buffer's regions and
+// markers are reported in. With two partitions it's the size of one of
+// them. With a single ring it's the whole chain, guard zone included.
+[[nodiscard]] inline
+auto get_ring_size(const catch_buffer::model& cbuf, const chain::model& chain) -> ads::frame_count {
+	if (cbuf.layout == catch_buffer_layout::single_ring) {
+		return chain.actual_frame_count;
+	}
+	return get_partition_size(chain);
+}
+
+// How many frames of history the catch buffer actually holds.
+[[nodiscard]] inline
+auto get_capacity(const catch_buffer::model& cbuf, const chain::model& chain) -> ads::frame_count {
+	return get_ring_size(cbuf, chain) - cbuf.guard;
+}
+
+// The frame `pre_roll` frames behind the onset, wrapping around the start
+// of the ring. The pre-roll only reaches back as far as the history which
+// is valid for it: the frames written since the ring started being written
+// continuously, or since the last recording ended, whichever is later.
+// Anything further back is either stale or part of the last recording.
+[[nodiscard]] inline
+auto get_pre_roll_start(const chain::model& chain, ads::frame_count pre_roll, uint64_t history, ads::frame_idx write_marker_frame, uint64_t onset) -> ads::frame_idx {
+	const auto frames = std::min(pre_roll.value, history + onset);
+	auto start = write_marker_frame.value + static_cast<int64_t>(onset) - static_cast<int64_t>(frames);
+	if (start < 0) {
+		start += static_cast<int64_t>(chain.actual_frame_count.value);
+	}
+	return ads::frame_idx{start};
+}
+
+// With a pre-roll the ring is written to whether the gate is open or not,
+// so when it does open the recording can simply start further back. That
+// means a finished recording is overwritten one ring's worth of frames
+// later whether another recording starts or not, even with two partitions.
+// The recording starts at the frame where the input actually went over the
+// threshold rather than at the start of the vector, so `onset_fn` is asked
+// for the offset of that frame within the vector when the gate opens.
 inline
-auto record(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, bool record_gate, auto write_fn) -> void {
+auto record(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, bool disable_recording, bool record_gate, auto onset_fn, auto write_fn) -> void {
 	auto& audio    = cbuf.service->audio;
 	auto& critical = cbuf.service->critical;
-	const auto record_active = critical.record_active.load(std::memory_order_relaxed);
-	if (record_gate) {
-		const auto write_marker = critical.write_marker.load(std::memory_order_relaxed);
-		const auto write_marker_frame = ads::frame_idx{static_cast<int64_t>(write_marker)};
-		detail::scary_write_one_valid_sub_buffer_region(th, service, chain.id, write_marker_frame, {kFloatsPerDSPVector}, write_fn);
-		if (!record_active) {
-			audio.record_start = write_marker_frame;
-			msg::to_ui::send(&service->critical.msgs_to_ui, msg::to_ui::catch_buffer::recording_started{cbuf.id, audio.record_start});
-			critical.record_active.store(true, std::memory_order_relaxed);
-		}
+	const auto record_active      = critical.record_active.load(std::memory_order_relaxed);
+	const auto write_marker       = critical.write_marker.load(std::memory_order_relaxed);
+	const auto write_marker_frame = ads::frame_idx{static_cast<int64_t>(write_marker)};
+	if (record_gate && !record_active) {
+		audio.record_start = get_pre_roll_start(chain, cbuf.pre_roll, audio.pre_roll_history, write_marker_frame, onset_fn());
+		msg::to_ui::send(&service->critical.msgs_to_ui, msg::to_ui::catch_buffer::recording_started{cbuf.id, audio.record_start});
+		critical.record_active.store(true, std::memory_order_relaxed);
+	}
+	if (!record_gate && record_active) {
+		const auto ring_size = get_ring_size(cbuf, chain);
+		const auto beg       = audio.record_start % ring_size;
+		const auto end       = write_marker_frame % ring_size;
+		msg::to_ui::send(&service->critical.msgs_to_ui, msg::to_ui::catch_buffer::recording_finished{cbuf.id, {beg, end}});
+		critical.record_active.store(false, std::memory_order_relaxed);
+		audio.pre_roll_history = 0;
+	}
+	if (record_gate || (cbuf.pre_roll.value > 0 && !disable_recording)) {
+		detail::scary_write_one_valid_sub_buffer_region(m, chain, write_marker_frame, {kFloatsPerDSPVector}, write_fn);
 		advance_write_marker(&critical, chain.actual_frame_count, write_marker);
+		if (!record_gate) {
+			audio.pre_roll_history = std::min(audio.pre_roll_history + kFloatsPerDSPVector, chain.actual_frame_count.value);
+		}
 	}
 	else {
-		if (record_active) {
-			const auto partition_size     = get_partition_size(chain);
-			const auto write_marker       = critical.write_marker.load(std::memory_order_relaxed);
-			const auto write_marker_frame = ads::frame_idx{static_cast<int64_t>(write_marker)};
-			const auto beg                = audio.record_start % partition_size;
-			const auto end                = write_marker_frame % partition_size;
-			msg::to_ui::send(&service->critical.msgs_to_ui, msg::to_ui::catch_buffer::recording_finished{cbuf.id, {beg, end}});
-			critical.record_active.store(false, std::memory_order_relaxed);
-		}
+		audio.pre_roll_history = 0;
 	}
 }
 
@@ -115,28 +214,75 @@ auto get_partitioned_read_frame(ads::frame_count frame_count, uint64_t write_mar
 
 [[nodiscard]]
 auto get_partitioned_read_frame(const catch_buffer::model& cbuf, ads::frame_count frame_count, auto read_frame) -> decltype(read_frame) {
+	if (cbuf.layout == catch_buffer_layout::single_ring) {
+		// Frames are read from wherever they were written.
+		return read_frame;
+	}
 	const auto write_marker = cbuf.service->critical.write_marker.load(std::memory_order_acquire);
 	return get_partitioned_read_frame(frame_count, write_marker, read_frame);
 }
 
+// The sub-buffers resolved by one playback call. Looking a sub-buffer up
+// in the model costs a few table lookups and a reference count, so the
+// channels of a voice, and voices whose regions overlap, share them.
+struct sub_buffer_cache {
+	static constexpr auto SIZE = CATCH_BUFFER_VOICE_COUNT * 2;
+	std::array<size_t, SIZE>                 slots;
+	std::array<const buffer::storage*, SIZE> storage;
+	size_t count = 0;
+	size_t next  = 0;
+};
+
+// Null if the sub-buffer containing the frame isn't allocated. The storage
+// is kept alive by the model snapshot which the playback call is using.
+[[nodiscard]] inline
+auto resolve(sub_buffer_cache* cache, const model& m, const chain::model& chain, ads::frame_idx frame) -> const buffer::storage* {
+	const auto slot = static_cast<size_t>(frame.value) / BUFFER_SIZE;
+	for (size_t i = 0; i < cache->count; i++) {
+		if (cache->slots[i] == slot) { return cache->storage[i]; }
+	}
+	const auto idx     = chain.buffers->at(slot);
+	const auto storage = idx ? get_storage(get_buffer_service(m, chain, idx)->critical) : nullptr;
+	const auto i       = cache->count < sub_buffer_cache::SIZE ? cache->count++ : cache->next++ % sub_buffer_cache::SIZE;
+	cache->slots[i]    = slot;
+	cache->storage[i]  = storage;
+	return storage;
+}
+
+template <typename ReadFn>
+auto scary_read_one_valid_sub_buffer_region(const model& m, const chain::model& chain, sub_buffer_cache* cache, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count, ReadFn read) -> ads::frame_count {
+	if (!chain.buffers) {
+		return {0};
+	}
+	validate_sub_buffer_region(chain, start, frame_count);
+	const auto local_start = start % BUFFER_SIZE;
+	const auto storage     = resolve(cache, m, chain, start);
+	if (!storage) {
+		return read(SILENCE.data() + local_start.value, local_start, frame_count);
+	}
+	return storage->read(ch, local_start, frame_count, read);
+}
+
+// A run of frames which doesn't wrap around the end of the ring.
 inline
-auto playback_one_channel(ez::audio_t, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, ads::frame_count partition_size, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frs, float* buffer) -> void {
+auto playback_one_segment(ez::audio_t, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, sub_buffer_cache* cache, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frs, float* buffer) -> void {
 	auto input = [&](float* chunk, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
 		auto transfer = [&](const float* buffer, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
 			std::copy(buffer, buffer + frame_count.value, chunk);
 			return frame_count;
 		};
-		return detail::scary_read_one_valid_sub_buffer_region(m, chain, ch, start, frame_count, transfer);
+		return scary_read_one_valid_sub_buffer_region(m, chain, cache, ch, start, frame_count, transfer);
 	};
-	auto output = [buffer, frs](const float* chunk, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
-		assert (frame_count == frs);
-		std::copy(chunk, chunk + frame_count.value, buffer);
+	auto output = [buffer, first = start](const float* chunk, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
+		std::copy(chunk, chunk + frame_count.value, buffer + (start - first).value);
 		return frame_count;
 	};
-	auto input_start_xform = [&, partition_size](ads::frame_idx fr) -> ads::frame_idx {
+	auto input_start_xform = [&](ads::frame_idx fr) -> ads::frame_idx {
 		return get_partitioned_read_frame(cbuf, chain.actual_frame_count, fr);
 	};
-	static constexpr auto input_region_alignment  = processor::input_region_alignment{BUFFER_SIZE};
+	// The write marker moves one DSP vector at a time so a chunk
+	// aligned to that never straddles it.
+	static constexpr auto input_region_alignment  = processor::input_region_alignment{kFloatsPerDSPVector};
 	static constexpr auto output_region_alignment = processor::OUTPUT_REGION_ALIGNMENT_IGNORE;
 	static constexpr auto chunk_size              = processor::chunk_size{kFloatsPerDSPVector};
 	static constexpr auto fixed_chunk_size        = processor::fixed_chunk_size::off;
@@ -145,91 +291,386 @@ auto playback_one_channel(ez::audio_t, const model& m, const catch_buffer::model
 }
 
 [[nodiscard]] inline
-auto playback_one_channel(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, ads::channel_idx ch, ads::frame_idx start) -> ml::DSPVector {
-	auto out                  = ml::DSPVector{};
-	const auto partition_size = get_partition_size(chain.actual_frame_count);
-	start.value %= partition_size.value;
+auto playback_one_channel(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, sub_buffer_cache* cache, ads::channel_idx ch, ads::frame_idx start) -> ml::DSPVector {
+	auto out             = ml::DSPVector{};
+	const auto ring_size = get_ring_size(cbuf, chain);
+	start.value %= ring_size.value;
 	const auto end = start + kFloatsPerDSPVector;
-	// Are we going to overflow the end of the partition?
+	// Are we going to overflow the end of the ring?
 	// In that case we need to split the playback up into
 	// two parts to do the wraparound. Otherwise we would
 	// generate an invalid read.
-	if (end > partition_size) {
+	if (end > ring_size) {
 		const auto part1_start = start;
-		const auto part1_frs   = partition_size - start;
+		const auto part1_frs   = ring_size - start;
 		const auto part2_start = ads::frame_idx{0};
 		const auto part2_frs   = ads::frame_count{kFloatsPerDSPVector} - part1_frs;
 		assert (part1_frs.value > 0);
 		assert (part2_frs.value > 0);
 		assert (part1_frs + part2_frs == ads::frame_count{kFloatsPerDSPVector});
-		playback_one_channel(th, m, cbuf, chain, partition_size, ads::channel_idx{0}, part1_start, part1_frs, out.getBuffer());
-		playback_one_channel(th, m, cbuf, chain, partition_size, ads::channel_idx{0}, part2_start, part2_frs, out.getBuffer() + part1_frs.value);
+		playback_one_segment(th, m, cbuf, chain, cache, ch, part1_start, part1_frs, out.getBuffer());
+		playback_one_segment(th, m, cbuf, chain, cache, ch, part2_start, part2_frs, out.getBuffer() + part1_frs.value);
 	}
 	else {
-		playback_one_channel(th, m, cbuf, chain, partition_size, ads::channel_idx{0}, start, {kFloatsPerDSPVector}, out.getBuffer());
+		playback_one_segment(th, m, cbuf, chain, cache, ch, start, {kFloatsPerDSPVector}, out.getBuffer());
 	}
 	return out;
 }
 
-[[nodiscard]] inline
-auto playback_mono(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, ads::frame_idx start) -> ml::DSPVectorArray<2> {
-	return ml::repeatRows<2>(playback_one_channel(th, m, cbuf, chain, ads::channel_idx{0}, start));
+// Any number of frames, split up wherever they
+// wrap around the end of the ring.
+inline
+auto playback_one_channel(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, sub_buffer_cache* cache, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count, float* out) -> void {
+	const auto ring_size = get_ring_size(cbuf, chain);
+	auto remaining = frame_count;
+	while (remaining.value > 0) {
+		start.value %= ring_size.value;
+		const auto frs = std::min(remaining, ring_size - start);
+		playback_one_segment(th, m, cbuf, chain, cache, ch, start, frs, out);
+		out       += frs.value;
+		start     += frs.value;
+		remaining -= frs;
+	}
+}
+
+// Rows beyond the catch buffer's channel count repeat its last
+// channel, e.g. a mono catch buffer is played into both rows of a
+// stereo output.
+template <int N> [[nodiscard]]
+auto playback_rows(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, sub_buffer_cache* cache, ads::frame_idx start) -> ml::DSPVectorArray<N> {
+	auto out = ml::DSPVectorArray<N>{};
+	const auto channel_count = static_cast<int>(chain.channel_count.value);
+	for (int i = 0; i < N; i++) {
+		if (i < channel_count) { out.row(i) = playback_one_channel(th, m, cbuf, chain, cache, ads::channel_idx{static_cast<uint64_t>(i)}, start); }
+		else                   { out.row(i) = out.constRow(channel_count - 1); }
+	}
+	return out;
 }
 
+// Plain playback at the recorded speed, which doesn't need interpolating.
 [[nodiscard]] inline
-auto playback_stereo(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, ads::frame_idx start) -> ml::DSPVectorArray<2> {
-	auto out = ml::DSPVectorArray<2>{};
-	out.row(0) = playback_one_channel(th, m, cbuf, chain, ads::channel_idx{0}, start);
-	out.row(1) = playback_one_channel(th, m, cbuf, chain, ads::channel_idx{1}, start);
+auto is_unity(const playback_options& options) -> bool {
+	return !options.loop && options.rate == 1.0;
+}
+
+// Frames of the ring relative to the start of a voice's region. If the
+// region loops they wrap around its end (and start), otherwise frames
+// outside it are just whatever else is in the ring.
+inline
+auto read_region(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, sub_buffer_cache* cache, const catch_buffer::playback_region& region, ads::channel_idx ch, int64_t offset, uint64_t frame_count, float* out) -> void {
+	const auto ring_size = static_cast<int64_t>(get_ring_size(cbuf, chain).value);
+	const auto length    = static_cast<int64_t>(region.length.value);
+	while (frame_count > 0) {
+		auto frs = frame_count;
+		if (region.options.loop) {
+			offset = ((offset % length) + length) % length;
+			frs    = std::min(frs, static_cast<uint64_t>(length - offset));
+		}
+		const auto frame = (((region.start.value + offset) % ring_size) + ring_size) % ring_size;
+		playback_one_channel(th, m, cbuf, chain, cache, ch, ads::frame_idx{frame}, {frs}, out);
+		out         += frs;
+		offset      += static_cast<int64_t>(frs);
+		frame_count -= frs;
+	}
+}
+
+// Up to a vector of frames of one channel of a voice which is `position`
+// frames into its region, at the voice's rate. Everything the kernel needs
+// is read from the chain in one go, so wraparound and sub-buffer boundaries
+// are dealt with once per vector rather than once per frame. Frames past
+// the end of a region which doesn't loop are silent.
+inline
+auto interpolate(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, sub_buffer_cache* cache, const catch_buffer::playback_region& region, ads::channel_idx ch, double position, uint64_t frame_count, float* out) -> void {
+	static constexpr auto max_taps  = interpolation::get_taps(playback_interpolation::sinc);
+	static constexpr auto max_reads = static_cast<size_t>(kFloatsPerDSPVector * MAX_PLAYBACK_RATE) + max_taps.before + max_taps.after + 2;
+	assert (frame_count > 0 && frame_count <= kFloatsPerDSPVector);
+	const auto& options = region.options;
+	const auto taps     = interpolation::get_taps(options.interpolation);
+	const auto length   = static_cast<double>(region.length.value);
+	const auto first    = static_cast<int64_t>(std::floor(position)) - taps.before;
+	const auto last     = static_cast<int64_t>(std::floor(position + (options.rate * static_cast<double>(frame_count - 1)))) + taps.after;
+	std::array<float, max_reads> frames;
+	assert (static_cast<size_t>(last - first + 1) <= max_reads);
+	read_region(th, m, cbuf, chain, cache, region, ch, first, static_cast<uint64_t>(last - first + 1), frames.data());
+	auto render = [&](auto kernel) {
+		for (uint64_t i = 0; i < frame_count; i++) {
+			const auto pos = position + (options.rate * static_cast<double>(i));
+			if (!options.loop && pos >= length) {
+				out[i] = 0.0f;
+				continue;
+			}
+			const auto whole = std::floor(pos);
+			out[i] = kernel(frames.data() + (static_cast<int64_t>(whole) - first), static_cast<float>(pos - whole));
+		}
+	};
+	switch (options.interpolation) {
+		case playback_interpolation::linear: { render(interpolation::linear); break; }
+		case playback_interpolation::cubic:  { render(interpolation::cubic); break; }
+		case playback_interpolation::sinc:   { render(interpolation::sinc); break; }
+	}
+}
+
+template <int N> [[nodiscard]]
+auto interpolate_rows(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, sub_buffer_cache* cache, const catch_buffer::playback_region& region, double position) -> ml::DSPVectorArray<N> {
+	auto out = ml::DSPVectorArray<N>{};
+	const auto channel_count = static_cast<int>(chain.channel_count.value);
+	for (int i = 0; i < N; i++) {
+		if (i < channel_count) { interpolate(th, m, cbuf, chain, cache, region, ads::channel_idx{static_cast<uint64_t>(i)}, position, kFloatsPerDSPVector, out.row(i).getBuffer()); }
+		else                   { out.row(i) = out.constRow(channel_count - 1); }
+	}
 	return out;
 }
 
+// Move an interpolated voice on by `frame_count` frames of output.
+// Returns true if it just reached the end of a region which doesn't loop.
 [[nodiscard]] inline
-auto playback(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const chain::model& chain) -> ml::DSPVectorArray<2> {
-	auto out       = ml::DSPVectorArray<2>{};
+auto advance_voice(const catch_buffer::model& cbuf, size_t voice, uint64_t frame_count) -> bool {
+	const auto& options = cbuf.playback[voice].options;
+	const auto length   = static_cast<double>(cbuf.playback[voice].length.value);
+	auto& position      = cbuf.service->audio.playback_position[voice];
+	position += options.rate * static_cast<double>(frame_count);
+	if (options.loop) {
+		position = std::fmod(position, length);
+	}
+	cbuf.service->critical.playback_progress[voice].store(static_cast<uint64_t>(position), std::memory_order_relaxed);
+	return !options.loop && position >= length;
+}
+
+// Tell the UI about the voices whose playback just finished.
+inline
+auto send_playback_finished(service::model* service, const catch_buffer::model& cbuf) -> void {
+	auto& finished = cbuf.service->audio.playback_finished;
+	for (size_t voice = 0; voice < CATCH_BUFFER_VOICE_COUNT; voice++) {
+		if (finished[voice]) {
+			msg::to_ui::send(&service->critical.msgs_to_ui, msg::to_ui::catch_buffer::playback_finished{cbuf.id, voice});
+			finished[voice] = false;
+		}
+	}
+}
+
+// Every active voice, mixed together.
+template <int N> [[nodiscard]]
+auto playback(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const chain::model& chain) -> ml::DSPVectorArray<N> {
+	auto out       = ml::DSPVectorArray<N>{};
+	auto cache     = sub_buffer_cache{};
 	auto& audio    = cbuf.service->audio;
 	auto& critical = cbuf.service->critical;
-	if (!audio.playback_active) { return {}; }
-	auto playback_progress = critical.playback_progress.load(std::memory_order_relaxed);
-	const auto beg = cbuf.playback_start + playback_progress;
-	if (chain.channel_count.value == 1) { out = playback_mono  (th, m, cbuf, chain, beg); }
-	else                                { out = playback_stereo(th, m, cbuf, chain, beg); }
-	playback_progress += kFloatsPerDSPVector;
-	critical.playback_progress.store(playback_progress, std::memory_order_relaxed);
-	if (playback_progress >= cbuf.playback_length) {
-		audio.playback_active = false;
-		msg::to_ui::send(&service->critical.msgs_to_ui, msg::to_ui::catch_buffer::playback_finished{cbuf.id});
+	for (size_t voice = 0; voice < CATCH_BUFFER_VOICE_COUNT; voice++) {
+		if (!audio.playback_active[voice]) { continue; }
+		const auto& region = cbuf.playback[voice];
+		auto finished      = false;
+		if (is_unity(region.options)) {
+			auto playback_progress = critical.playback_progress[voice].load(std::memory_order_relaxed);
+			out = out + playback_rows<N>(th, m, cbuf, chain, &cache, region.start + playback_progress);
+			playback_progress += kFloatsPerDSPVector;
+			critical.playback_progress[voice].store(playback_progress, std::memory_order_relaxed);
+			finished = playback_progress >= region.length;
+		}
+		else {
+			out = out + interpolate_rows<N>(th, m, cbuf, chain, &cache, region, audio.playback_position[voice]);
+			finished = advance_voice(cbuf, voice, kFloatsPerDSPVector);
+		}
+		if (finished) {
+			audio.playback_active[voice]   = false;
+			audio.playback_finished[voice] = true;
+		}
 	}
+	send_playback_finished(service, cbuf);
 	return out;
 }
 
+// Playback of `frame_count` frames into each of the output channels, with
+// every active voice mixed together. A mono catch buffer is played into
+// every output channel. Unlike the vector version each voice stops exactly
+// at the end of its playback length. Only touches the catch buffer's own
+// state, so different catch buffers can be played back in parallel. The
+// voices which finished are left in `audio.playback_finished` for
+// send_playback_finished().
+inline
+auto playback_frames(ez::audio_t th, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, std::span<float* const> out, ads::frame_count frame_count) -> void {
+	for (const auto buffer : out) {
+		std::fill(buffer, buffer + frame_count.value, 0.0f);
+	}
+	if (out.empty()) { return; }
+	auto cache     = sub_buffer_cache{};
+	auto& audio    = cbuf.service->audio;
+	auto& critical = cbuf.service->critical;
+	const auto channel_count = std::min<uint64_t>(out.size(), chain.channel_count.value);
+	// Mixed in one vector at a time so no scratch memory is needed.
+	auto chunk = std::array<float, kFloatsPerDSPVector>{};
+	auto mix   = [&chunk](float* dest, uint64_t frs) {
+		std::transform(chunk.data(), chunk.data() + frs, dest, dest, std::plus{});
+	};
+	for (size_t voice = 0; voice < CATCH_BUFFER_VOICE_COUNT; voice++) {
+		if (!audio.playback_active[voice]) { continue; }
+		const auto& region = cbuf.playback[voice];
+		auto finished      = false;
+		if (is_unity(region.options)) {
+			auto playback_progress  = critical.playback_progress[voice].load(std::memory_order_relaxed);
+			const auto playback_end = region.length.value;
+			const auto frs = std::min(frame_count.value, playback_end - std::min(playback_progress, playback_end));
+			for (uint64_t i = 0; i < frs; i += kFloatsPerDSPVector) {
+				const auto n   = std::min<uint64_t>(kFloatsPerDSPVector, frs - i);
+				const auto beg = region.start + ads::frame_count{playback_progress + i};
+				for (uint64_t ch = 0; ch < channel_count; ch++) {
+					playback_one_channel(th, m, cbuf, chain, &cache, ads::channel_idx{ch}, beg, {n}, chunk.data());
+					mix(out[ch] + i, n);
+				}
+			}
+			playback_progress += frs;
+			critical.playback_progress[voice].store(playback_progress, std::memory_order_relaxed);
+			finished = playback_progress >= region.length;
+		}
+		else {
+			for (uint64_t i = 0; i < frame_count.value && !finished; i += kFloatsPerDSPVector) {
+				const auto n = std::min<uint64_t>(kFloatsPerDSPVector, frame_count.value - i);
+				for (uint64_t ch = 0; ch < channel_count; ch++) {
+					interpolate(th, m, cbuf, chain, &cache, region, ads::channel_idx{ch}, audio.playback_position[voice], n, chunk.data());
+					mix(out[ch] + i, n);
+				}
+				finished = advance_voice(cbuf, voice, n);
+			}
+		}
+		if (finished) {
+			audio.playback_active[voice]   = false;
+			audio.playback_finished[voice] = true;
+		}
+	}
+	for (size_t i = channel_count; i < out.size(); i++) {
+		std::copy(out[channel_count - 1], out[channel_count - 1] + frame_count.value, out[i]);
+	}
+}
+
+inline
+auto playback(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, std::span<float* const> out, ads::frame_count frame_count) -> void {
+	playback_frames(th, m, cbuf, chain, out, frame_count);
+	send_playback_finished(service, cbuf);
+}
+
+// Swap in the gate from set_gate_options if there is one. The old gate
+// goes back to the UI thread to be freed, so it waits until the UI
+// thread has freed the one before it.
 [[nodiscard]] inline
-auto process(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const ml::DSPVector& in, float threshold, float gain, bool disable_recording) -> ml::DSPVectorArray<2> {
-	auto& audio            = cbuf.service->audio;
-	const auto& chain      = m.chains.at(cbuf.chain);
-	const auto record_gate = disable_recording ? false : peak_gate::process(&audio.peak_gate, in, threshold);
-	auto write_fn = [in, gain](float* buffer, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
+auto get_gate(ez::audio_t, const catch_buffer::model& cbuf) -> gate::model* {
+	auto& critical = cbuf.service->critical;
+	auto& audio    = cbuf.service->audio;
+	if (critical.incoming_gate_full.load(std::memory_order_acquire) && !critical.retired_gate_full.load(std::memory_order_acquire)) {
+		critical.retired_gate = std::move(audio.gate);
+		audio.gate            = std::move(critical.incoming_gate);
+		critical.retired_gate_full.store(true, std::memory_order_release);
+		critical.incoming_gate_full.store(false, std::memory_order_release);
+	}
+	return audio.gate.get();
+}
+
+// `in` holds one vector per channel, one after the other. What's recorded
+// is the input from before the gate's look-ahead delay, if it has one.
+inline
+auto record_vector(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, const float* in, float gain, bool disable_recording, bool record_gate, auto onset_fn) -> void {
+	auto write_fn = [src = gate::delay(cbuf.service->audio.gate.get(), in), gain](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
 		assert (frame_count.value == kFloatsPerDSPVector);
-		ml::storeAligned(in * gain, buffer);
+		const auto row = src + (ch.value * kFloatsPerDSPVector);
+		std::transform(row, row + kFloatsPerDSPVector, buffer, [gain](float x) { return x * gain; });
 		return ads::frame_count{kFloatsPerDSPVector};
 	};
-	record(th, service, m, cbuf, chain, record_gate, write_fn);
-	return playback(th, service, m, cbuf, chain);
+	record(th, service, m, cbuf, chain, disable_recording, record_gate, onset_fn, write_fn);
+}
+
+template <int N>
+auto record(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, const ml::DSPVectorArray<N>& in, float threshold, float gain, bool disable_recording) -> void {
+	const auto record_gate = disable_recording ? false : gate::process(get_gate(th, cbuf), in, threshold);
+	auto onset_fn = [&in, threshold] { return peak_gate::find_onset(in, threshold); };
+	record_vector(th, service, m, cbuf, chain, in.getConstBuffer(), gain, disable_recording, record_gate, onset_fn);
+}
+
+inline
+auto record(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, const float* in, float threshold, float gain, bool disable_recording) -> void {
+	const auto record_gate = disable_recording ? false : gate::process(get_gate(th, cbuf), in, threshold);
+	auto onset_fn = [in, threshold, &chain] { return peak_gate::find_onset(in, chain.channel_count, threshold); };
+	record_vector(th, service, m, cbuf, chain, in, gain, disable_recording, record_gate, onset_fn);
 }
 
 [[nodiscard]] inline
-auto process(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const ml::DSPVectorArray<2>& in, float threshold, float gain, bool disable_recording) -> ml::DSPVectorArray<2> {
-	auto& audio            = cbuf.service->audio;
-	const auto& chain      = m.chains.at(cbuf.chain);
-	const auto record_gate = disable_recording ? false : peak_gate::process(&audio.peak_gate, in, threshold);
-	auto write_fn = [in, gain](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
-		assert (frame_count.value == kFloatsPerDSPVector);
-		assert (ch.value < 2);
-		ml::storeAligned(in.constRow(static_cast<int>(ch.value)) * gain, buffer);
-		return ads::frame_count{kFloatsPerDSPVector};
+auto process(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const ml::DSPVector& in, float threshold, float gain, bool disable_recording) -> ml::DSPVectorArray<2> {
+	const auto& chain = m.chains.at(cbuf.chain);
+	record(th, service, m, cbuf, chain, in, threshold, gain, disable_recording);
+	return playback<2>(th, service, m, cbuf, chain);
+}
+
+// The input has a row for each of the catch buffer's channels.
+template <int N> [[nodiscard]]
+auto process(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const ml::DSPVectorArray<N>& in, float threshold, float gain, bool disable_recording) -> ml::DSPVectorArray<N> {
+	const auto& chain = m.chains.at(cbuf.chain);
+	assert (chain.channel_count.value == N);
+	record(th, service, m, cbuf, chain, in, threshold, gain, disable_recording);
+	return playback<N>(th, service, m, cbuf, chain);
+}
+
+// Any number of frames in one go. The input is recorded one DSP vector at
+// a time because that's what the gate and the write marker work in, so a
+// partial vector at the end of the block is held back until the next call.
+inline
+auto record(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, const chain::model& chain, std::span<const float* const> in, ads::frame_count frame_count, float threshold, float gain, bool disable_recording) -> void {
+	auto& audio = cbuf.service->audio;
+	assert (in.size() == chain.channel_count.value);
+	for (uint64_t i = 0; i < frame_count.value;) {
+		const auto frs = std::min(kFloatsPerDSPVector - audio.pending_frames, frame_count.value - i);
+		for (size_t ch = 0; ch < in.size(); ch++) {
+			std::copy(in[ch] + i, in[ch] + i + frs, audio.pending_input.data() + (ch * kFloatsPerDSPVector) + audio.pending_frames);
+		}
+		audio.pending_frames += frs;
+		i                    += frs;
+		if (audio.pending_frames < kFloatsPerDSPVector) {
+			break;
+		}
+		audio.pending_frames = 0;
+		record(th, service, m, cbuf, chain, audio.pending_input.data(), threshold, gain, disable_recording);
+	}
+}
+
+// Playback doesn't have the same restriction as recording.
+inline
+auto process(ez::audio_t th, service::model* service, const model& m, const catch_buffer::model& cbuf, std::span<const float* const> in, std::span<float* const> out, ads::frame_count frame_count, float threshold, float gain, bool disable_recording) -> void {
+	const auto& chain = m.chains.at(cbuf.chain);
+	record(th, service, m, cbuf, chain, in, frame_count, threshold, gain, disable_recording);
+	playback(th, service, m, cbuf, chain, out, frame_count);
+}
+
+// Each catch buffer's playback state is only touched by the worker which
+// has its job, so a batch can't have more than one job per catch buffer.
+[[nodiscard]] inline
+auto has_unique_ids(std::span<const catch_buffer_job> jobs) -> bool {
+	for (size_t i = 0; i < jobs.size(); i++) {
+		for (size_t j = i + 1; j < jobs.size(); j++) {
+			if (jobs[i].id == jobs[j].id) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Recording is done first, on the calling thread, because it feeds queues
+// which only have room for one producer. Playback is then spread across the
+// workers and the UI is told about any playback which finished afterwards.
+template <typename RunFn>
+auto process(ez::audio_t th, service::model* service, const model& m, std::span<const catch_buffer_job> jobs, ads::frame_count frame_count, size_t worker_count, RunFn&& run) -> void {
+	assert (has_unique_ids(jobs));
+	for (const auto& job : jobs) {
+		const auto& cbuf = m.catch_buffers.at(job.id);
+		record(th, service, m, cbuf, m.chains.at(cbuf.chain), job.in, frame_count, job.threshold, job.gain, job.disable_recording);
+	}
+	auto play = [th, &m, jobs, frame_count, worker_count](size_t worker) {
+		for (auto i = worker; i < jobs.size(); i += worker_count) {
+			const auto& cbuf = m.catch_buffers.at(jobs[i].id);
+			playback_frames(th, m, cbuf, m.chains.at(cbuf.chain), jobs[i].out, frame_count);
+		}
 	};
-	record(th, service, m, cbuf, chain, record_gate, write_fn);
-	return playback(th, service, m, cbuf, chain);
+	if (worker_count > 1) { run(play); }
+	else                  { play(0); }
+	for (const auto& job : jobs) {
+		send_playback_finished(service, m.catch_buffers.at(job.id));
+	}
 }
 
 [[nodiscard]] inline
@@ -249,7 +690,7 @@ auto get_channel_count(ez::ui_t th, service::model* service, catch_buffer_id id)
 
 [[nodiscard]] inline
 auto get_actual_frame_count(const model& m, const catch_buffer::model& cbuf) -> ads::frame_count {
-	return get_partition_size(m.chains.at(cbuf.chain).actual_frame_count);
+	return get_capacity(cbuf, m.chains.at(cbuf.chain));
 }
 
 [[nodiscard]] inline
@@ -269,7 +710,11 @@ auto get_actual_frame_count(ads::frame_count requested_frs) -> ads::frame_count
 
 [[nodiscard]] inline
 auto get_requested_frame_count(const model& m, const catch_buffer::model& cbuf) -> ads::frame_count {
-	return get_partition_size(m.chains.at(cbuf.chain).requested_frame_count);
+	const auto& chain = m.chains.at(cbuf.chain);
+	if (cbuf.layout == catch_buffer_layout::single_ring) {
+		return chain.requested_frame_count - cbuf.guard;
+	}
+	return get_partition_size(chain.requested_frame_count);
 }
 
 [[nodiscard]] inline
@@ -282,19 +727,27 @@ auto get_requested_frame_count(ez::ui_t th, service::model* service, catch_buffe
 	return get_requested_frame_count(service->model.read(th), id);
 }
 
+inline
+auto check_voice(size_t voice) -> void {
+	if (voice >= CATCH_BUFFER_VOICE_COUNT) {
+		throw std::runtime_error(std::format("catch buffer playback voice {} is out of range (there are {})", voice, CATCH_BUFFER_VOICE_COUNT));
+	}
+}
+
 [[nodiscard]] inline
-auto get_playback_marker(const model& m, const catch_buffer::model& cbuf) -> ads::frame_idx {
-	const auto& chain = m.chains.at(cbuf.chain);
-	const auto start    = cbuf.playback_start;
-	const auto progress = cbuf.service->critical.playback_progress.load(std::memory_order_relaxed);
-	return {static_cast<int64_t>((start.value + progress) % get_partition_size(chain.actual_frame_count).value)};
+auto get_playback_marker(const model& m, const catch_buffer::model& cbuf, size_t voice) -> ads::frame_idx {
+	check_voice(voice);
+	const auto& chain   = m.chains.at(cbuf.chain);
+	const auto start    = cbuf.playback[voice].start;
+	const auto progress = cbuf.service->critical.playback_progress[voice].load(std::memory_order_relaxed);
+	return {static_cast<int64_t>((start.value + progress) % get_ring_size(cbuf, chain).value)};
 }
 
 [[nodiscard]] inline
 auto get_write_marker(const model& m, const catch_buffer::model& cbuf) -> ads::frame_idx {
 	const auto& chain = m.chains.at(cbuf.chain);
 	const auto marker = cbuf.service->critical.write_marker.load(std::memory_order_relaxed);
-	return {static_cast<int64_t>(marker % get_partition_size(chain.actual_frame_count).value)};
+	return {static_cast<int64_t>(marker % get_ring_size(cbuf, chain).value)};
 }
 
 [[nodiscard]] inline
@@ -303,13 +756,14 @@ auto is_record_active(const catch_buffer::model& cbuf) -> bool {
 }
 
 [[nodiscard]] inline
-auto is_playback_active(ez::ui_t, const catch_buffer::model& cbuf) -> bool {
-	return cbuf.service->ui.playback_active;
+auto is_playback_active(ez::ui_t, const catch_buffer::model& cbuf, size_t voice) -> bool {
+	check_voice(voice);
+	return cbuf.service->ui.playback_active[voice];
 }
 
 [[nodiscard]] inline
-auto get_playback_marker(const model& m, catch_buffer_id id) -> ads::frame_idx {
-	return get_playback_marker(m, m.catch_buffers.at(id));
+auto get_playback_marker(const model& m, catch_buffer_id id, size_t voice) -> ads::frame_idx {
+	return get_playback_marker(m, m.catch_buffers.at(id), voice);
 }
 
 [[nodiscard]] inline
@@ -323,13 +777,13 @@ auto is_record_active(const model& m, catch_buffer_id id) -> bool {
 }
 
 [[nodiscard]] inline
-auto is_playback_active(ez::ui_t th, const model& m, catch_buffer_id id) -> bool {
-	return is_playback_active(th, m.catch_buffers.at(id));
+auto is_playback_active(ez::ui_t th, const model& m, catch_buffer_id id, size_t voice) -> bool {
+	return is_playback_active(th, m.catch_buffers.at(id), voice);
 }
 
 [[nodiscard]] inline
-auto get_playback_marker(ez::ui_t th, service::model* service, catch_buffer_id id) -> ads::frame_idx {
-	return detail::get_playback_marker(service->model.read(th), id);
+auto get_playback_marker(ez::ui_t th, service::model* service, catch_buffer_id id, size_t voice) -> ads::frame_idx {
+	return detail::get_playback_marker(service->model.read(th), id, voice);
 }
 
 [[nodiscard]] inline
@@ -343,15 +797,15 @@ auto is_record_active(ez::ui_t th, service::model* service, catch_buffer_id id)
 }
 
 [[nodiscard]] inline
-auto is_playback_active(ez::ui_t th, service::model* service, catch_buffer_id id) -> bool {
-	return detail::is_playback_active(th, service->model.read(th), id);
+auto is_playback_active(ez::ui_t th, service::model* service, catch_buffer_id id, size_t voice) -> bool {
+	return detail::is_playback_active(th, service->model.read(th), id, voice);
 }
 
 [[nodiscard]] inline
 auto read_mipmap(const model& m, const catch_buffer::model& cbuf, double bin_size, ads::channel_idx ch, double fr) -> ads::mipmap_minmax<uint8_t> {
 	const auto& chain = m.chains.at(cbuf.chain);
-	if (fr < 0)                                             { return {}; }
-	if (fr >= get_partition_size(chain.actual_frame_count)) { return {}; }
+	if (fr < 0)                            { return {}; }
+	if (fr >= get_ring_size(cbuf, chain)) { return {}; }
 	fr = get_partitioned_read_frame(cbuf, chain.actual_frame_count, fr);
 	return detail::read_mipmap(m, cbuf.chain, bin_size, ch, fr);
 }
@@ -380,11 +834,16 @@ auto read(const model& m, const catch_buffer::model& cbuf, const chain::model& c
 	auto output = [&](const float* chunk, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
 		return read_fn(chunk, start, frame_count);
 	};
-	const auto partition_size = get_partition_size(chain.actual_frame_count);
-	auto input_start_xform = [&, partition_size](ads::frame_idx fr) -> ads::frame_idx {
+	auto input_start_xform = [&](ads::frame_idx fr) -> ads::frame_idx {
+		if (cbuf.layout == catch_buffer_layout::single_ring) {
+			// Reads of the oldest frames carry on around the end of the ring.
+			return {fr.value % static_cast<int64_t>(chain.actual_frame_count.value)};
+		}
 		return get_partitioned_read_frame(cbuf, chain.actual_frame_count, fr);
 	};
-	static constexpr auto input_region_alignment  = processor::input_region_alignment{BUFFER_SIZE};
+	// The write marker moves one DSP vector at a time so a chunk
+	// aligned to that never straddles it.
+	static constexpr auto input_region_alignment  = processor::input_region_alignment{kFloatsPerDSPVector};
 	static constexpr auto output_region_alignment = processor::OUTPUT_REGION_ALIGNMENT_IGNORE;
 	static constexpr auto chunk_size              = processor::chunk_size{kFloatsPerDSPVector};
 	static constexpr auto fixed_chunk_size        = processor::fixed_chunk_size::off;
@@ -436,18 +895,164 @@ auto read(const model& m, catch_buffer_id id, ads::frame_idx start, ads::frame_c
 	return read(m, m.catch_buffers.at(id), start, frame_count, read_fn);
 }
 
+[[nodiscard]] inline
+auto get_write_generation(const catch_buffer::model& cbuf) -> uint64_t {
+	return cbuf.service->critical.write_generation.load(std::memory_order_acquire);
+}
+
+[[nodiscard]] inline
+auto get_write_generation(ez::nort_t th, service::model* service, catch_buffer_id id) -> uint64_t {
+	return get_write_generation(service->model.read(th).catch_buffers.at(id));
+}
+
+// Whether the frames [start, start + frame_count) of a single ring could
+// have been written over by a writer which went from generation `before`
+// to `after` while they were being read. The writer may be part way
+// through the vector after `after`.
+[[nodiscard]] inline
+auto is_ring_read_torn(uint64_t ring_size, uint64_t before, uint64_t after, ads::frame_idx start, ads::frame_count frame_count) -> bool {
+	if (frame_count.value == 0) {
+		return false;
+	}
+	const auto written = after - before + kFloatsPerDSPVector;
+	if (written >= ring_size || frame_count.value >= ring_size) {
+		return true;
+	}
+	const auto n             = static_cast<int64_t>(ring_size);
+	const auto read_start    = static_cast<uint64_t>(((start.value % n) + n) % n);
+	const auto written_start = before % ring_size;
+	return (read_start + ring_size - written_start) % ring_size < written
+	    || (written_start + ring_size - read_start) % ring_size < frame_count.value;
+}
+
+// Two partitions keep readers out of the half which is being written to,
+// but a single ring doesn't, so on that layout the non-realtime readers
+// check the write generation either side of the read, the same way
+// read_validated does, and throw if the writer got to any of the frames in
+// the meantime. The read function may already have been given some of
+// them by then. Playback doesn't need this because it runs on the audio
+// thread, in between the writes.
+[[nodiscard]]
+auto read_ring_checked(const model& m, const catch_buffer::model& cbuf, ads::frame_idx start, ads::frame_count frame_count, auto read) -> ads::frame_count {
+	if (cbuf.layout != catch_buffer_layout::single_ring) {
+		return read();
+	}
+	const auto ring_size   = get_ring_size(cbuf, m.chains.at(cbuf.chain)).value;
+	const auto before      = get_write_generation(cbuf);
+	const auto frames_read = read();
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const auto after = cbuf.service->critical.write_generation.load(std::memory_order_relaxed);
+	if (is_ring_read_torn(ring_size, before, after, start, frame_count)) {
+		throw std::runtime_error(std::format("the writer reached frames [{}, {}) of the catch buffer while they were being read. use read_validated to retry torn reads", start.value, start.value + static_cast<int64_t>(frame_count.value)));
+	}
+	return frames_read;
+}
+
 template <typename ReadFn>
 	requires ads::concepts::is_single_channel_read_fn<float, ReadFn>
 [[nodiscard]]
 auto read(ez::nort_t th, service::model* service, catch_buffer_id id, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count, ReadFn read_fn) -> ads::frame_count {
-	return read(service->model.read(th), id, ch, start, frame_count, read_fn);
+	const auto m     = service->model.read(th);
+	const auto& cbuf = m.catch_buffers.at(id);
+	return read_ring_checked(m, cbuf, start, frame_count, [&] { return read(m, cbuf, ch, start, frame_count, read_fn); });
 }
 
 template <typename ReadFn>
 	requires ads::concepts::is_multi_channel_read_fn<float, ReadFn>
 [[nodiscard]]
 auto read(ez::nort_t th, service::model* service, catch_buffer_id id, ads::frame_idx start, ads::frame_count frame_count, ReadFn read_fn) -> ads::frame_count {
-	return read(service->model.read(th), id, start, frame_count, read_fn);
+	const auto m     = service->model.read(th);
+	const auto& cbuf = m.catch_buffers.at(id);
+	return read_ring_checked(m, cbuf, start, frame_count, [&] { return read(m, cbuf, start, frame_count, read_fn); });
+}
+
+// The generation of the frame at `position` in the ring once `generation`
+// frames have been written, i.e. how many frames had been written before it.
+// Negative if nothing has been written there yet.
+[[nodiscard]] inline
+auto get_frame_generation(uint64_t ring_size, uint64_t generation, uint64_t position) -> int64_t {
+	const auto write_position = generation % ring_size;
+	const auto lap_start      = static_cast<int64_t>(generation - write_position);
+	if (position < write_position) {
+		return lap_start + static_cast<int64_t>(position);
+	}
+	return lap_start - static_cast<int64_t>(ring_size) + static_cast<int64_t>(position);
+}
+
+// A seqlock style read. The write generation is read before and after,
+// and the frames are read from wherever they were as of the first one,
+// rather than checking the write marker for each chunk. If the writer got
+// to any of them in the meantime the read is torn. Otherwise it is
+// overwritten if any of them were written at or after `since`.
+template <typename ReadFn>
+	requires ads::concepts::is_multi_channel_read_fn<float, ReadFn>
+[[nodiscard]]
+auto read_validated_once(const model& m, const catch_buffer::model& cbuf, ads::frame_idx start, ads::frame_count frame_count, uint64_t since, ReadFn read_fn) -> catch_buffer_read_status {
+	const auto& chain     = m.chains.at(cbuf.chain);
+	const auto ring_size  = get_ring_size(cbuf, chain).value;
+	const auto chain_size = static_cast<int64_t>(chain.actual_frame_count.value);
+	const auto generation = get_write_generation(cbuf);
+	auto oldest   = std::numeric_limits<int64_t>::max();
+	auto newest   = std::numeric_limits<int64_t>::min();
+	auto position = static_cast<uint64_t>(start.value) % ring_size;
+	auto out      = start;
+	auto remaining = frame_count.value;
+	while (remaining > 0) {
+		// Runs which are contiguous in the history end at the write position and at the end of the ring.
+		const auto write_position = generation % ring_size;
+		const auto run_end        = position < write_position ? write_position : ring_size;
+		const auto frs            = std::min(remaining, run_end - position);
+		const auto frame_gen      = get_frame_generation(ring_size, generation, position);
+		const auto chain_frame    = ((frame_gen % chain_size) + chain_size) % chain_size;
+		oldest = std::min(oldest, frame_gen);
+		newest = std::max(newest, frame_gen + static_cast<int64_t>(frs) - 1);
+		for (auto ch = ads::channel_idx{0}; ch < chain.channel_count; ++ch) {
+			for (uint64_t i = 0; i < frs;) {
+				const auto fr  = ads::frame_idx{chain_frame + static_cast<int64_t>(i)};
+				const auto n   = std::min(frs - i, BUFFER_SIZE - static_cast<uint64_t>(fr.value % BUFFER_SIZE));
+				auto adapter = [read_fn, ch, dest = out + ads::frame_count{i}](const float* buffer, ads::frame_idx, ads::frame_count frame_count) {
+					return read_fn(buffer, ch, dest, frame_count);
+				};
+				std::ignore = scary_read_one_valid_sub_buffer_region(m, chain, ch, fr, {n}, adapter);
+				i += n;
+			}
+		}
+		position   = (position + frs) % ring_size;
+		out       += ads::frame_count{frs};
+		remaining -= frs;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	// The writer may be part way through the vector after this.
+	const auto written = static_cast<int64_t>(cbuf.service->critical.write_generation.load(std::memory_order_relaxed) + kFloatsPerDSPVector);
+	// A frame is written over when the writer comes back around the chain to it.
+	if (oldest + chain_size < written)                { return catch_buffer_read_status::torn; }
+	if (newest >= 0 && static_cast<uint64_t>(newest) >= since) { return catch_buffer_read_status::overwritten; }
+	return catch_buffer_read_status::ok;
+}
+
+// Torn reads are retried, up to `attempts` reads in total, so `read_fn`
+// may see the same frames more than once.
+template <typename ReadFn>
+	requires ads::concepts::is_multi_channel_read_fn<float, ReadFn>
+[[nodiscard]]
+auto read_validated(const model& m, catch_buffer_id id, ads::frame_idx start, ads::frame_count frame_count, uint64_t since, int attempts, ReadFn read_fn) -> catch_buffer_read_status {
+	const auto& cbuf     = m.catch_buffers.at(id);
+	const auto  capacity = get_capacity(cbuf, m.chains.at(cbuf.chain));
+	if (frame_count > capacity) {
+		throw std::runtime_error(std::format("can't read {} frames of a catch buffer which is only {} frames long", frame_count.value, capacity.value));
+	}
+	auto status = catch_buffer_read_status::torn;
+	for (int i = 0; i < std::max(attempts, 1) && status == catch_buffer_read_status::torn; i++) {
+		status = read_validated_once(m, cbuf, start, frame_count, since, read_fn);
+	}
+	return status;
+}
+
+template <typename ReadFn>
+	requires ads::concepts::is_multi_channel_read_fn<float, ReadFn>
+[[nodiscard]]
+auto read_validated(ez::nort_t th, service::model* service, catch_buffer_id id, ads::frame_idx start, ads::frame_count frame_count, uint64_t since, int attempts, ReadFn read_fn) -> catch_buffer_read_status {
+	return read_validated(service->model.read(th), id, start, frame_count, since, attempts, read_fn);
 }
 
 inline
@@ -459,61 +1064,137 @@ auto set_mipmaps_enabled(ez::nort_t th, service::model* service, catch_buffer_id
 }
 
 [[nodiscard]] inline
-auto set_playback_region(model&& m, catch_buffer_id id, ads::frame_idx start, ads::frame_count frs) -> model {
-	m.catch_buffers = m.catch_buffers.update(id, [start, frs](detail::catch_buffer::model x){
-		x.playback_start  = start;
-		x.playback_length = frs;
+auto set_playback_region(model&& m, catch_buffer_id id, size_t voice, ads::frame_idx start, ads::frame_count frs, const playback_options& options) -> model {
+	check_voice(voice);
+	if (!(options.rate > 0.0 && options.rate <= MAX_PLAYBACK_RATE)) {
+		throw std::runtime_error(std::format("catch buffer playback rate {} is outside (0, {}]", options.rate, MAX_PLAYBACK_RATE));
+	}
+	if (options.loop && frs.value == 0) {
+		throw std::runtime_error("can't loop an empty catch buffer playback region");
+	}
+	m.catch_buffers = m.catch_buffers.update(id, [voice, start, frs, &options](detail::catch_buffer::model x){
+		x.playback[voice] = {start, frs, options};
+		return x;
+	});
+	return m;
+}
+
+[[nodiscard]] inline
+auto set_pre_roll(model&& m, catch_buffer_id id, ads::frame_count pre_roll) -> model {
+	const auto& cbuf    = m.catch_buffers.at(id);
+	const auto capacity = get_capacity(cbuf, m.chains.at(cbuf.chain));
+	if (pre_roll >= capacity) {
+		throw std::runtime_error(std::format("a pre-roll of {} frames doesn't fit in a catch buffer which is only {} frames long", pre_roll.value, capacity.value));
+	}
+	m.catch_buffers = m.catch_buffers.update(id, [pre_roll](detail::catch_buffer::model x){
+		x.pre_roll = pre_roll;
 		return x;
 	});
 	return m;
 }
 
 inline
-auto playback_start(ez::audio_t, const model& m, catch_buffer_id id) -> void {
-	const auto& cbuf      = m.catch_buffers.at(id);
-	auto& audio           = cbuf.service->audio;
-	auto& critical        = cbuf.service->critical;
-	audio.playback_active = true;
-	critical.playback_progress.store(0, std::memory_order_relaxed);
+auto set_pre_roll(ez::ui_t th, service::model* service, catch_buffer_id id, ads::frame_count pre_roll) -> void {
+	service->model.update_publish(th, [id, pre_roll](detail::model x){
+		return set_pre_roll(std::move(x), id, pre_roll);
+	});
+}
+
+[[nodiscard]] inline
+auto set_gate_options(model&& m, catch_buffer_id id, const gate_options& options) -> model {
+	if (options.close_ratio <= 0.0f || options.close_ratio > 1.0f) {
+		throw std::runtime_error(std::format("gate close ratio {} is outside (0, 1]", options.close_ratio));
+	}
+	m.catch_buffers = m.catch_buffers.update(id, [&options](detail::catch_buffer::model x){
+		x.gate = options;
+		return x;
+	});
+	return m;
 }
 
+// Free the gate which the audio thread last swapped out, and hand it the
+// pending one if it has taken the last one.
 inline
-auto playback_start(ez::audio_t th, service::model* service, catch_buffer_id id) -> void {
-	playback_start(th, *service->model.read(th), id);
+auto hand_over_gate(ez::ui_t, const catch_buffer::model& cbuf) -> void {
+	auto& critical = cbuf.service->critical;
+	auto& ui       = cbuf.service->ui;
+	if (critical.retired_gate_full.load(std::memory_order_acquire)) {
+		critical.retired_gate.reset();
+		critical.retired_gate_full.store(false, std::memory_order_release);
+	}
+	if (ui.pending_gate && !critical.incoming_gate_full.load(std::memory_order_acquire)) {
+		critical.incoming_gate = std::move(ui.pending_gate);
+		critical.incoming_gate_full.store(true, std::memory_order_release);
+	}
 }
 
 inline
-auto playback_start(ez::audio_t th, catch_buffer_id id) -> void {
-	playback_start(th, &detail::service_, id);
+auto hand_over_gates(ez::ui_t th, const model& m) -> void {
+	for (const auto& cbuf : m.catch_buffers) {
+		hand_over_gate(th, cbuf);
+	}
 }
 
 inline
-auto playback_start(ez::ui_t th, service::model* service, catch_buffer_id id, ads::frame_idx start, ads::frame_count frs) -> void {
-	const auto model = service->model.update_publish(th, [id, start, frs](detail::model x){
-		return set_playback_region(std::move(x), id, start, frs);
+auto set_gate_options(ez::ui_t th, service::model* service, catch_buffer_id id, const gate_options& options) -> void {
+	service->model.update_publish(th, [id, &options](detail::model x){
+		return set_gate_options(std::move(x), id, options);
+	});
+	const auto m      = service->model.read(th);
+	const auto& cbuf  = m.catch_buffers.at(id);
+	cbuf.service->ui.pending_gate = gate::make(m.chains.at(cbuf.chain).channel_count, options);
+	hand_over_gate(th, cbuf);
+}
+
+inline
+auto playback_start(ez::audio_t, const model& m, catch_buffer_id id, size_t voice) -> void {
+	const auto& cbuf = m.catch_buffers.at(id);
+	auto& audio      = cbuf.service->audio;
+	auto& critical   = cbuf.service->critical;
+	audio.playback_active[voice]   = true;
+	audio.playback_finished[voice] = false;
+	audio.playback_position[voice] = 0.0;
+	critical.playback_progress[voice].store(0, std::memory_order_relaxed);
+}
+
+inline
+auto playback_start(ez::audio_t th, service::model* service, catch_buffer_id id, size_t voice) -> void {
+	playback_start(th, *service->model.read(th), id, voice);
+}
+
+inline
+auto playback_start(ez::audio_t th, catch_buffer_id id, size_t voice) -> void {
+	playback_start(th, &detail::service_, id, voice);
+}
+
+inline
+auto playback_start(ez::ui_t th, service::model* service, catch_buffer_id id, ads::frame_idx start, ads::frame_count frs, size_t voice, const playback_options& options) -> void {
+	const auto model = service->model.update_publish(th, [id, voice, start, frs, &options](detail::model x){
+		return set_playback_region(std::move(x), id, voice, start, frs, options);
 	});
 	const auto& cbuf = model.catch_buffers.at(id);
-	cbuf.service->ui.playback_active = true;
+	cbuf.service->ui.playback_active[voice] = true;
 	// This is only written at this point so that the UI thread can immediately
 	// see the value. It's not required from the audio thread's perspective.
-	cbuf.service->critical.playback_progress.store(0, std::memory_order_relaxed);
+	cbuf.service->critical.playback_progress[voice].store(0, std::memory_order_relaxed);
 	// Tell the audio thread to start playback.
-	service->critical.msgs_to_audio.v.enqueue(msg::to_audio::catch_buffer::playback_start{id});
+	service->critical.msgs_to_audio.v.enqueue(msg::to_audio::catch_buffer::playback_start{id, voice});
 }
 
 inline
-auto playback_stop(ez::audio_t, const model& m, catch_buffer_id id) -> void {
+auto playback_stop(ez::audio_t, const model& m, catch_buffer_id id, size_t voice) -> void {
 	const auto& cbuf = m.catch_buffers.at(id);
 	auto& audio      = cbuf.service->audio;
-	audio.playback_active = false;
+	audio.playback_active[voice] = false;
 }
 
 inline
-auto playback_stop(ez::ui_t th, service::model* service, catch_buffer_id id) -> void {
+auto playback_stop(ez::ui_t th, service::model* service, catch_buffer_id id, size_t voice) -> void {
+	check_voice(voice);
 	const auto model = service->model.read(th);
 	const auto& cbuf = model.catch_buffers.at(id);
-	cbuf.service->ui.playback_active = false;
-	service->critical.msgs_to_audio.v.enqueue(msg::to_audio::catch_buffer::playback_stop{id});
+	cbuf.service->ui.playback_active[voice] = false;
+	service->critical.msgs_to_audio.v.enqueue(msg::to_audio::catch_buffer::playback_stop{id, voice});
 }
 
 [[nodiscard]] inline
@@ -521,8 +1202,8 @@ auto process(ez::audio_t th, service::model* service, const model& m, catch_buff
 	return detail::process(th, service, m, m.catch_buffers.at(id), in, threshold, gain, disable_recording);
 }
 
-[[nodiscard]] inline
-auto process(ez::audio_t th, service::model* service, const model& m, catch_buffer_id id, const ml::DSPVectorArray<2>& in, float threshold, float gain, bool disable_recording) -> ml::DSPVectorArray<2> {
+template <int N> [[nodiscard]]
+auto process(ez::audio_t th, service::model* service, const model& m, catch_buffer_id id, const ml::DSPVectorArray<N>& in, float threshold, float gain, bool disable_recording) -> ml::DSPVectorArray<N> {
 	return detail::process(th, service, m, m.catch_buffers.at(id), in, threshold, gain, disable_recording);
 }
 
@@ -531,16 +1212,32 @@ auto process(ez::audio_t th, service::model* service, catch_buffer_id id, const
 	return detail::process(th, service, *service->model.read(th), id, in, threshold, gain, disable_recording);
 }
 
-[[nodiscard]] inline
-auto process(ez::audio_t th, service::model* service, catch_buffer_id id, const ml::DSPVectorArray<2>& in, float threshold, float gain, bool disable_recording) -> ml::DSPVectorArray<2> {
+template <int N> [[nodiscard]]
+auto process(ez::audio_t th, service::model* service, catch_buffer_id id, const ml::DSPVectorArray<N>& in, float threshold, float gain, bool disable_recording) -> ml::DSPVectorArray<N> {
 	return detail::process(th, service, *service->model.read(th), id, in, threshold, gain, disable_recording);
 }
 
+inline
+auto process(ez::audio_t th, service::model* service, const model& m, catch_buffer_id id, std::span<const float* const> in, std::span<float* const> out, ads::frame_count frame_count, float threshold, float gain, bool disable_recording) -> void {
+	detail::process(th, service, m, m.catch_buffers.at(id), in, out, frame_count, threshold, gain, disable_recording);
+}
+
+inline
+auto process(ez::audio_t th, service::model* service, catch_buffer_id id, std::span<const float* const> in, std::span<float* const> out, ads::frame_count frame_count, float threshold, float gain, bool disable_recording) -> void {
+	detail::process(th, service, *service->model.read(th), id, in, out, frame_count, threshold, gain, disable_recording);
+}
+
+template <typename RunFn>
+auto process(ez::audio_t th, service::model* service, std::span<const catch_buffer_job> jobs, ads::frame_count frame_count, size_t worker_count, RunFn&& run) -> void {
+	const auto m = service->model.read(th);
+	detail::process(th, service, *m, jobs, frame_count, worker_count, std::forward<RunFn>(run));
+}
+
 template <uint64_t DestChs, uint64_t DestFrs> inline
 auto copy(const model& m, const catch_buffer::model& cbuf, ads::frame_idx src_start, ads::data<float, DestChs, DestFrs>* dest, ads::frame_idx dest_start, ads::frame_count frame_count) -> ads::frame_count {
 	auto write_fn = [&](float* write_to, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
 		auto read_fn = [&](const float* read_from, ads::frame_idx start, ads::frame_count frame_count) {
-			std::copy(read_from, read_from + frame_count.value, write_to);
+			std::copy(read_from, read_from + frame_count.value, write_to + (start.value - src_start.value));
 			return frame_count;
 		};
 		return read(m, cbuf, ch, src_start, frame_count, read_fn);
@@ -550,34 +1247,109 @@ auto copy(const model& m, const catch_buffer::model& cbuf, ads::frame_idx src_st
 
 template <uint64_t DestChs, uint64_t DestFrs> inline
 auto copy(const model& m, catch_buffer_id id, ads::frame_idx start, ads::data<float, DestChs, DestFrs>* dest, ads::frame_idx dest_start, ads::frame_count frame_count) -> ads::frame_count {
-	const auto& cbuf          = m.catch_buffers.at(id);
-	const auto& chain         = m.chains.at(cbuf.chain);
-	const auto partition_size = get_partition_size(chain);
-	return detail::copy(m, cbuf, start % partition_size, dest, dest_start, frame_count);
+	const auto& cbuf  = m.catch_buffers.at(id);
+	const auto& chain = m.chains.at(cbuf.chain);
+	return detail::copy(m, cbuf, start % get_ring_size(cbuf, chain), dest, dest_start, frame_count);
 }
 
 template <uint64_t DestChs, uint64_t DestFrs> inline
 auto copy(ez::nort_t th, service::model* service, catch_buffer_id id, ads::frame_idx start, ads::data<float, DestChs, DestFrs>* dest, ads::frame_idx dest_start, ads::frame_count frame_count) -> ads::frame_count {
-	return detail::copy(service->model.read(th), id, start, dest, dest_start, frame_count);
+	const auto m     = service->model.read(th);
+	const auto& cbuf = m.catch_buffers.at(id);
+	return read_ring_checked(m, cbuf, start, frame_count, [&] { return detail::copy(m, id, start, dest, dest_start, frame_count); });
+}
+
+// Where the frames [start, start + frame_count) of the catch buffer
+// currently live in the underlying chain. The region can wrap around
+// the end of the ring.
+[[nodiscard]] inline
+auto get_linear_layout(const model& m, const catch_buffer::model& cbuf, ads::frame_idx start, ads::frame_count frame_count) -> edit::layout {
+	const auto& chain    = m.chains.at(cbuf.chain);
+	const auto ring_size = get_ring_size(cbuf, chain).value;
+	const auto capacity  = get_capacity(cbuf, chain).value;
+	if (frame_count.value > capacity) {
+		throw std::runtime_error(std::format("can't linearize {} frames of a catch buffer which is only {} frames long", frame_count.value, capacity));
+	}
+	const auto single_ring  = cbuf.layout == catch_buffer_layout::single_ring;
+	const auto write_marker = cbuf.service->critical.write_marker.load(std::memory_order_acquire);
+	// The partitioned read frame jumps at the write marker and at the end of the partition.
+	// A single ring is only split at its end.
+	const auto split = single_ring ? 0 : write_marker % ring_size;
+	auto segments    = edit::layout{};
+	auto frame       = static_cast<uint64_t>(start.value) % ring_size;
+	auto remaining   = frame_count.value;
+	while (remaining > 0) {
+		if (frame == ring_size) {
+			frame = 0;
+		}
+		const auto run_end = frame < split ? split : ring_size;
+		const auto count   = std::min(remaining, run_end - frame);
+		const auto src     = single_ring ? frame : get_partitioned_read_frame(chain.actual_frame_count, write_marker, frame);
+		edit::push_chain_segment(&segments, chain, ads::frame_idx{static_cast<int64_t>(src)}, ads::frame_count{count});
+		frame     += count;
+		remaining -= count;
+	}
+	return segments;
+}
+
+// Whole sub-buffers of the recorded region are shared copy-on-write
+// with the new chain, so only the partial sub-buffers at the edges
+// are copied. The catch buffer gets a fresh copy of a shared sub-buffer
+// the next time it records over it.
+[[nodiscard]] inline
+auto linearize(ez::nort_t th, model m, catch_buffer_id id, ads::frame_idx start, ads::frame_count frame_count, chain_options options, std::any client_data) -> std::tuple<model, chain_id> {
+	const auto& cbuf = m.catch_buffers.at(id);
+	const auto& src  = m.chains.at(cbuf.chain);
+	edit::check_editable(src);
+	const auto segments = get_linear_layout(m, cbuf, start, frame_count);
+	options.allocate_now = true;
+	options.backing_file.clear();
+	chain_id chain;
+	std::tie(m, chain) = make_chain(th, std::move(m), src.channel_count, {0}, options, client_data);
+	m = edit::rebuild(th, std::move(m), chain, segments);
+	return std::make_tuple(std::move(m), chain);
+}
+
+[[nodiscard]] inline
+auto linearize(ez::nort_t th, service::model* service, catch_buffer_id id, ads::frame_idx start, ads::frame_count frame_count, chain_options options, std::any client_data) -> chain_id {
+	return publish_edit(th, service, [=](detail::model&& m) {
+		return linearize(ez::nort, std::move(m), id, start, frame_count, options, client_data);
+	});
 }
 
 [[nodiscard]] inline
 auto reconfigure(ez::nort_t th, model&& m, catch_buffer_id id, ads::channel_count chc, ads::frame_count frc) -> model {
-	auto cbuf         = m.catch_buffers.at(id);
-	const auto& chain = m.chains.at(cbuf.chain);
-	std::tie(m, cbuf.chain) = make_chain(th, std::move(m), chc, frc * 2, cbuf.chain_options, chain.client_data);
+	auto cbuf = m.catch_buffers.at(id);
+	// A copy, since m is replaced before we're done with it.
+	const auto chain = m.chains.at(cbuf.chain);
+	if (chc != chain.channel_count) {
+		// The audio thread's per-channel state can't be resized in place.
+		// The caller retires the old state.
+		cbuf.service = make_service(chc, cbuf.gate);
+	}
+	std::tie(m, cbuf.chain) = make_chain(th, std::move(m), chc, get_chain_frame_count(cbuf.layout, cbuf.guard, frc), cbuf.chain_options, chain.client_data);
 	m = erase(std::move(m), chain.id);
 	m.catch_buffers = m.catch_buffers.insert(cbuf);
-	cbuf.service->critical.playback_progress.store(0, std::memory_order_relaxed);
+	for (auto& progress : cbuf.service->critical.playback_progress) {
+		progress.store(0, std::memory_order_relaxed);
+	}
 	cbuf.service->critical.write_marker.store(0, std::memory_order_relaxed);
+	cbuf.service->critical.write_generation.store(0, std::memory_order_relaxed);
 	return m;
 }
 
 inline
 auto reconfigure(ez::nort_t th, service::model* service, catch_buffer_id id, ads::channel_count chc, ads::frame_count frc) -> void {
-	service->model.update_publish(th, [id, chc, frc](detail::model x){
-		return reconfigure(ez::nort, std::move(x), id, chc, frc);
+	auto replaced = catch_buffer::service::ptr{};
+	service->model.update_publish(th, [id, chc, frc, &replaced](detail::model x){
+		const auto old = x.catch_buffers.at(id).service;
+		x = reconfigure(ez::nort, std::move(x), id, chc, frc);
+		replaced = x.catch_buffers.at(id).service == old ? nullptr : old;
+		return x;
 	});
+	if (replaced) {
+		retire(th, service, std::move(replaced));
+	}
 }
 
 inline
@@ -615,8 +1387,8 @@ auto get_requested_frame_count(ez::ui_t th, catch_buffer_id id) -> ads::frame_co
 }
 
 [[nodiscard]] inline
-auto get_playback_marker(ez::ui_t th, catch_buffer_id id) -> ads::frame_idx {
-	return detail::get_playback_marker(th, &detail::service_, id);
+auto get_playback_marker(ez::ui_t th, catch_buffer_id id, size_t voice = 0) -> ads::frame_idx {
+	return detail::get_playback_marker(th, &detail::service_, id, voice);
 }
 
 [[nodiscard]] inline
@@ -630,23 +1402,28 @@ auto is_record_active(ez::ui_t th, catch_buffer_id id) -> bool {
 }
 
 [[nodiscard]] inline
-auto is_playback_active(ez::ui_t th, catch_buffer_id id) -> bool {
-	return detail::is_playback_active(th, &detail::service_, id);
+auto is_playback_active(ez::ui_t th, catch_buffer_id id, size_t voice = 0) -> bool {
+	return detail::is_playback_active(th, &detail::service_, id, voice);
 }
 
 [[nodiscard]] inline
-auto make_catch_buffer(ez::nort_t th, ads::channel_count channel_count, ads::frame_count frame_count, chain_options options, std::any client_data) -> catch_buffer_id {
-	return detail::make_catch_buffer(th, &detail::service_, channel_count, frame_count, options, client_data);
+auto make_catch_buffer(ez::nort_t th, ads::channel_count channel_count, ads::frame_count frame_count, chain_options options, std::any client_data, catch_buffer_layout layout = catch_buffer_layout::two_partitions, ads::frame_count guard = {detail::CATCH_BUFFER_GUARD_SIZE}) -> catch_buffer_id {
+	return detail::make_catch_buffer(th, &detail::service_, channel_count, frame_count, options, client_data, layout, guard);
 }
 
+// Each catch buffer has CATCH_BUFFER_VOICE_COUNT playback voices which
+// play their own regions independently of each other, mixed together.
+// Starting a voice which is already playing restarts it with the new region.
+// A voice can loop its region and play it at a different rate, in which
+// case the frames are interpolated.
 inline
-auto playback_start(ez::ui_t th, catch_buffer_id id, ads::frame_idx start, ads::frame_count frs) -> void {
-	return detail::playback_start(th, &detail::service_, id, start, frs);
+auto playback_start(ez::ui_t th, catch_buffer_id id, ads::frame_idx start, ads::frame_count frs, size_t voice = 0, const playback_options& options = {}) -> void {
+	return detail::playback_start(th, &detail::service_, id, start, frs, voice, options);
 }
 
 inline
-auto playback_stop(ez::ui_t th, catch_buffer_id id) -> void {
-	return detail::playback_stop(th, &detail::service_, id);
+auto playback_stop(ez::ui_t th, catch_buffer_id id, size_t voice = 0) -> void {
+	return detail::playback_stop(th, &detail::service_, id, voice);
 }
 
 [[nodiscard]] inline
@@ -654,15 +1431,44 @@ auto process(ez::audio_t th, catch_buffer_id id, const ml::DSPVector& in, float
 	return detail::process(th, &detail::service_, id, in, threshold, gain, disable_recording);
 }
 
-[[nodiscard]] inline
-auto process(ez::audio_t th, catch_buffer_id id, const ml::DSPVectorArray<2>& in, float threshold, float gain, bool disable_recording = false) -> ml::DSPVectorArray<2> {
+// The input has a row for each of the catch buffer's channels, e.g. four
+// for a first order ambisonic source, and so does the output.
+template <int N> [[nodiscard]]
+auto process(ez::audio_t th, catch_buffer_id id, const ml::DSPVectorArray<N>& in, float threshold, float gain, bool disable_recording = false) -> ml::DSPVectorArray<N> {
 	return detail::process(th, &detail::service_, id, in, threshold, gain, disable_recording);
 }
 
+// Process a whole host block at once rather than one DSP vector at a time.
+// There is one input pointer per channel of the catch buffer and any number
+// of output pointers, each of which gets `frame_count` frames of playback.
+inline
+auto process(ez::audio_t th, catch_buffer_id id, std::span<const float* const> in, std::span<float* const> out, ads::frame_count frame_count, float threshold, float gain, bool disable_recording = false) -> void {
+	detail::process(th, &detail::service_, id, in, out, frame_count, threshold, gain, disable_recording);
+}
+
+// Process a batch of catch buffers against a single snapshot of the model,
+// e.g. one per input channel. Every job gets `frame_count` frames. Each
+// catch buffer can only appear once in the batch.
+inline
+auto process(ez::audio_t th, std::span<const catch_buffer_job> jobs, ads::frame_count frame_count) -> void {
+	detail::process(th, &detail::service_, jobs, frame_count, 1, [](auto&&) {});
+}
+
+// The same, but with playback spread across the host's worker threads.
+// `run(fn)` must call `fn(worker)` once for each worker index in
+// [0, worker_count), from any realtime threads, and return once they have
+// all finished. The calling thread may be one of the workers. Each catch
+// buffer can only appear once in the batch, because the workers would
+// otherwise play it back at the same time.
+template <typename RunFn>
+auto process(ez::audio_t th, std::span<const catch_buffer_job> jobs, ads::frame_count frame_count, size_t worker_count, RunFn&& run) -> void {
+	detail::process(th, &detail::service_, jobs, frame_count, worker_count, std::forward<RunFn>(run));
+}
+
 template <typename ReadFn>
 	requires ads::concepts::is_multi_channel_read_fn<float, ReadFn>
 [[nodiscard]] auto read(ez::nort_t th, catch_buffer_id id, ads::frame_idx start, ads::frame_count frame_count, ReadFn read_fn) -> ads::frame_count {
-	return detail::read(th, &detail::service_, id, start, read_fn);
+	return detail::read(th, &detail::service_, id, start, frame_count, read_fn);
 }
 
 template <typename ReadFn>
@@ -671,6 +1477,27 @@ template <typename ReadFn>
 	return detail::read(th, &detail::service_, id, ch, start, frame_count, read_fn);
 }
 
+// How many frames the catch buffer has ever written. Take this when a
+// region of interest is found (e.g. when recording_finished is received)
+// and pass it to read_validated() to find out whether the region has
+// been recorded over since. It starts again from 0 on reconfigure().
+[[nodiscard]] inline
+auto get_write_generation(ez::nort_t th, catch_buffer_id id) -> uint64_t {
+	return detail::get_write_generation(th, &detail::service_, id);
+}
+
+// Read from a background thread without having to leave a safety margin
+// between the frames and the write marker. Rather than the read being
+// clamped, the result says whether the writer got to any of the frames
+// while they were being read (torn), or whether any of them were written
+// at or after the `since` generation (overwritten). Torn reads are
+// retried, up to `attempts` reads in total.
+template <typename ReadFn>
+	requires ads::concepts::is_multi_channel_read_fn<float, ReadFn>
+[[nodiscard]] auto read_validated(ez::nort_t th, catch_buffer_id id, ads::frame_idx start, ads::frame_count frame_count, uint64_t since, int attempts, ReadFn read_fn) -> catch_buffer_read_status {
+	return detail::read_validated(th, &detail::service_, id, start, frame_count, since, attempts, read_fn);
+}
+
 [[nodiscard]] inline
 auto read_mipmap(ez::ui_t th, catch_buffer_id id, double bin_size, ads::channel_idx ch, double fr) -> ads::mipmap_minmax<uint8_t> {
 	return detail::read_mipmap(th, &detail::service_, id, bin_size, ch, fr);
@@ -681,6 +1508,14 @@ auto erase(ez::nort_t th, catch_buffer_id id) -> void {
 	detail::erase(th, &detail::service_, id);
 }
 
+// Turn a recorded region of the catch buffer into a standalone chain,
+// e.g. the region reported by recording_finished. Only the partial
+// sub-buffers at the edges of the region are copied.
+[[nodiscard]] inline
+auto linearize(ez::nort_t th, catch_buffer_id id, ads::frame_idx start, ads::frame_count frame_count, chain_options options, std::any client_data) -> chain_id {
+	return detail::linearize(th, &detail::service_, id, start, frame_count, options, client_data);
+}
+
 inline
 auto reconfigure(ez::nort_t th, catch_buffer_id id, ads::channel_count chc, ads::frame_count frc) -> void {
 	return detail::reconfigure(th, &detail::service_, id, chc, frc);
@@ -691,13 +1526,30 @@ auto set_mipmaps_enabled(ez::nort_t th, catch_buffer_id id, bool enabled) -> voi
 	return detail::set_mipmaps_enabled(th, &detail::service_, id, enabled);
 }
 
+// Include this many frames from before the gate opened in each recording,
+// i.e. recording_started reports a frame this far behind the point where
+// the gate opened. While it's non-zero the ring is written to all the time
+// (unless recording is disabled) so the audio is already there. It has to
+// be shorter than the catch buffer.
+inline
+auto set_pre_roll(ez::ui_t th, catch_buffer_id id, ads::frame_count pre_roll) -> void {
+	detail::set_pre_roll(th, &detail::service_, id, pre_roll);
+}
+
+// Choose how the record gate measures the input, and give it hysteresis
+// or a look-ahead. The gate starts again from closed.
+inline
+auto set_gate_options(ez::ui_t th, catch_buffer_id id, const gate_options& options) -> void {
+	detail::set_gate_options(th, &detail::service_, id, options);
+}
+
 // RAII catch buffer wrapper
 struct catch_buffer {
 	catch_buffer()                               = default;
 	catch_buffer(const catch_buffer&)            = delete;
 	catch_buffer& operator=(const catch_buffer&) = delete;
-	catch_buffer(ads::channel_count channel_count, ads::frame_count frame_count, chain_options options, std::any client_data)
-		: id_{adrian::make_catch_buffer(ez::nort, channel_count, frame_count, options, client_data)}
+	catch_buffer(ads::channel_count channel_count, ads::frame_count frame_count, chain_options options, std::any client_data, catch_buffer_layout layout = catch_buffer_layout::two_partitions, ads::frame_count guard = {detail::CATCH_BUFFER_GUARD_SIZE})
+		: id_{adrian::make_catch_buffer(ez::nort, channel_count, frame_count, options, client_data, layout, guard)}
 	{
 	}
 	~catch_buffer() {
@@ -712,18 +1564,22 @@ struct catch_buffer {
 	}
 	// If `frs` frames are requested, what would the actual frame count be?
 	[[nodiscard]] static auto get_actual_frame_count(ads::frame_count frs) -> ads::frame_count { return adrian::get_actual_frame_count(frs); }
-	auto playback_start(ez::ui_t th, ads::frame_idx start, ads::frame_count frs) -> void{ adrian::playback_start(th, id_, start, frs); }
-	auto playback_stop(ez::ui_t th) -> void                                             { adrian::playback_stop(th, id_); }
+	auto playback_start(ez::ui_t th, ads::frame_idx start, ads::frame_count frs, size_t voice = 0, const playback_options& options = {}) -> void {
+		adrian::playback_start(th, id_, start, frs, voice, options);
+	}
+	auto playback_stop(ez::ui_t th, size_t voice = 0) -> void                           { adrian::playback_stop(th, id_, voice); }
 	auto reconfigure(ez::nort_t th, ads::channel_count chc, ads::frame_count frc)       { adrian::reconfigure(th, id_, chc, frc); }
 	auto set_mipmaps_enabled(ez::nort_t th, bool enabled) -> void                       { adrian::set_mipmaps_enabled(th, id_, enabled); }
+	auto set_pre_roll(ez::ui_t th, ads::frame_count pre_roll) -> void                   { adrian::set_pre_roll(th, id_, pre_roll); }
+	auto set_gate_options(ez::ui_t th, const gate_options& options) -> void             { adrian::set_gate_options(th, id_, options); }
 	[[nodiscard]] auto get_channel_count(ez::ui_t th) const -> ads::channel_count       { return adrian::get_channel_count(th, id_); }
 	[[nodiscard]] auto get_actual_frame_count(ez::ui_t th) const -> ads::frame_count    { return adrian::get_actual_frame_count(th, id_); }
 	[[nodiscard]] auto get_requested_frame_count(ez::ui_t th) const -> ads::frame_count { return adrian::get_requested_frame_count(th, id_); }
-	[[nodiscard]] auto get_playback_marker(ez::ui_t th) const -> ads::frame_idx         { return adrian::get_playback_marker(th, id_); }
+	[[nodiscard]] auto get_playback_marker(ez::ui_t th, size_t voice = 0) const -> ads::frame_idx { return adrian::get_playback_marker(th, id_, voice); }
 	[[nodiscard]] auto get_write_marker(ez::ui_t th) const -> ads::frame_idx            { return adrian::get_write_marker(th, id_); }
 	[[nodiscard]] auto id() const -> catch_buffer_id                                    { return id_; }
 	[[nodiscard]] auto is_record_active(ez::ui_t th) const -> bool                      { return adrian::is_record_active(th, id_); }
-	[[nodiscard]] auto is_playback_active(ez::ui_t th) const -> bool                    { return adrian::is_playback_active(th, id_); }
+	[[nodiscard]] auto is_playback_active(ez::ui_t th, size_t voice = 0) const -> bool  { return adrian::is_playback_active(th, id_, voice); }
 	[[nodiscard]]
 	auto read_mipmap(ez::ui_t th, double bin_size, ads::channel_idx ch, double fr) const -> ads::mipmap_minmax<uint8_t> {
 		return adrian::read_mipmap(th, id_, bin_size, ch, fr);
@@ -732,6 +1588,10 @@ struct catch_buffer {
 	auto copy(ez::nort_t th, ads::frame_idx start, ads::data<float, DestChs, DestFrs>* dest, ads::frame_idx dest_start, ads::frame_count frame_count) -> ads::frame_count {
 		return adrian::copy(th, id_, start, dest, dest_start, frame_count);
 	}
+	[[nodiscard]]
+	auto linearize(ez::nort_t th, ads::frame_idx start, ads::frame_count frame_count, chain_options options, std::any client_data) const -> chain_id {
+		return adrian::linearize(th, id_, start, frame_count, options, client_data);
+	}
 	template <typename ReadFn> requires ads::concepts::is_read_fn<float, ReadFn>
 	auto read(ez::nort_t th, ads::frame_idx start, ads::frame_count frame_count, ReadFn read_fn) -> ads::frame_count {
 		return adrian::read(th, id_, start, frame_count, read_fn);
@@ -740,6 +1600,11 @@ struct catch_buffer {
 	auto read(ez::nort_t th, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count, ReadFn read_fn) -> ads::frame_count {
 		return adrian::read(th, id_, ch, start, frame_count, read_fn);
 	}
+	template <typename ReadFn> requires ads::concepts::is_multi_channel_read_fn<float, ReadFn>
+	auto read_validated(ez::nort_t th, ads::frame_idx start, ads::frame_count frame_count, uint64_t since, int attempts, ReadFn read_fn) -> catch_buffer_read_status {
+		return adrian::read_validated(th, id_, start, frame_count, since, attempts, read_fn);
+	}
+	[[nodiscard]] auto get_write_generation(ez::nort_t th) const -> uint64_t { return adrian::get_write_generation(th, id_); }
 private:
 	auto erase() -> void {
 		if (id_) {
@@ -0,0 +1,291 @@
+#pragma once
+
+#include "adrian-chain.hpp"
+#include <vector>
+
+// EDITING ------------------------------------------------------------------------------------------------
+//
+// An edit describes the new contents of a chain as a list of segments, each
+// of which is either a region of an existing chain or silence. The chain is
+// then rebuilt one sub-buffer at a time:
+//
+// - If a sub-buffer of the new chain lines up exactly with a sub-buffer of
+//   the chain being edited, the pool buffer is simply moved to its new slot
+//   (along with its mipmap.)
+// - If it lines up exactly with a sub-buffer of some other chain (or of the
+//   same chain, if that pool buffer was already used) the storage is shared,
+//   copy-on-write.
+// - Otherwise a fresh pool buffer is filled by copying frames into it.
+//
+// So an edit whose offsets are all multiples of BUFFER_SIZE is just a
+// remapping of sub-buffer indices, and an edit which shifts the rest of the
+// chain by a multiple of BUFFER_SIZE only copies the sub-buffers at the
+// boundaries of the edit.
+//
+// Buffers which are visible to the audio thread are never written to. The
+// frames which are copied are scary reads though, so the caller shouldn't
+// be writing to the affected regions at the same time.
+//
+//---------------------------------------------------------------------------------------------------------
+namespace adrian::detail::edit {
+
+struct segment {
+	std::optional<chain::model> src; // Silence, if empty
+	ads::frame_idx start;
+	ads::frame_count frame_count;
+};
+
+using layout = std::vector<segment>;
+
+[[nodiscard]] inline
+auto get_frame_count(const layout& segments) -> ads::frame_count {
+	auto out = ads::frame_count{0};
+	for (const auto& s : segments) {
+		out.value += s.frame_count.value;
+	}
+	return out;
+}
+
+inline
+auto check_editable(const chain::model& chain) -> void {
+	if (is_disk_backed(chain)) {
+		throw std::runtime_error("disk-backed chains can't be edited");
+	}
+	if (!chain.buffers) {
+		throw std::runtime_error("can't edit a chain which hasn't finished loading");
+	}
+}
+
+inline
+auto check_region(const chain::model& chain, ads::frame_idx start, ads::frame_count frame_count) -> void {
+	if (start.value < 0 || start.value + frame_count.value > chain.requested_frame_count.value) {
+		throw std::runtime_error(std::format("region [{}, {}) is outside of the chain (length {})", start.value, start.value + frame_count.value, chain.requested_frame_count.value));
+	}
+}
+
+// Appends the segment of the chain's current contents
+// which starts at 'start' and has the given length.
+inline
+auto push_chain_segment(layout* segments, const chain::model& chain, ads::frame_idx start, ads::frame_count frame_count) -> void {
+	if (frame_count.value > 0) {
+		segments->push_back({chain, start, frame_count});
+	}
+}
+
+inline
+auto push_silence(layout* segments, ads::frame_count frame_count) -> void {
+	if (frame_count.value > 0) {
+		segments->push_back({std::nullopt, {}, frame_count});
+	}
+}
+
+struct slot_source {
+	const chain::model* src = nullptr;
+	size_t slot;
+	buffer_idx idx;
+};
+
+// If the frames which belong in the slot [slot_beg, slot_end) all come
+// from a single sub-buffer of a chain, at the same offsets, return it.
+[[nodiscard]] inline
+auto find_whole_sub_buffer(const layout& segments, uint64_t slot_beg, uint64_t slot_end) -> std::optional<slot_source> {
+	uint64_t seg_beg = 0;
+	for (const auto& s : segments) {
+		const auto seg_end = seg_beg + s.frame_count.value;
+		if (slot_beg >= seg_beg && slot_beg < seg_end) {
+			if (!s.src || slot_end > seg_end) {
+				return std::nullopt;
+			}
+			const auto src_frame = static_cast<uint64_t>(s.start.value) + (slot_beg - seg_beg);
+			if (src_frame % BUFFER_SIZE != 0) {
+				return std::nullopt;
+			}
+			const auto slot = src_frame / BUFFER_SIZE;
+			return slot_source{&*s.src, slot, s.src->buffers->at(slot)};
+		}
+		seg_beg = seg_end;
+	}
+	return std::nullopt;
+}
+
+inline
+auto copy_frames(const buffer::storage& src, ads::frame_idx src_start, buffer::storage* dest, ads::frame_idx dest_start, ads::frame_count frame_count) -> void {
+	auto write = [&src, src_start](float* buffer, ads::channel_idx ch, ads::frame_idx, ads::frame_count frame_count) {
+		auto read = [buffer](const float* src_buffer, ads::frame_idx, ads::frame_count frame_count) {
+			std::copy(src_buffer, src_buffer + frame_count.value, buffer);
+			return frame_count;
+		};
+		return src.read(ch, src_start, frame_count, read);
+	};
+	dest->write(dest_start, frame_count, write);
+}
+
+// Copy the frames which belong in the slot [slot_beg, slot_end) into
+// the storage of a fresh buffer. Silent segments are left as zeros.
+inline
+auto fill_slot(const model& m, const layout& segments, uint64_t slot_beg, uint64_t slot_end, buffer::storage* dest) -> void {
+	uint64_t seg_beg = 0;
+	for (const auto& s : segments) {
+		const auto seg_end = seg_beg + s.frame_count.value;
+		const auto beg     = std::max(seg_beg, slot_beg);
+		const auto end     = std::min(seg_end, slot_end);
+		if (s.src && beg < end) {
+			auto src_frame  = static_cast<uint64_t>(s.start.value) + (beg - seg_beg);
+			auto dest_frame = beg - slot_beg;
+			auto remaining  = end - beg;
+			while (remaining > 0) {
+				const auto src_local  = src_frame % BUFFER_SIZE;
+				const auto count      = std::min(remaining, BUFFER_SIZE - src_local);
+				const auto src_idx    = s.src->buffers->at(src_frame / BUFFER_SIZE);
+				const auto& src_store = *get_storage(get_buffer_service(m, *s.src, src_idx)->critical);
+				copy_frames(src_store, ads::frame_idx{static_cast<int64_t>(src_local)}, dest, ads::frame_idx{static_cast<int64_t>(dest_frame)}, ads::frame_count{count});
+				src_frame  += count;
+				dest_frame += count;
+				remaining  -= count;
+			}
+		}
+		seg_beg = seg_end;
+	}
+}
+
+// Replace the contents of the chain with the given segments.
+[[nodiscard]] inline
+auto rebuild(ez::nort_t th, model m, chain_id id, const layout& segments) -> model {
+	auto chain = m.chains.at(id);
+	const auto old_buffers      = *chain.buffers;
+	const auto frame_count      = get_frame_count(segments);
+	const auto new_buffer_count = buffer_count(frame_count);
+	auto moved   = std::vector<bool>(old_buffers.size(), false);
+	auto buffers = immer::vector<buffer_idx>{};
+	for (size_t slot = 0; slot < new_buffer_count; slot++) {
+		const auto slot_beg = slot * BUFFER_SIZE;
+		const auto slot_end = std::min(slot_beg + BUFFER_SIZE, frame_count.value);
+		buffer_idx idx;
+		if (const auto whole = find_whole_sub_buffer(segments, slot_beg, slot_end)) {
+			if (whole->src->id == id && !moved[whole->slot]) {
+				moved[whole->slot] = true;
+				buffers = buffers.push_back(whole->idx);
+				continue;
+			}
+			m = enable_reserve(std::move(m), chain.channel_count);
+			std::tie(m, idx) = find_unused_or_create_new_shared_buffer(th, std::move(m), chain.channel_count, whole->idx);
+		}
+		else {
+			std::tie(m, idx) = find_unused_or_create_new_buffer(th, std::move(m), chain.channel_count);
+			fill_slot(m, segments, slot_beg, slot_end, get_storage(get_buffer_service(m, chain, idx)->critical));
+		}
+		m = set_as_in_use(std::move(m), chain.channel_count, idx);
+		m = attach_dirty_mipmap(std::move(m), chain, idx);
+		buffers = buffers.push_back(idx);
+	}
+	for (size_t i = 0; i < old_buffers.size(); i++) {
+		if (!moved[i]) {
+			m = release(std::move(m), chain.channel_count, old_buffers[i]);
+		}
+	}
+	chain.buffers               = std::move(buffers);
+	chain.requested_frame_count = frame_count;
+	chain.actual_frame_count    = {new_buffer_count * BUFFER_SIZE};
+	m.chains = std::move(m.chains).insert(std::move(chain));
+	return m;
+}
+
+[[nodiscard]] inline
+auto erase_frames(ez::nort_t th, model m, chain_id id, ads::frame_idx start, ads::frame_count frame_count) -> model {
+	const auto chain = m.chains.at(id);
+	check_editable(chain);
+	check_region(chain, start, frame_count);
+	const auto end = ads::frame_idx{start.value + static_cast<int64_t>(frame_count.value)};
+	auto segments = layout{};
+	push_chain_segment(&segments, chain, ads::frame_idx{0}, ads::frame_count{static_cast<uint64_t>(start.value)});
+	push_chain_segment(&segments, chain, end, ads::frame_count{chain.requested_frame_count.value - end.value});
+	return rebuild(th, std::move(m), id, segments);
+}
+
+[[nodiscard]] inline
+auto insert_silence(ez::nort_t th, model m, chain_id id, ads::frame_idx at, ads::frame_count frame_count) -> model {
+	const auto chain = m.chains.at(id);
+	check_editable(chain);
+	check_region(chain, at, {});
+	auto segments = layout{};
+	push_chain_segment(&segments, chain, ads::frame_idx{0}, ads::frame_count{static_cast<uint64_t>(at.value)});
+	push_silence(&segments, frame_count);
+	push_chain_segment(&segments, chain, at, ads::frame_count{chain.requested_frame_count.value - at.value});
+	return rebuild(th, std::move(m), id, segments);
+}
+
+// Insert a region of the source chain into the destination chain. The source
+// chain is left alone (it can also be the destination chain.) Aligned sub-buffers
+// share their storage with the source, copy-on-write.
+[[nodiscard]] inline
+auto splice(ez::nort_t th, model m, chain_id dest_id, ads::frame_idx at, chain_id src_id, ads::frame_idx src_start, ads::frame_count frame_count) -> model {
+	const auto dest = m.chains.at(dest_id);
+	const auto src  = m.chains.at(src_id);
+	check_editable(dest);
+	check_editable(src);
+	check_region(dest, at, {});
+	check_region(src, src_start, frame_count);
+	if (src.channel_count != dest.channel_count) {
+		throw std::runtime_error(std::format("can't splice a {} channel chain into a {} channel chain", src.channel_count.value, dest.channel_count.value));
+	}
+	auto segments = layout{};
+	push_chain_segment(&segments, dest, ads::frame_idx{0}, ads::frame_count{static_cast<uint64_t>(at.value)});
+	push_chain_segment(&segments, src, src_start, frame_count);
+	push_chain_segment(&segments, dest, at, ads::frame_count{dest.requested_frame_count.value - at.value});
+	return rebuild(th, std::move(m), dest_id, segments);
+}
+
+} // adrian::detail::edit
+
+namespace adrian::detail {
+
+// fn returns the edited model along with the chain which was edited or
+// created, so that only that chain's sub-buffers go on the dirty list.
+[[nodiscard]] inline
+auto publish_edit(ez::nort_t th, service::model* service, auto fn) -> chain_id {
+	chain_id id;
+	service->model.update_publish(th, [fn, &id](detail::model&& m) {
+		std::tie(m, id) = fn(std::move(m));
+		return std::move(m);
+	});
+	push_dirty_mipmaps(th, service->model.read(th), id);
+	// Spliced sub-buffers may share their storage so wake
+	// up the allocation thread to fill the copy-on-write reserve.
+	service->critical.cv_allocation_thread_wait.notify_one();
+	return id;
+}
+
+} // adrian::detail
+
+// public interface ----------------------------------------------------------------
+namespace adrian {
+
+// Remove a region of the chain. Everything after it moves back.
+// The chain gets shorter.
+inline
+auto erase_frames(ez::nort_t th, chain_id id, ads::frame_idx start, ads::frame_count frame_count) -> void {
+	std::ignore = detail::publish_edit(th, &detail::service_, [=](detail::model&& m) {
+		return std::make_tuple(detail::edit::erase_frames(ez::nort, std::move(m), id, start, frame_count), id);
+	});
+}
+
+// Insert silence into the chain. Everything after it moves forward.
+// The chain gets longer.
+inline
+auto insert_silence(ez::nort_t th, chain_id id, ads::frame_idx at, ads::frame_count frame_count) -> void {
+	std::ignore = detail::publish_edit(th, &detail::service_, [=](detail::model&& m) {
+		return std::make_tuple(detail::edit::insert_silence(ez::nort, std::move(m), id, at, frame_count), id);
+	});
+}
+
+// Insert a copy of a region of the source chain into the destination
+// chain. Everything after it moves forward. The destination chain gets
+// longer. Both chains must have the same channel count.
+inline
+auto splice(ez::nort_t th, chain_id dest, ads::frame_idx at, chain_id src, ads::frame_idx src_start, ads::frame_count frame_count) -> void {
+	std::ignore = detail::publish_edit(th, &detail::service_, [=](detail::model&& m) {
+		return std::make_tuple(detail::edit::splice(ez::nort, std::move(m), dest, at, src, src_start, frame_count), dest);
+	});
+}
+
+} // adrian
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "adrian-buffer.hpp"
+#include <algorithm>
+#include <cmath>
+
+// The per-sub-buffer mipmaps can't summarize more than one sub-buffer per
+// bin, so views which are zoomed out further than that read from the chain
+// overview instead. Each value at level N covers 2^N sub-buffers so any
+// zoom level is O(1) per bin. The overview is built the first time it's
+// needed and then kept up to date as the sub-buffer mipmaps are updated.
+// Values are floats whatever the chain's mipmap_format is, so zooming out
+// doesn't lose precision, and each value carries the mean square of the
+// sub-buffers under it so the RMS covers the same frames as the min/max.
+namespace adrian::detail::overview {
+
+using value = chain::overview_value;
+
+// The two values cover the same number of sub-buffers.
+[[nodiscard]] inline
+auto merge(value a, value b) -> value {
+	return {std::min(a.min, b.min), std::max(a.max, b.max), (a.mean_square + b.mean_square) * 0.5f};
+}
+
+[[nodiscard]] inline
+auto silence() -> value {
+	return {};
+}
+
+// Merges any number of values which each cover the same number of frames.
+struct accumulator {
+	auto add(value v) -> void {
+		if (count == 0) {
+			min = v.min;
+			max = v.max;
+		}
+		else {
+			min = std::min(min, v.min);
+			max = std::max(max, v.max);
+		}
+		sum_mean_square += v.mean_square;
+		count++;
+	}
+	[[nodiscard]] auto empty() const -> bool { return count == 0; }
+	[[nodiscard]] auto get() const -> value {
+		if (count == 0) { return silence(); }
+		return {min, max, static_cast<float>(sum_mean_square / static_cast<double>(count))};
+	}
+private:
+	float min = 0.0f;
+	float max = 0.0f;
+	double sum_mean_square = 0.0;
+	size_t count = 0;
+};
+
+[[nodiscard]] inline
+auto to_minmax(value v) -> ads::mipmap_minmax<uint8_t> {
+	return {ads::encode<uint8_t>(v.min), ads::encode<uint8_t>(v.max)};
+}
+
+[[nodiscard]] inline
+auto to_mipmap_value(value v) -> mipmap_value {
+	return {v.min, v.max, std::sqrt(v.mean_square)};
+}
+
+[[nodiscard]] inline
+auto get_level_size(const chain::overview& o, const chain::model& chain, size_t level) -> size_t {
+	return o.levels[level].size() / chain.channel_count.value;
+}
+
+// Read the top LOD of the sub-buffer's mipmap.
+[[nodiscard]] inline
+auto summarize(const model& m, const chain::model& chain, buffer_idx idx, ads::channel_idx ch) -> value {
+	if (!idx) {
+		// Paged out.
+		return silence();
+	}
+	const auto mipmap = get_mipmap(m, chain.channel_count, idx);
+	if (!mipmap) {
+		return silence();
+	}
+	const auto lod    = bin_size_to_lod(*mipmap, static_cast<double>(BUFFER_SIZE));
+	const auto minmax = read_value(*mipmap, lod, ch, ads::frame_idx{0});
+	return {minmax.min, minmax.max, read_mean_square(*mipmap, lod, ch, ads::frame_idx{0})};
+}
+
+// Merge the pair of values below this one.
+inline
+auto merge_from_below(const chain::model& chain, chain::overview* o, size_t level, size_t i) -> void {
+	const auto& below  = o->levels[level - 1];
+	const auto n_below = get_level_size(*o, chain, level - 1);
+	const auto n       = get_level_size(*o, chain, level);
+	for (auto ch = ads::channel_idx{0}; ch < chain.channel_count; ch++) {
+		const auto a = below[(ch.value * n_below) + (i * 2)];
+		const auto b = (i * 2) + 1 < n_below ? below[(ch.value * n_below) + (i * 2) + 1] : a;
+		o->levels[level][(ch.value * n) + i] = merge(a, b);
+	}
+}
+
+inline
+auto set_slot(const model& m, const chain::model& chain, chain::overview* o, size_t slot) -> void {
+	for (auto ch = ads::channel_idx{0}; ch < chain.channel_count; ch++) {
+		o->levels[0][(ch.value * o->buffers.size()) + slot] = summarize(m, chain, o->buffers[slot], ch);
+	}
+}
+
+[[nodiscard]] inline
+auto is_current(const chain::overview& o, const chain::model& chain) -> bool {
+	return o.buffers == *chain.buffers && o.mipmap_version == chain.mipmap_version;
+}
+
+[[nodiscard]] inline
+auto build(const model& m, const chain::model& chain) -> chain::overview {
+	chain::overview o;
+	o.buffers        = *chain.buffers;
+	o.mipmap_version = chain.mipmap_version;
+	auto n = std::max(o.buffers.size(), size_t{1});
+	for (;;) {
+		o.levels.emplace_back(n * chain.channel_count.value, silence());
+		if (n == 1) { break; }
+		n = (n + 1) / 2;
+	}
+	for (size_t slot = 0; slot < o.buffers.size(); slot++) {
+		set_slot(m, chain, &o, slot);
+	}
+	for (size_t level = 1; level < o.levels.size(); level++) {
+		for (size_t i = 0; i < get_level_size(o, chain, level); i++) {
+			merge_from_below(chain, &o, level, i);
+		}
+	}
+	return o;
+}
+
+// Called after the LODs of one of the chain's sub-buffers were updated.
+// If the chain's sub-buffers or mipmaps have changed since the overview was built
+// then it is thrown away and rebuilt the next time it's read.
+inline
+auto update(ez::ui_t, service::model* service, const model& m, const mipmap::touched_buffer& touched) -> void {
+	auto& overviews = service->ui.chain_overviews;
+	const auto pos = overviews.find(touched.chain);
+	if (pos == overviews.end()) {
+		return;
+	}
+	const auto chain = m.chains.find(touched.chain);
+	if (!chain || !chain->buffers || !is_current(pos->second, *chain)) {
+		overviews.erase(pos);
+		return;
+	}
+	auto& o = pos->second;
+	if (touched.slot >= o.buffers.size()) {
+		return;
+	}
+	set_slot(m, *chain, &o, touched.slot);
+	// Only the values above the slot in each level need recalculating.
+	for (size_t level = 1, i = touched.slot / 2; level < o.levels.size(); level++, i /= 2) {
+		merge_from_below(*chain, &o, level, i);
+	}
+}
+
+// Forget the overviews of chains which no longer exist.
+inline
+auto prune(ez::ui_t, service::model* service, const model& m) -> void {
+	std::erase_if(service->ui.chain_overviews, [&m](const auto& entry) {
+		return !m.chains.find(entry.first);
+	});
+}
+
+[[nodiscard]] inline
+auto get(ez::ui_t, service::model* service, const model& m, const chain::model& chain) -> const chain::overview& {
+	auto& o = service->ui.chain_overviews[chain.id];
+	if (o.levels.empty() || !is_current(o, chain)) {
+		o = build(m, chain);
+	}
+	return o;
+}
+
+// Level 0 is one sub-buffer per bin, level 1 is two, and so on.
+[[nodiscard]] inline
+auto read(const chain::overview& o, const chain::model& chain, size_t level, ads::channel_idx ch, size_t slot) -> value {
+	level = std::min(level, o.levels.size() - 1);
+	return o.levels[level][(ch.value * get_level_size(o, chain, level)) + (slot >> level)];
+}
+
+[[nodiscard]] inline
+auto bin_size_to_level(double bin_size) -> size_t {
+	return static_cast<size_t>(std::floor(std::log2(bin_size / static_cast<double>(BUFFER_SIZE))));
+}
+
+} // adrian::detail::overview
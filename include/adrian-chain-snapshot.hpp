@@ -0,0 +1,324 @@
+#pragma once
+
+#include "adrian-chain.hpp"
+#include <istream>
+#include <ostream>
+
+// SNAPSHOT FORMAT ----------------------------------------------------------------------------------------
+//
+// All values are written in native byte order.
+//
+//   header
+//   sub-buffer 0: channel 0 samples (BUFFER_SIZE floats), channel 1 samples, ...
+//   sub-buffer 1: ...
+//   ...
+//   [if header.flags & has_mipmaps]
+//   sub-buffer 0: channel 0 encoded mipmap values (BUFFER_SIZE uint8s), channel 1 ...
+//   sub-buffer 1: ...
+//   ...
+//
+// Every sub-buffer record is exactly the size of a pool buffer, so loading
+// is just a matter of reading each record straight into the storage of a
+// freshly allocated pool buffer.
+//
+//---------------------------------------------------------------------------------------------------------
+namespace adrian {
+
+struct snapshot_options {
+	bool include_mipmaps = false;
+};
+
+} // adrian
+
+namespace adrian::detail::snapshot {
+
+static constexpr auto MAGIC   = std::array<char, 4>{'A', 'D', 'R', 'N'};
+static constexpr auto VERSION = uint32_t{1};
+
+struct flags {
+	enum e {
+		has_mipmaps = 1 << 0,
+	};
+};
+
+struct header {
+	std::array<char, 4> magic = MAGIC;
+	uint32_t version          = VERSION;
+	uint32_t flags            = 0;
+	uint32_t channel_count    = 0;
+	uint64_t buffer_size      = BUFFER_SIZE;
+	uint64_t frame_count      = 0;
+	uint64_t buffer_count     = 0;
+};
+
+[[nodiscard]] inline
+auto get_record_size(ads::channel_count channel_count) -> size_t {
+	return channel_count.value * BUFFER_SIZE * sizeof(float);
+}
+
+inline
+auto write_bytes(std::ostream& out, const void* data, size_t size) -> void {
+	out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+	if (!out) {
+		throw std::runtime_error("failed to write chain snapshot");
+	}
+}
+
+inline
+auto read_bytes(std::istream& in, void* data, size_t size) -> void {
+	in.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+	if (in.gcount() != static_cast<std::streamsize>(size)) {
+		throw std::runtime_error("unexpected end of chain snapshot");
+	}
+}
+
+[[nodiscard]] inline
+auto read_header(std::istream& in) -> header {
+	header h;
+	read_bytes(in, &h, sizeof(header));
+	if (h.magic != MAGIC) {
+		throw std::runtime_error("not a chain snapshot");
+	}
+	if (h.version != VERSION) {
+		throw std::runtime_error(std::format("unsupported chain snapshot version {}", h.version));
+	}
+	if (h.buffer_size != BUFFER_SIZE) {
+		throw std::runtime_error(std::format("chain snapshot buffer size {} doesn't match buffer size {}", h.buffer_size, BUFFER_SIZE));
+	}
+	if (h.channel_count == 0) {
+		throw std::runtime_error("chain snapshot has no channels");
+	}
+	if (h.buffer_count != buffer_count(ads::frame_count{h.frame_count})) {
+		throw std::runtime_error(std::format("chain snapshot buffer count {} doesn't match frame count {}", h.buffer_count, h.frame_count));
+	}
+	return h;
+}
+
+// Sub-buffers of disk-backed chains which are paged out are
+// read straight from the backing file.
+inline
+auto save_record(std::ostream& out, const model& m, const chain::model& chain, size_t slot) -> void {
+	const auto idx = (*chain.buffers)[slot];
+	if (!idx) {
+		const auto offset = get_backing_file_offset(chain.channel_count, slot);
+		write_bytes(out, chain.file->data + offset, get_record_size(chain.channel_count));
+		return;
+	}
+	const auto& storage = *get_storage(get_buffer_service(m, chain, idx)->critical);
+	for (auto ch = ads::channel_idx{}; ch < chain.channel_count; ch++) {
+		auto write_to_stream = [&out](const float* buffer, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
+			write_bytes(out, buffer, frame_count.value * sizeof(float));
+			return frame_count;
+		};
+		storage.read(ch, ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, write_to_stream);
+	}
+}
+
+inline
+auto save_mipmap_record(std::ostream& out, const model& m, const chain::model& chain, size_t slot) -> void {
+	auto plane = std::array<uint8_t, BUFFER_SIZE>{};
+	auto encode = [&plane](const float* buffer, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
+		for (size_t i = 0; i < frame_count.value; i++) {
+			plane[i] = ads::encode<uint8_t>(buffer[i]);
+		}
+		return frame_count;
+	};
+	const auto idx = (*chain.buffers)[slot];
+	for (auto ch = ads::channel_idx{}; ch < chain.channel_count; ch++) {
+		if (idx) {
+			get_storage(get_buffer_service(m, chain, idx)->critical)->read(ch, ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, encode);
+		}
+		else {
+			const auto offset = get_backing_file_offset(chain.channel_count, slot) + (ch.value * BUFFER_SIZE * sizeof(float));
+			encode(reinterpret_cast<const float*>(chain.file->data + offset), ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE});
+		}
+		write_bytes(out, plane.data(), plane.size());
+	}
+}
+
+inline
+auto save(const model& m, chain_id id, std::ostream& out, snapshot_options options) -> void {
+	const auto& chain = m.chains.at(id);
+	if (!chain.buffers) {
+		throw std::runtime_error("can't save a chain which hasn't finished loading");
+	}
+	header h;
+	h.flags         = set_flag(0, flags::has_mipmaps, options.include_mipmaps);
+	h.channel_count = static_cast<uint32_t>(chain.channel_count.value);
+	h.frame_count   = chain.requested_frame_count.value;
+	h.buffer_count  = chain.buffers->size();
+	write_bytes(out, &h, sizeof(header));
+	for (size_t slot = 0; slot < chain.buffers->size(); slot++) {
+		save_record(out, m, chain, slot);
+	}
+	if (options.include_mipmaps) {
+		for (size_t slot = 0; slot < chain.buffers->size(); slot++) {
+			save_mipmap_record(out, m, chain, slot);
+		}
+	}
+}
+
+inline
+auto load_record(std::istream& in, buffer::service::model* service) -> void {
+	auto read_from_stream = [&in](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) -> ads::frame_count {
+		read_bytes(in, buffer, frame_count.value * sizeof(float));
+		return frame_count;
+	};
+	get_storage(service->critical)->write(ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, read_from_stream);
+}
+
+inline
+auto load_mipmap_record(std::istream& in, const header& h, buffer::mipmap* mipmap) -> void {
+	auto planes = std::vector<uint8_t>(h.channel_count * BUFFER_SIZE);
+	read_bytes(in, planes.data(), planes.size());
+	auto get_value = [&planes](ads::channel_idx ch, ads::frame_idx fr) {
+		return planes[(ch.value * BUFFER_SIZE) + fr.value];
+	};
+	mipmap->lods.write(ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, get_value);
+	mipmap->lods.update(get_whole_region());
+}
+
+// If mipmaps are enabled but weren't saved then they are built straight
+// from the loaded samples, in parallel. They are published along with
+// the chain.
+[[nodiscard]] inline
+auto build_mipmaps(service::model* service, const model& m, ads::channel_count channel_count, const immer::vector<buffer_idx>& buffers, mipmap_format format) -> std::vector<buffer::mipmap_ptr> {
+	auto mipmaps = std::vector<buffer::mipmap_ptr>(buffers.size());
+	auto scratch = std::vector<mipmap::scratch>(get_worker_count(buffers.size()));
+	parallel_for(&service->workers, buffers.size(), [&](size_t worker, size_t slot) {
+		const auto& storage = *get_storage(get_buffer_service(m, channel_count, buffers[slot])->critical);
+		mipmaps[slot] = build_mipmap(storage, channel_count, format, &scratch[worker]);
+	});
+	return mipmaps;
+}
+
+[[nodiscard]] inline
+auto make_loaded_chain(model m, const header& h, chain_options options, std::any client_data) -> std::tuple<model, chain::model> {
+	chain::model chain;
+	chain.id                    = {++m.next_id};
+	chain.flags                 = set_flag(chain.flags, chain.flags.generate_mipmaps, options.enable_mipmaps);
+	chain.flags                 = set_flag(chain.flags, chain.flags.silent, options.silent);
+	chain.channel_count         = ads::channel_count{h.channel_count};
+	chain.requested_frame_count = ads::frame_count{h.frame_count};
+	chain.actual_frame_count    = {h.buffer_count * BUFFER_SIZE};
+	chain.mipmap_format         = options.mipmap_format;
+	chain.client_data           = client_data;
+	return std::make_tuple(std::move(m), std::move(chain));
+}
+
+// Disk-backed chains are loaded straight into the backing file.
+[[nodiscard]] inline
+auto load_disk_backed(ez::nort_t th, service::model* service, std::istream& in, const header& h, chain_options options, std::any client_data) -> chain_id {
+	const auto channel_count = ads::channel_count{h.channel_count};
+	const auto file = mapped_file::open(options.backing_file, get_backing_file_size(channel_count, h.buffer_count), mapped_file::mode::create);
+	read_bytes(in, file->data, get_backing_file_size(channel_count, h.buffer_count));
+	if (is_flag_set(h.flags, flags::has_mipmaps)) {
+		in.ignore(static_cast<std::streamsize>(h.buffer_count * h.channel_count * BUFFER_SIZE));
+	}
+	chain_id id;
+	service->model.update_publish(th, [&](model&& m) {
+		chain::model chain;
+		std::tie(m, chain) = make_loaded_chain(std::move(m), h, options, client_data);
+		chain              = set_disk_backed(std::move(chain), file, h.buffer_count);
+		id                 = chain.id;
+		m.chains = std::move(m.chains).insert(std::move(chain));
+		return std::move(m);
+	});
+	return id;
+}
+
+// 1. Reserve the pool buffers.
+// 2. Stream the snapshot straight into them without holding up the model.
+// 3. Publish the chain.
+[[nodiscard]] inline
+auto load(ez::nort_t th, service::model* service, std::istream& in, chain_options options, std::any client_data) -> chain_id {
+	const auto h = read_header(in);
+	if (!options.backing_file.empty()) {
+		return load_disk_backed(th, service, in, h, options, client_data);
+	}
+	const auto channel_count = ads::channel_count{h.channel_count};
+	auto buffers = immer::vector<buffer_idx>{};
+	service->model.update_publish(th, [&](model&& m) {
+		for (size_t i = 0; i < h.buffer_count; i++) {
+			buffer_idx idx;
+			std::tie(m, idx) = find_unused_or_create_new_buffer(th, std::move(m), channel_count);
+			m = set_as_in_use(std::move(m), channel_count, idx);
+			if (options.enable_mipmaps) {
+				std::tie(m, std::ignore) = attach_mipmap(std::move(m), channel_count, idx, options.mipmap_format);
+			}
+			buffers = buffers.push_back(idx);
+		}
+		return std::move(m);
+	});
+	auto release_all = [&](model&& m) {
+		for (const auto idx : buffers) {
+			m = release(std::move(m), channel_count, idx);
+		}
+		return std::move(m);
+	};
+	auto built_mipmaps = std::vector<buffer::mipmap_ptr>{};
+	try {
+		const auto m = service->model.read(th);
+		for (const auto idx : buffers) {
+			load_record(in, get_buffer_service(m, channel_count, idx).get());
+		}
+		const auto has_mipmaps = is_flag_set(h.flags, flags::has_mipmaps);
+		// The saved values are uint8 so they're only any use to chains in that format.
+		const auto use_saved_mipmaps = has_mipmaps && options.mipmap_format == mipmap_format::uint8_minmax;
+		if (has_mipmaps && !(options.enable_mipmaps && use_saved_mipmaps)) {
+			in.ignore(static_cast<std::streamsize>(h.buffer_count * h.channel_count * BUFFER_SIZE));
+		}
+		if (options.enable_mipmaps) {
+			if (use_saved_mipmaps) {
+				for (const auto idx : buffers) {
+					load_mipmap_record(in, h, get_mipmap(m, channel_count, idx).get());
+				}
+			}
+			else {
+				built_mipmaps = build_mipmaps(service, m, channel_count, buffers, options.mipmap_format);
+			}
+		}
+	}
+	catch (...) {
+		service->model.update_publish(th, release_all);
+		throw;
+	}
+	chain_id id;
+	service->model.update_publish(th, [&](model&& m) {
+		chain::model chain;
+		std::tie(m, chain) = make_loaded_chain(std::move(m), h, options, client_data);
+		chain.buffers      = buffers;
+		id                 = chain.id;
+		m.chains = std::move(m.chains).insert(std::move(chain));
+		for (size_t slot = 0; slot < built_mipmaps.size(); slot++) {
+			m = set_mipmap(std::move(m), channel_count, buffers[slot], built_mipmaps[slot]);
+		}
+		return std::move(m);
+	});
+	return id;
+}
+
+} // adrian::detail::snapshot
+
+// public interface ----------------------------------------------------------------
+namespace adrian {
+
+// Write the contents of the chain to a stream.
+// - This is a scary read. If the chain is being written to
+//   at the same time then the snapshot may be torn.
+// - If include_mipmaps is set, the encoded mipmap values are
+//   saved too so that they don't have to be regenerated
+//   when the snapshot is loaded.
+inline
+auto save(ez::nort_t th, chain_id id, std::ostream& out, snapshot_options options = {}) -> void {
+	detail::snapshot::save(detail::service_.model.read(th), id, out, options);
+}
+
+// Create a new chain from a snapshot written by save().
+// The chain is ready as soon as this returns.
+[[nodiscard]] inline
+auto load_chain(ez::nort_t th, std::istream& in, chain_options options, std::any client_data) -> chain_id {
+	return detail::snapshot::load(th, &detail::service_, in, options, client_data);
+}
+
+} // adrian
@@ -1,8 +1,13 @@
 #pragma once
 
 #include "adrian-buffer.hpp"
+#include "adrian-chain-overview.hpp"
 #include "adrian-concepts.hpp"
 #include "adrian-flags.hpp"
+#include <limits>
+#include <optional>
+#include <span>
+#include <thread>
 #pragma warning(push, 0)
 #include <immer/algorithm.hpp>
 #pragma warning(pop)
@@ -34,6 +39,22 @@ auto finish_loading(immer::vector<buffer_idx> buffers) {
 	};
 }
 
+[[nodiscard]] inline
+auto set_buffer(size_t slot, buffer_idx idx) {
+	return [slot, idx](chain::model x){
+		*x.buffers = x.buffers->set(slot, idx);
+		return x;
+	};
+}
+
+[[nodiscard]] inline
+auto set_hot_regions(immer::vector<hot_region> regions) {
+	return [regions](chain::model x){
+		x.hot_regions = regions;
+		return x;
+	};
+}
+
 [[nodiscard]] inline
 auto set_load_progress(float v) {
 	return [v](chain::model x){
@@ -79,6 +100,156 @@ auto should_generate_mipmaps(const chain::model& c) -> bool {
 	return is_flag_set(c.flags, c.flags.generate_mipmaps);
 }
 
+// Sub-buffers which join a chain that generates mipmaps get a mipmap
+// straight away, rather than waiting for the allocation thread.
+[[nodiscard]] inline
+auto attach_silent_mipmap(model m, const chain::model& chain, buffer_idx idx) -> model {
+	if (should_generate_mipmaps(chain)) {
+		std::tie(m, std::ignore) = attach_mipmap(std::move(m), chain.channel_count, idx, chain.mipmap_format);
+	}
+	return m;
+}
+
+// For sub-buffers which already contain audio. The whole sub-buffer is
+// marked dirty so the caller should push it to the dirty list once the
+// model is published. The sub-buffer isn't visible to the audio thread
+// yet so it's safe to touch the audio state here.
+[[nodiscard]] inline
+auto attach_dirty_mipmap(model m, const chain::model& chain, buffer_idx idx) -> model {
+	if (!should_generate_mipmaps(chain)) {
+		return m;
+	}
+	m = attach_silent_mipmap(std::move(m), chain, idx);
+	auto& audio = get_buffer_service(m, chain.channel_count, idx)->audio;
+	audio.mipmap_dirty_region = grow_dirty_region(audio.mipmap_dirty_region, ads::frame_idx{0}, ads::frame_idx{static_cast<int64_t>(BUFFER_SIZE)});
+	return m;
+}
+
+// Tell the audio thread about a sub-buffer which a non-realtime thread
+// has marked dirty or invalidated, once the model containing it has been
+// published. Pushing one which turns out to be clean costs nothing more
+// than the look at it.
+inline
+auto push_dirty_mipmap(ez::nort_t, const model& m, ads::channel_count channel_count, mipmap::dirty_buffer dirty) -> void {
+	auto& list = *m.buffers.at(channel_count.value).mipmap_dirty;
+	if (!list.v.try_enqueue(dirty)) {
+		list.overflowed = true;
+	}
+}
+
+inline
+auto push_dirty_mipmap(ez::nort_t th, const model& m, chain_id id, size_t slot) -> void {
+	const auto chain = m.chains.find(id);
+	if (!chain || !chain->buffers || slot >= chain->buffers->size() || !should_generate_mipmaps(*chain)) {
+		return;
+	}
+	if (const auto idx = (*chain->buffers)[slot]) {
+		push_dirty_mipmap(th, m, chain->channel_count, {id, idx, slot});
+	}
+}
+
+// Every resident sub-buffer of the chain, for when the whole chain
+// was rebuilt, cloned or edited.
+inline
+auto push_dirty_mipmaps(ez::nort_t th, const model& m, chain_id id) -> void {
+	const auto chain = m.chains.find(id);
+	if (!chain || !chain->buffers) {
+		return;
+	}
+	for (size_t slot = 0; slot < chain->buffers->size(); slot++) {
+		push_dirty_mipmap(th, m, id, slot);
+	}
+}
+
+[[nodiscard]] inline
+auto is_disk_backed(const chain::model& c) -> bool {
+	return is_flag_set(c.flags, c.flags.disk_backed);
+}
+
+[[nodiscard]] inline
+auto is_hot(const chain::model& chain, size_t slot) -> bool {
+	static constexpr auto buffer_size = static_cast<int64_t>(BUFFER_SIZE);
+	static constexpr auto readahead   = static_cast<int64_t>(PAGING_READAHEAD);
+	for (const auto& region : chain.hot_regions) {
+		if (region.frame_count.value == 0) {
+			continue;
+		}
+		const auto beg = std::max(int64_t{0}, region.beg.value);
+		const auto end = region.beg.value + static_cast<int64_t>(region.frame_count.value);
+		if (end <= beg) {
+			continue;
+		}
+		const auto first_slot = beg / buffer_size - readahead;
+		const auto last_slot  = (end - 1) / buffer_size + readahead;
+		if (static_cast<int64_t>(slot) >= first_slot && static_cast<int64_t>(slot) <= last_slot) {
+			return true;
+		}
+	}
+	return false;
+}
+
+[[nodiscard]] inline
+auto is_resident(const chain::model& chain, size_t slot) -> bool {
+	return bool((*chain.buffers)[slot]);
+}
+
+[[nodiscard]] inline
+auto drop_page_ops(immer::vector<page_op> ops, chain_id id) -> immer::vector<page_op> {
+	auto out = immer::vector<page_op>{};
+	for (const auto& op : ops) {
+		if (op.chain != id) {
+			out = std::move(out).push_back(op);
+		}
+	}
+	return out;
+}
+
+// Work out which of the chain's sub-buffers need paging in or out.
+[[nodiscard]] inline
+auto schedule_paging(model m, chain_id id) -> model {
+	m.paging.ins  = drop_page_ops(std::move(m.paging.ins), id);
+	m.paging.outs = drop_page_ops(std::move(m.paging.outs), id);
+	const auto chain = m.chains.find(id);
+	if (!chain || !is_disk_backed(*chain) || !chain->buffers) {
+		return m;
+	}
+	// Pushed in reverse so that they're worked through in order.
+	for (auto slot = chain->buffers->size(); slot-- > 0;) {
+		const auto hot      = is_hot(*chain, slot);
+		const auto resident = is_resident(*chain, slot);
+		if (hot && !resident) { m.paging.ins  = std::move(m.paging.ins).push_back(page_op{id, slot, true}); }
+		if (!hot && resident) { m.paging.outs = std::move(m.paging.outs).push_back(page_op{id, slot, false}); }
+	}
+	return m;
+}
+
+[[nodiscard]] inline
+auto get_next_page_op(const model& m) -> std::optional<page_op> {
+	if (!m.paging.ins.empty())  { return m.paging.ins.back(); }
+	if (!m.paging.outs.empty()) { return m.paging.outs.back(); }
+	return std::nullopt;
+}
+
+[[nodiscard]] inline
+auto pop_page_op(model m, const page_op& op) -> model {
+	auto& ops = op.page_in ? m.paging.ins : m.paging.outs;
+	if (!ops.empty() && ops.back() == op) {
+		ops = std::move(ops).take(ops.size() - 1);
+	}
+	return m;
+}
+
+// Sub-buffers of disk-backed chains which are paged out read as silence
+// and writes to them are dropped. The UI thread reports those.
+static const auto SILENCE = std::array<float, BUFFER_SIZE>{};
+
+inline
+auto drop_paged_out_write(const chain::model& chain) -> void {
+	if (chain.disk_stats) {
+		chain.disk_stats->dropped_writes.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
 [[nodiscard]] inline
 auto clear(model m, chain_id id) -> model {
 	m.chains = std::move(m.chains).update(id, [](chain::model x){
@@ -104,6 +275,16 @@ auto buffer_count(ads::frame_count frame_count) -> size_t {
 	return (frame_count.value + BUFFER_SIZE - 1) / BUFFER_SIZE;
 }
 
+[[nodiscard]] inline
+auto get_backing_file_offset(ads::channel_count channel_count, size_t slot) -> size_t {
+	return slot * channel_count.value * BUFFER_SIZE * sizeof(float);
+}
+
+[[nodiscard]] inline
+auto get_backing_file_size(ads::channel_count channel_count, size_t buffer_count) -> size_t {
+	return get_backing_file_offset(channel_count, buffer_count);
+}
+
 [[nodiscard]] inline
 auto shrink(model m, chain_id id, size_t required_buffer_count) -> model {
 	auto c = m.chains.at(id);
@@ -111,7 +292,9 @@ auto shrink(model m, chain_id id, size_t required_buffer_count) -> model {
 	const auto unneeded_buffers_beg  = c.buffers->size() - required_buffer_count;
 	const auto unneeded_buffers_end  = c.buffers->size();
 	for (size_t i = unneeded_buffers_beg; i < unneeded_buffers_end; i++) {
-		m = release(std::move(m), c.channel_count, (*c.buffers)[i]);
+		if ((*c.buffers)[i]) {
+			m = release(std::move(m), c.channel_count, (*c.buffers)[i]);
+		}
 	}
 	*c.buffers = c.buffers->take(required_buffer_count);
 	m.chains = std::move(m.chains).insert(std::move(c));
@@ -143,6 +326,7 @@ auto allocate_entire_chain_now(ez::nort_t th, model m, chain_id id) -> model {
 		buffer_idx idx;
 		std::tie(m, idx) = find_unused_or_create_new_buffer(th, std::move(m), chain.channel_count);
 		m = set_as_in_use(std::move(m), chain.channel_count, idx);
+		m = attach_silent_mipmap(std::move(m), chain, idx);
 		buffers = buffers.push_back(idx);
 	}
 	chain.buffers = std::move(buffers);
@@ -150,29 +334,96 @@ auto allocate_entire_chain_now(ez::nort_t th, model m, chain_id id) -> model {
 	return m;
 }
 
+// Nothing is allocated up front for a disk-backed chain. Every sub-buffer
+// starts off paged out and the allocation thread pages them in as hot
+// regions are set.
+[[nodiscard]] inline
+auto set_disk_backed(chain::model chain, mapped_file::ptr file, size_t buffer_count) -> chain::model {
+	chain.flags      = set_flag(chain.flags, chain.flags.disk_backed);
+	chain.file       = std::move(file);
+	chain.disk_stats = std::make_shared<chain::disk_stats>();
+	chain.buffers    = immer::vector<buffer_idx>(buffer_count, buffer_idx{});
+	return chain;
+}
+
+[[nodiscard]] inline
+auto make_disk_backed(model m, chain_id id, const std::filesystem::path& path) -> model {
+	auto chain = m.chains.at(id);
+	const auto required_buffer_count = buffer_count(chain.requested_frame_count);
+	auto file = mapped_file::open(path, get_backing_file_size(chain.channel_count, required_buffer_count), mapped_file::mode::create);
+	m.chains = std::move(m.chains).insert(set_disk_backed(std::move(chain), std::move(file), required_buffer_count));
+	return m;
+}
+
 [[nodiscard]] inline
 auto make_chain(ez::nort_t th, model m, ads::channel_count channel_count, ads::frame_count requested_frame_count, chain_options options, std::any client_data) -> std::tuple<model, chain_id> {
 	chain::model chain;
 	chain.id                    = {++m.next_id};
-	chain.flags                 = set_flag(chain.flags, chain.flags.loading, !options.allocate_now);
+	const auto disk_backed      = !options.backing_file.empty();
+	chain.flags                 = set_flag(chain.flags, chain.flags.loading, !options.allocate_now && !disk_backed);
 	chain.flags                 = set_flag(chain.flags, chain.flags.generate_mipmaps, options.enable_mipmaps);
 	chain.flags                 = set_flag(chain.flags, chain.flags.silent, options.silent);
+	chain.flags                 = set_flag(chain.flags, chain.flags.disk_backed, disk_backed);
 	chain.channel_count         = channel_count;
 	chain.actual_frame_count    = {buffer_count(requested_frame_count) * BUFFER_SIZE};
 	chain.requested_frame_count = requested_frame_count;
+	chain.mipmap_format         = options.mipmap_format;
 	chain.buffers               = std::nullopt;
 	chain.client_data           = client_data;
 	m.chains = std::move(m.chains).insert(chain);
-	if (options.allocate_now) { m = allocate_entire_chain_now(th, std::move(m), chain.id); }
-	else                      { m = make_loading_chain(std::move(m), chain.id, channel_count); }
+	if (disk_backed)               { m = make_disk_backed(std::move(m), chain.id, options.backing_file); }
+	else if (options.allocate_now) { m = allocate_entire_chain_now(th, std::move(m), chain.id); }
+	else                           { m = make_loading_chain(std::move(m), chain.id, channel_count); }
 	return std::make_tuple(std::move(m), chain.id);
 }
 
+// The clone shares the storage of all of the source chain's sub-buffers.
+// A sub-buffer is only copied when one of the chains writes to it.
+[[nodiscard]] inline
+auto clone(ez::nort_t th, model m, chain_id src_id, std::any client_data) -> std::tuple<model, chain_id> {
+	auto chain = m.chains.at(src_id);
+	if (is_disk_backed(chain)) {
+		throw std::runtime_error("disk-backed chains can't be cloned");
+	}
+	if (!chain.buffers) {
+		throw std::runtime_error("can't clone a chain which hasn't finished loading");
+	}
+	m = enable_reserve(std::move(m), chain.channel_count);
+	auto buffers = immer::vector<buffer_idx>{};
+	for (const auto src_idx : *chain.buffers) {
+		buffer_idx idx;
+		std::tie(m, idx) = find_unused_or_create_new_shared_buffer(th, std::move(m), chain.channel_count, src_idx);
+		m = set_as_in_use(std::move(m), chain.channel_count, idx);
+		m = attach_dirty_mipmap(std::move(m), chain, idx);
+		buffers = buffers.push_back(idx);
+	}
+	chain.id          = {++m.next_id};
+	chain.buffers     = std::move(buffers);
+	chain.client_data = client_data;
+	m.chains = std::move(m.chains).insert(chain);
+	return std::make_tuple(std::move(m), chain.id);
+}
+
+[[nodiscard]] inline
+auto clone(ez::nort_t th, service::model* service, chain_id src_id, std::any client_data) -> chain_id {
+	chain_id id;
+	service->model.update_publish(th, [src_id, client_data, &id](detail::model&& m) mutable {
+		std::tie(m, id) = detail::clone(ez::nort, std::move(m), src_id, client_data);
+		return std::move(m);
+	});
+	push_dirty_mipmaps(th, service->model.read(th), id);
+	// Wake up the allocation thread so it can fill the copy-on-write reserve.
+	service->critical.cv_allocation_thread_wait.notify_one();
+	return id;
+}
+
 [[nodiscard]] inline
 auto release_buffers(model m, chain_id id) -> model {
 	if (const auto chain = m.chains.at(id); chain.buffers) {
 		for (const auto buffer_idx : *chain.buffers) {
-			m = release(std::move(m), chain.channel_count, buffer_idx);
+			if (buffer_idx) {
+				m = release(std::move(m), chain.channel_count, buffer_idx);
+			}
 		}
 	}
 	return m;
@@ -182,6 +433,7 @@ auto release_buffers(model m, chain_id id) -> model {
 auto erase(model m, chain_id id) -> model {
 	m = release_buffers(std::move(m), id);
 	m.chains = std::move(m.chains).erase(id);
+	m = schedule_paging(std::move(m), id);
 	return m;
 }
 
@@ -202,6 +454,27 @@ auto make_chain(ez::nort_t th, service::model* service, ads::channel_count chann
 	return id;
 }
 
+[[nodiscard]] inline
+auto resize_disk_backed(model m, chain_id id, size_t required_buffer_count) -> model {
+	auto c = m.chains.at(id);
+	for (size_t i = required_buffer_count; i < c.buffers->size(); i++) {
+		if ((*c.buffers)[i]) {
+			m = release(std::move(m), c.channel_count, (*c.buffers)[i]);
+		}
+	}
+	*c.buffers = c.buffers->take(required_buffer_count);
+	while (c.buffers->size() < required_buffer_count) {
+		*c.buffers = c.buffers->push_back(buffer_idx{});
+	}
+	// The file is mapped again through the same handle rather than being
+	// reopened and resized, because the old mapping stays alive for as long
+	// as anyone is still holding onto a model which references it.
+	c.file   = mapped_file::remap(*c.file, get_backing_file_size(c.channel_count, required_buffer_count));
+	m.chains = std::move(m.chains).insert(std::move(c));
+	m = schedule_paging(std::move(m), id);
+	return m;
+}
+
 [[nodiscard]] inline
 auto resize(model m, chain_id id, ads::frame_count required_frame_count) -> model {
 	const auto c = m.chains.at(id);
@@ -215,6 +488,9 @@ auto resize(model m, chain_id id, ads::frame_count required_frame_count) -> mode
 	if (current_buffer_count == required_buffer_count) {
 		return m;
 	}
+	if (is_disk_backed(c)) {
+		return resize_disk_backed(std::move(m), id, required_buffer_count);
+	}
 	if (c.buffers) {
 		if (required_buffer_count < current_buffer_count) {
 			m = shrink(std::move(m), id, required_buffer_count);
@@ -234,16 +510,6 @@ auto resize(ez::nort_t th, service::model* service, chain_id id, ads::frame_coun
 	});
 }
 
-[[nodiscard]] inline
-auto grow_dirty_region(ads::mipmap_region region, ads::frame_idx start, ads::frame_idx end) -> ads::mipmap_region {
-	if (start < region.beg) { region.beg = start; }
-	if (end >= region.end)  { region.end = end; }
-	assert (region.beg <= region.end);
-	assert (region.beg <  static_cast<uint64_t>(BUFFER_SIZE));
-	assert (region.end <= static_cast<uint64_t>(BUFFER_SIZE));
-	return region;
-}
-
 namespace processor {
 
 template <typename Fn>
@@ -309,6 +575,15 @@ struct chunk {
 	ads::frame_count frames_written;
 	ads::frame_count frames_read;
 	chunk() { frames.fill(0.0f); }
+	chunk(const chunk&)            = delete;
+	chunk& operator=(const chunk&) = delete;
+	auto reset() -> void {
+		frames.fill(0.0f);
+		write_pos      = frames.data();
+		read_pos       = frames.data();
+		frames_written = {};
+		frames_read    = {};
+	}
 	auto advance_write(ads::frame_count count) {
 		frames_written += count;
 		write_pos      += count.value;
@@ -336,12 +611,14 @@ auto process(ads::frame_idx input_start, ads::frame_idx output_start, ads::frame
 	if (frame_count == 0ULL) {
 		return {0};
 	}
-	auto chunk                   = processor::chunk<CHUNK_SIZE>{};
+	processor::chunk<CHUNK_SIZE> chunk;
 	auto input_frames_remaining  = frame_count;
 	auto output_frames_remaining = frame_count;
 	for (;;) {
 		const auto xformed_input_start  = input_start_xform_fn(input_start);
-		const auto input_frames_to_read = calculate_sub_chunk_size<region_alignment{INPUT_REGION_ALIGNMENT.v}, CHUNK_SIZE>(xformed_input_start, input_frames_remaining);
+		// An unaligned read may have left the chunk partly filled.
+		const auto chunk_space          = ads::frame_count{CHUNK_SIZE.v} - chunk.frames_written;
+		const auto input_frames_to_read = calculate_sub_chunk_size<region_alignment{INPUT_REGION_ALIGNMENT.v}, CHUNK_SIZE>(xformed_input_start, std::min(input_frames_remaining, chunk_space));
 		const auto input_frames_read    = input(chunk.write_pos, xformed_input_start, input_frames_to_read);
 		assert (input_frames_read <= input_frames_to_read);
 		assert (input_frames_read <= input_frames_remaining);
@@ -364,7 +641,7 @@ auto process(ads::frame_idx input_start, ads::frame_idx output_start, ads::frame
 				if (output_frames_remaining == 0ULL)    { return frame_count - output_frames_remaining; }
 				if (chunk.is_fully_read())              { break; }
 			}
-			chunk = {};
+			chunk.reset();
 		}
 		if (couldnt_get_enough_input_frames) { return frame_count - output_frames_remaining; }
 		if (input_frames_remaining == 0ULL)  { return frame_count - output_frames_remaining; }
@@ -395,9 +672,12 @@ auto scary_read_one_valid_sub_buffer_region(const model& m, const chain::model&
 	assert (ch < chain.channel_count);
 	validate_sub_buffer_region(chain, start, frame_count);
 	const auto local_start     = start % BUFFER_SIZE;
+	if (!get_index_of_sub_buffer(chain, start)) {
+		return read(SILENCE.data() + local_start.value, local_start, frame_count);
+	}
 	const auto& buffer_service = get_buffer_service(m, chain, start);
 	auto& critical             = buffer_service->critical;
-	return critical.storage.read(ch, local_start, frame_count, read);
+	return get_storage(critical)->read(ch, local_start, frame_count, read);
 }
 
 template <typename ReadFn>
@@ -413,9 +693,14 @@ auto scary_read_random(const model& m, const chain::model& chain, const std::arr
 				continue;
 			}
 			const auto local_frame     = fr % BUFFER_SIZE;
-			const auto& buffer_service = get_buffer_service(m, chain, fr);
+			const auto buffer          = get_index_of_sub_buffer(chain, fr);
+			if (!buffer) {
+				read_fn(0.0f, ch, frame_counter++);
+				continue;
+			}
+			const auto& buffer_service = get_buffer_service(m, chain, buffer);
 			const auto& critical       = buffer_service->critical;
-			read_fn(critical.storage.at(ch, local_frame), ch, frame_counter++);
+			read_fn(get_storage(critical)->at(ch, local_frame), ch, frame_counter++);
 		}
 	}
 }
@@ -455,6 +740,22 @@ auto scary_read(const model& m, const chain::model& chain, ads::frame_idx start,
 	return frame_count;
 }
 
+// Grow the dirty region of the sub-buffer. If it was clean then the
+// audio thread is told about it via the dirty list.
+inline
+auto mark_mipmap_dirty(const model& m, const chain::model& chain, ads::frame_idx frame, buffer::service::audio* audio, ads::frame_idx beg, ads::frame_idx end) -> void {
+	const auto was_clean = audio->mipmap_dirty_region.is_empty();
+	audio->mipmap_dirty_region = grow_dirty_region(audio->mipmap_dirty_region, beg, end);
+	if (!was_clean || !should_generate_mipmaps(chain)) {
+		return;
+	}
+	auto& list = *m.buffers.at(chain.channel_count.value).mipmap_dirty;
+	const auto slot = static_cast<size_t>(frame.value / BUFFER_SIZE);
+	if (!list.v.try_enqueue({chain.id, chain.buffers->at(slot), slot})) {
+		list.overflowed = true;
+	}
+}
+
 template <typename WriteFn>
 	requires ads::concepts::is_write_fn<float, WriteFn>
 auto scary_write_one_valid_sub_buffer_region(const model& m, const chain::model& chain, ads::frame_idx start, ads::frame_count frame_count, WriteFn write) -> ads::frame_count {
@@ -462,15 +763,31 @@ auto scary_write_one_valid_sub_buffer_region(const model& m, const chain::model&
 		return {0};
 	}
 	validate_sub_buffer_region(chain, start, frame_count);
+	const auto buffer = get_index_of_sub_buffer(chain, start);
+	if (!buffer) {
+		drop_paged_out_write(chain);
+		return frame_count;
+	}
 	const auto local_start      = start % BUFFER_SIZE;
 	const auto local_end        = local_start + frame_count;
-	const auto& buffer_service  = get_buffer_service(m, chain, start);
+	const auto& buffer_service  = get_buffer_service(m, chain, buffer);
 	auto& critical              = buffer_service->critical;
-	auto& storage               = buffer_service->critical.storage;
 	auto& audio                 = buffer_service->audio;
-	audio.mipmap_dirty_region = grow_dirty_region(audio.mipmap_dirty_region, local_start, local_end);
+	const auto disk_backed      = is_disk_backed(chain);
+	if (disk_backed && !begin_write(&critical)) {
+		drop_paged_out_write(chain);
+		return frame_count;
+	}
+	if (!make_writable(m, chain.channel_count, buffer, buffer_service.get())) {
+		if (disk_backed) { end_write(&critical); }
+		return frame_count;
+	}
+	auto& storage               = *get_storage(critical);
+	mark_mipmap_dirty(m, chain, start, &audio, local_start, local_end);
 	const auto frames_written = storage.write(local_start, frame_count, write);
 	assert (frames_written.value == frame_count.value);
+	count_mipmap_write(&critical);
+	if (disk_backed) { end_write(&critical); }
 	return frames_written;
 }
 
@@ -490,11 +807,29 @@ auto scary_write_random(const model& m, const chain::model& chain, const std::ar
 			}
 			const auto local_frame     = fr % BUFFER_SIZE;
 			const auto buffer          = get_index_of_sub_buffer(chain, fr);
+			if (!buffer) {
+				drop_paged_out_write(chain);
+				frame_counter++;
+				continue;
+			}
 			const auto& buffer_service = get_buffer_service(m, chain, buffer);
 			auto& critical             = buffer_service->critical;
 			auto& audio                = buffer_service->audio;
-			critical.storage.set(ch, local_frame, provider_fn(ch, frame_counter++));
-			audio.mipmap_dirty_region = grow_dirty_region(audio.mipmap_dirty_region, local_frame, local_frame + 1ULL);
+			const auto disk_backed     = is_disk_backed(chain);
+			if (disk_backed && !begin_write(&critical)) {
+				drop_paged_out_write(chain);
+				frame_counter++;
+				continue;
+			}
+			if (!make_writable(m, chain.channel_count, buffer, buffer_service.get())) {
+				if (disk_backed) { end_write(&critical); }
+				frame_counter++;
+				continue;
+			}
+			get_storage(critical)->set(ch, local_frame, provider_fn(ch, frame_counter++));
+			mark_mipmap_dirty(m, chain, fr, &audio, local_frame, local_frame + 1ULL);
+			count_mipmap_write(&critical);
+			if (disk_backed) { end_write(&critical); }
 		}
 	}
 }
@@ -645,6 +980,9 @@ auto diff(ez::ui_t th, chains was, chains now, concepts::push_ui_event auto push
 				if (loading.now) { push_ui_event(ui::events::chain::load_begin{now.id, now.client_data}); }
 				else             { push_ui_event(ui::events::chain::load_end{was.id, was.client_data}); }
 			}
+			if (was.mipmap_version != now.mipmap_version) {
+				push_ui_event(ui::events::chain::mipmap_changed{now.id, now.client_data});
+			}
 		}
 	};
 	immer::diff(was, now, immer::make_differ(on_added, on_erased, on_changed));
@@ -664,6 +1002,126 @@ auto set_mipmaps_enabled(ez::nort_t th, service::model* service, chain_id id, bo
 	service->model.update_publish(th, [id, enabled](detail::model x){
 		return set_mipmaps_enabled(std::move(x), id, enabled);
 	});
+	// Wake up the allocation thread so it can create or
+	// release the mipmaps of the chain's sub-buffers.
+	service->critical.mipmaps_need_maintenance = true;
+	service->critical.cv_allocation_thread_wait.notify_one();
+}
+
+[[nodiscard]] inline
+auto set_mipmap_format(model&& m, chain_id id, mipmap_format format) -> model {
+	m.chains = std::move(m.chains).update(id, [format](detail::chain::model x){
+		x.mipmap_format = format;
+		return x;
+	});
+	return m;
+}
+
+inline
+auto set_mipmap_format(ez::nort_t th, service::model* service, chain_id id, mipmap_format format) -> void {
+	service->model.update_publish(th, [id, format](detail::model x){
+		return set_mipmap_format(std::move(x), id, format);
+	});
+	// The allocation thread replaces the mipmaps of the chain's
+	// sub-buffers with ones in the new format.
+	service->critical.mipmaps_need_maintenance = true;
+	service->critical.cv_allocation_thread_wait.notify_one();
+}
+
+// Replace the mipmaps of the chain's resident sub-buffers with complete
+// ones, as long as the sub-buffers haven't changed in the meantime. If
+// enable is set then mipmaps are enabled for the chain in this format,
+// otherwise the chain must already be generating mipmaps in it.
+// Sub-buffers without a mipmap in the list get a silent one which is
+// then generated in the usual way. The chain's mipmap_version is bumped
+// so the UI thread produces a single mipmap_changed event for the lot.
+[[nodiscard]] inline
+auto publish_mipmaps(ez::nort_t th, service::model* service, chain_id id, immer::vector<buffer_idx> buffers, mipmap_format format, bool enable, const std::vector<buffer::mipmap_ptr>& mipmaps, const std::vector<uint64_t>& writes) -> bool {
+	auto complete   = std::vector<std::pair<buffer::service::ptr, uint64_t>>{};
+	auto incomplete = std::vector<buffer::service::ptr>{};
+	auto published  = false;
+	service->model.update_publish(th, [&](model&& x) {
+		complete.clear();
+		incomplete.clear();
+		published = false;
+		const auto c = x.chains.find(id);
+		if (!c || c->buffers != buffers) {
+			return std::move(x);
+		}
+		if (!enable && (!should_generate_mipmaps(*c) || c->mipmap_format != format)) {
+			return std::move(x);
+		}
+		const auto channel_count = c->channel_count;
+		for (size_t slot = 0; slot < buffers.size(); slot++) {
+			const auto idx = buffers[slot];
+			if (!idx) {
+				continue;
+			}
+			if (mipmaps[slot]) {
+				x = set_mipmap(std::move(x), channel_count, idx, mipmaps[slot]);
+				complete.emplace_back(get_buffer_service(x, channel_count, idx), writes[slot]);
+				continue;
+			}
+			x = set_mipmap(std::move(x), channel_count, idx, make_mipmap(channel_count, format));
+			incomplete.push_back(get_buffer_service(x, channel_count, idx));
+		}
+		x = update_chain(std::move(x), id, [format](chain::model c) {
+			c.flags         = set_flag(c.flags, c.flags.generate_mipmaps);
+			c.mipmap_format = format;
+			c.mipmap_version++;
+			return c;
+		});
+		published = true;
+		return std::move(x);
+	});
+	if (!published) {
+		return false;
+	}
+	for (const auto& [buffer_service, writes] : complete) { buffer_service->critical.mipmap_cached = writes + 1; }
+	for (const auto& buffer_service : incomplete)         { buffer_service->critical.mipmap_invalid = true; }
+	// Makes sure that every flag is seen by the audio thread.
+	push_dirty_mipmaps(th, service->model.read(th), id);
+	return true;
+}
+
+// Build every resident sub-buffer's mipmap from scratch, in parallel,
+// rather than going through the incremental path on the audio and UI
+// threads. Returns false if the chain's sub-buffers changed while this
+// was running.
+[[nodiscard]] inline
+auto rebuild_mipmaps(ez::nort_t th, service::model* service, chain_id id) -> bool {
+	const auto m      = service->model.read(th);
+	const auto& chain = m.chains.at(id);
+	if (!chain.buffers || !should_generate_mipmaps(chain)) {
+		return false;
+	}
+	const auto buffers = *chain.buffers;
+	auto mipmaps = std::vector<buffer::mipmap_ptr>(buffers.size());
+	auto writes  = std::vector<uint64_t>(buffers.size());
+	auto scratch = std::vector<mipmap::scratch>(get_worker_count(buffers.size()));
+	parallel_for(&service->workers, buffers.size(), [&](size_t worker, size_t slot) {
+		if (const auto idx = buffers[slot]) {
+			const auto& critical = get_buffer_service(m, chain.channel_count, idx)->critical;
+			writes[slot]  = get_mipmap_writes(critical);
+			mipmaps[slot] = build_mipmap(*get_storage(critical), chain.channel_count, chain.mipmap_format, &scratch[worker]);
+		}
+	});
+	return publish_mipmaps(th, service, id, buffers, chain.mipmap_format, false, mipmaps, writes);
+}
+
+[[nodiscard]] inline
+auto set_hot_regions(model&& m, chain_id id, immer::vector<hot_region> regions) -> model {
+	m = update_chain(std::move(m), id, chain::fn::set_hot_regions(std::move(regions)));
+	return schedule_paging(std::move(m), id);
+}
+
+inline
+auto set_hot_regions(ez::nort_t th, service::model* service, chain_id id, immer::vector<hot_region> regions) -> void {
+	service->model.update_publish(th, [id, regions](detail::model x){
+		return set_hot_regions(std::move(x), id, regions);
+	});
+	// Wake up the allocation thread so it can page sub-buffers in or out.
+	service->critical.cv_allocation_thread_wait.notify_one();
 }
 
 [[nodiscard]] inline
@@ -678,29 +1136,163 @@ auto read_mipmap(const model& m, chain_id id, double bin_size, ads::channel_idx
 	auto buffer_index_b = detail::buffer_idx{static_cast<int32_t>(index_b / detail::BUFFER_SIZE)};
 	buffer_index_a            = chain.buffers->at(buffer_index_a.value);
 	buffer_index_b            = chain.buffers->at(buffer_index_b.value);
+	if (!buffer_index_a || !buffer_index_b) { return {}; }
 	const auto local_frame_a  = ads::frame_idx{index_a % static_cast<int64_t>(detail::BUFFER_SIZE)};
 	const auto local_frame_b  = ads::frame_idx{index_b % static_cast<int64_t>(detail::BUFFER_SIZE)};
-	auto service_a = detail::get_buffer_service(m, chain, buffer_index_a);
-	auto service_b = detail::get_buffer_service(m, chain, buffer_index_b);
-	auto& ui_a = service_a->ui;
-	auto& ui_b = service_b->ui;
-	auto lod_a = ui_a.mipmap.bin_size_to_lod(bin_size);
-	auto lod_b = ui_b.mipmap.bin_size_to_lod(bin_size);
-	const auto value_a = ui_a.mipmap.read(lod_a, ch, local_frame_a);
-	const auto value_b = ui_b.mipmap.read(lod_b, ch, local_frame_b);
+	const auto mipmap_a = detail::get_mipmap(m, chain.channel_count, buffer_index_a);
+	const auto mipmap_b = detail::get_mipmap(m, chain.channel_count, buffer_index_b);
+	if (!mipmap_a || !mipmap_b) { return {}; }
+	const auto value_a = read_minmax(*mipmap_a, bin_size_to_lod(*mipmap_a, bin_size), ch, local_frame_a);
+	const auto value_b = read_minmax(*mipmap_b, bin_size_to_lod(*mipmap_b, bin_size), ch, local_frame_b);
 	return ads::lerp(value_a, value_b, t);
 }
 
 [[nodiscard]] inline
-auto update_mipmap(ez::ui_t th, const model& m, const chain::model& chain) -> bool {
-	if (!should_generate_mipmaps(chain)) { return false; }
-	if (!chain.buffers)                  { return false; }
-	const auto services = m.buffers.at(chain.channel_count.value).service;
-	bool mipmap_changed = false;
-	for (const auto buffer_idx : *chain.buffers) {
-		mipmap_changed |= update_mipmap(th, services.at(buffer_idx.value).get());
+auto lerp(mipmap_value a, mipmap_value b, double t) -> mipmap_value {
+	const auto tf = static_cast<float>(t);
+	return {std::lerp(a.min, b.min, tf), std::lerp(a.max, b.max, tf), std::lerp(a.rms, b.rms, tf)};
+}
+
+// Same as read_mipmap but the values are floats and include the RMS
+// if the chain's mipmap_format has it.
+[[nodiscard]] inline
+auto read_mipmap_value(const model& m, chain_id id, double bin_size, ads::channel_idx ch, double fr) -> mipmap_value {
+	if (fr < 0.0) { return {}; }
+	const auto& chain = m.chains.at(id);
+	if (!chain.buffers) { return {}; }
+	const auto index_a = static_cast<int64_t>(std::floor(fr));
+	const auto index_b = static_cast<int64_t>(std::ceil(fr));
+	const auto t       = fr - index_a;
+	const auto slot_a  = static_cast<size_t>(index_a) / BUFFER_SIZE;
+	const auto slot_b  = static_cast<size_t>(index_b) / BUFFER_SIZE;
+	if (slot_b >= chain.buffers->size()) { return {}; }
+	const auto buffer_index_a = (*chain.buffers)[slot_a];
+	const auto buffer_index_b = (*chain.buffers)[slot_b];
+	if (!buffer_index_a || !buffer_index_b) { return {}; }
+	const auto mipmap_a = get_mipmap(m, chain.channel_count, buffer_index_a);
+	const auto mipmap_b = get_mipmap(m, chain.channel_count, buffer_index_b);
+	if (!mipmap_a || !mipmap_b) { return {}; }
+	const auto local_frame_a = ads::frame_idx{index_a % static_cast<int64_t>(BUFFER_SIZE)};
+	const auto local_frame_b = ads::frame_idx{index_b % static_cast<int64_t>(BUFFER_SIZE)};
+	const auto value_a = read_value(*mipmap_a, bin_size_to_lod(*mipmap_a, bin_size), ch, local_frame_a);
+	const auto value_b = read_value(*mipmap_b, bin_size_to_lod(*mipmap_b, bin_size), ch, local_frame_b);
+	return lerp(value_a, value_b, t);
+}
+
+// Bins which are wider than a sub-buffer are read from the chain overview.
+[[nodiscard]] inline
+auto read_overview(ez::ui_t th, service::model* service, const model& m, chain_id id, double bin_size, ads::channel_idx ch, double fr) -> std::optional<overview::value> {
+	if (fr < 0.0) { return std::nullopt; }
+	const auto& chain = m.chains.at(id);
+	if (!chain.buffers) { return std::nullopt; }
+	const auto slot = static_cast<size_t>(fr) / BUFFER_SIZE;
+	if (slot >= chain.buffers->size()) { return std::nullopt; }
+	return overview::read(overview::get(th, service, m, chain), chain, overview::bin_size_to_level(bin_size), ch, slot);
+}
+
+[[nodiscard]] inline
+auto read_mipmap(ez::ui_t th, service::model* service, chain_id id, double bin_size, ads::channel_idx ch, double fr) -> ads::mipmap_minmax<uint8_t> {
+	const auto m = service->model.read(th);
+	if (bin_size < static_cast<double>(BUFFER_SIZE)) {
+		return read_mipmap(m, id, bin_size, ch, fr);
+	}
+	const auto value = read_overview(th, service, m, id, bin_size, ch, fr);
+	return value ? overview::to_minmax(*value) : ads::mipmap_minmax<uint8_t>{};
+}
+
+// When zoomed out the RMS is over all the sub-buffers under the bin,
+// the same as the min/max.
+[[nodiscard]] inline
+auto read_mipmap_value(ez::ui_t th, service::model* service, chain_id id, double bin_size, ads::channel_idx ch, double fr) -> mipmap_value {
+	const auto m = service->model.read(th);
+	if (bin_size < static_cast<double>(BUFFER_SIZE)) {
+		return read_mipmap_value(m, id, bin_size, ch, fr);
 	}
-	return mipmap_changed;
+	const auto value = read_overview(th, service, m, id, bin_size, ch, fr);
+	return value ? overview::to_mipmap_value(*value) : mipmap_value{};
+}
+
+// Each bin gets the min/max and mean square of the mipmap cells which
+// overlap it, and is passed to set_bin(index, value). Bins with no data
+// are skipped. The sub-buffer and LOD are only resolved when they change,
+// rather than once per point as with read_mipmap.
+template <typename SetBinFn> inline
+auto read_mipmap_row(ez::ui_t th, service::model* service, chain_id id, ads::channel_idx ch, ads::frame_idx start, double bin_size, size_t count, SetBinFn&& set_bin) -> void {
+	const auto m      = service->model.read(th);
+	const auto& chain = m.chains.at(id);
+	if (!chain.buffers || chain.buffers->empty() || bin_size <= 0.0) {
+		return;
+	}
+	const auto chain_end = static_cast<int64_t>(chain.buffers->size() * BUFFER_SIZE);
+	auto get_bin = [start, bin_size, chain_end](size_t i) -> std::pair<int64_t, int64_t> {
+		const auto beg = start.value + static_cast<int64_t>(std::floor(static_cast<double>(i) * bin_size));
+		const auto end = start.value + static_cast<int64_t>(std::floor(static_cast<double>(i + 1) * bin_size));
+		return {std::max(beg, int64_t{0}), std::min(std::max(end, beg + 1), chain_end)};
+	};
+	if (bin_size >= static_cast<double>(BUFFER_SIZE)) {
+		const auto& o    = overview::get(th, service, m, chain);
+		const auto level = std::min(overview::bin_size_to_level(bin_size), o.levels.size() - 1);
+		const auto cell  = size_t{1} << level;
+		for (size_t i = 0; i < count; i++) {
+			const auto [beg, end] = get_bin(i);
+			if (beg >= end) {
+				continue;
+			}
+			const auto first = static_cast<size_t>(beg) / BUFFER_SIZE;
+			const auto last  = static_cast<size_t>(end - 1) / BUFFER_SIZE;
+			auto value = overview::accumulator{};
+			value.add(overview::read(o, chain, level, ch, first));
+			for (auto slot = ((first / cell) + 1) * cell; slot <= last; slot += cell) {
+				value.add(overview::read(o, chain, level, ch, slot));
+			}
+			set_bin(i, value.get());
+		}
+		return;
+	}
+	auto slot   = std::numeric_limits<size_t>::max();
+	auto mipmap = buffer::mipmap_ptr{};
+	auto lod    = -1.0f;
+	auto cell   = int64_t{1};
+	for (size_t i = 0; i < count; i++) {
+		const auto [beg, end] = get_bin(i);
+		auto value = overview::accumulator{};
+		for (auto fr = beg; fr < end;) {
+			if (const auto fr_slot = static_cast<size_t>(fr) / BUFFER_SIZE; fr_slot != slot) {
+				slot = fr_slot;
+				const auto idx = (*chain.buffers)[slot];
+				mipmap = idx ? get_mipmap(m, chain.channel_count, idx) : nullptr;
+				if (mipmap && lod < 0.0f) {
+					lod  = std::floor(bin_size_to_lod(*mipmap, bin_size));
+					cell = int64_t{1} << static_cast<int64_t>(lod);
+				}
+			}
+			if (!mipmap) {
+				// Paged out or no mipmap yet, so skip to the next sub-buffer.
+				fr = static_cast<int64_t>((slot + 1) * BUFFER_SIZE);
+				continue;
+			}
+			const auto local  = ads::frame_idx{fr % static_cast<int64_t>(BUFFER_SIZE)};
+			const auto minmax = read_value(*mipmap, lod, ch, local);
+			value.add({minmax.min, minmax.max, read_mean_square(*mipmap, lod, ch, local)});
+			fr = ((fr / cell) + 1) * cell;
+		}
+		if (!value.empty()) {
+			set_bin(i, value.get());
+		}
+	}
+}
+
+inline
+auto read_mipmap_row(ez::ui_t th, service::model* service, chain_id id, ads::channel_idx ch, ads::frame_idx start, double bin_size, std::span<ads::mipmap_minmax<uint8_t>> out) -> void {
+	std::ranges::fill(out, ads::mipmap_minmax<uint8_t>{});
+	read_mipmap_row(th, service, id, ch, start, bin_size, out.size(), [out](size_t i, overview::value v) { out[i] = overview::to_minmax(v); });
+}
+
+// Float values, and the RMS if the chain's mipmap_format has it.
+inline
+auto read_mipmap_row(ez::ui_t th, service::model* service, chain_id id, ads::channel_idx ch, ads::frame_idx start, double bin_size, std::span<mipmap_value> out) -> void {
+	std::ranges::fill(out, mipmap_value{});
+	read_mipmap_row(th, service, id, ch, start, bin_size, out.size(), [out](size_t i, overview::value v) { out[i] = overview::to_mipmap_value(v); });
 }
 
 } // adrian::detail
@@ -716,8 +1308,11 @@ auto clear_mipmap(ez::ui_t th, chain_id id) -> void {
 		return;
 	}
 	for (const auto buffer_idx : *chain.buffers) {
-		const auto& buffer_service = get_buffer_service(model, chain, buffer_idx);
-		buffer_service->ui.mipmap.clear();
+		if (buffer_idx) {
+			if (const auto mipmap = detail::get_mipmap(model, chain.channel_count, buffer_idx)) {
+				detail::clear_mipmap(mipmap.get());
+			}
+		}
 	}
 }
 
@@ -745,9 +1340,41 @@ auto make_chain(ez::nort_t th, ads::channel_count channel_count, ads::frame_coun
 	return detail::make_chain(th, &detail::service_, channel_count, frame_count, options, client_data);
 }
 
+// Make a copy of the chain without copying any audio data.
+// The copy is done lazily, one sub-buffer at a time, the first time that
+// either chain writes to a sub-buffer. Disk-backed chains can't be cloned.
+[[nodiscard]] inline
+auto clone(ez::nort_t th, chain_id id, std::any client_data) -> chain_id {
+	return detail::clone(th, &detail::service_, id, client_data);
+}
+
 [[nodiscard]] inline
 auto read_mipmap(ez::ui_t th, chain_id id, double bin_size, ads::channel_idx ch, double fr) -> ads::mipmap_minmax<uint8_t> {
-	return detail::read_mipmap(detail::service_.model.read(th), id, bin_size, ch, fr);
+	return detail::read_mipmap(th, &detail::service_, id, bin_size, ch, fr);
+}
+
+// Float min/max, plus the RMS if the chain's mipmap_format has it.
+// For chains in the uint8_minmax format the values are decoded and
+// the RMS is always zero.
+[[nodiscard]] inline
+auto read_mipmap_value(ez::ui_t th, chain_id id, double bin_size, ads::channel_idx ch, double fr) -> mipmap_value {
+	return detail::read_mipmap_value(th, &detail::service_, id, bin_size, ch, fr);
+}
+
+// Fill a whole row of bins at once, e.g. one per pixel of a waveform.
+// Bin i covers the frames [start + i * bin_size, start + (i + 1) * bin_size).
+// Bins which are outside the chain, or in sub-buffers which are paged
+// out, are left empty.
+inline
+auto read_mipmap_row(ez::ui_t th, chain_id id, ads::channel_idx ch, ads::frame_idx start, double bin_size, std::span<ads::mipmap_minmax<uint8_t>> out) -> void {
+	detail::read_mipmap_row(th, &detail::service_, id, ch, start, bin_size, out);
+}
+
+// Same as above but the values are floats and include the RMS if the
+// chain's mipmap_format has it.
+inline
+auto read_mipmap_row(ez::ui_t th, chain_id id, ads::channel_idx ch, ads::frame_idx start, double bin_size, std::span<mipmap_value> out) -> void {
+	detail::read_mipmap_row(th, &detail::service_, id, ch, start, bin_size, out);
 }
 
 inline
@@ -834,6 +1461,34 @@ auto set_mipmaps_enabled(ez::nort_t th, chain_id id, bool enabled) -> void {
 	detail::set_mipmaps_enabled(th, &detail::service_, id, enabled);
 }
 
+// Regenerate all of the chain's mipmaps at once, fanned out across a pool
+// of worker threads, e.g. after filling the chain with audio from disk.
+// The dirty regions left behind by the writes are dropped, and the UI
+// gets a single mipmap_changed event once it's done. Returns false if the
+// chain doesn't generate mipmaps, or was edited while this was running.
+// Mipmaps which are enabled later with set_mipmaps_enabled() are built
+// this way automatically.
+[[nodiscard]] inline
+auto rebuild_mipmaps(ez::nort_t th, chain_id id) -> bool {
+	return detail::rebuild_mipmaps(th, &detail::service_, id);
+}
+
+// The chain's sub-buffers get new mipmaps in this format, which are
+// then regenerated from the audio data.
+inline
+auto set_mipmap_format(ez::nort_t th, chain_id id, mipmap_format format) -> void {
+	detail::set_mipmap_format(th, &detail::service_, id, format);
+}
+
+// Only meaningful for disk-backed chains. Tell the allocation thread which
+// regions of the chain are about to be read or written (e.g. the play and
+// record regions.) Sub-buffers around these regions are paged in from the
+// backing file and everything else is paged out.
+inline
+auto set_hot_regions(ez::nort_t th, chain_id id, std::initializer_list<hot_region> regions) -> void {
+	detail::set_hot_regions(th, &detail::service_, id, immer::vector<hot_region>(regions));
+}
+
 // RAII chain wrapper
 struct chain {
 	chain()                        = default;
@@ -853,11 +1508,18 @@ struct chain {
 		rhs.id_ = {};
 		return *this;
 	}
+	[[nodiscard]] auto clone(ez::nort_t th, std::any client_data) const -> chain   { return chain{adrian::clone(th, id_, client_data)}; }
 	auto clear_mipmap(ez::ui_t th) -> void                                         { adrian::clear_mipmap(th, id_); }
 	auto resize(ez::nort_t th, ads::frame_count frame_count) -> void               { return adrian::resize(th, id_, frame_count); }
 	auto set_mipmaps_enabled(ez::nort_t th, bool enabled) -> void                  { return adrian::set_mipmaps_enabled(th, id_, enabled); }
+	auto set_mipmap_format(ez::nort_t th, mipmap_format format) -> void            { return adrian::set_mipmap_format(th, id_, format); }
+	[[nodiscard]] auto rebuild_mipmaps(ez::nort_t th) -> bool                      { return adrian::rebuild_mipmaps(th, id_); }
+	auto set_hot_regions(ez::nort_t th, std::initializer_list<hot_region> regions) { return adrian::set_hot_regions(th, id_, regions); }
 	[[nodiscard]] auto is_ready(ez::ui_t th) -> bool                                             { return adrian::is_ready(th, id_); }
 	[[nodiscard]] auto read_mipmap(ez::ui_t th, double bin_size, ads::channel_idx ch, double fr) { return adrian::read_mipmap(th, id_, bin_size, ch, fr); }
+	[[nodiscard]] auto read_mipmap_value(ez::ui_t th, double bin_size, ads::channel_idx ch, double fr) { return adrian::read_mipmap_value(th, id_, bin_size, ch, fr); }
+	auto read_mipmap_row(ez::ui_t th, ads::channel_idx ch, ads::frame_idx start, double bin_size, std::span<ads::mipmap_minmax<uint8_t>> out) -> void { adrian::read_mipmap_row(th, id_, ch, start, bin_size, out); }
+	auto read_mipmap_row(ez::ui_t th, ads::channel_idx ch, ads::frame_idx start, double bin_size, std::span<mipmap_value> out) -> void { adrian::read_mipmap_row(th, id_, ch, start, bin_size, out); }
 	[[nodiscard]] auto get_actual_frame_count(ez::ui_t th) const                                 { return adrian::get_actual_frame_count(th, id_); }
 	[[nodiscard]] auto get_requested_frame_count(ez::ui_t th) const                              { return adrian::get_requested_frame_count(th, id_); }
 	[[nodiscard]] auto id() const -> chain_id                                                    { return id_; }
@@ -891,6 +1553,7 @@ struct chain {
 		return adrian::scary_write(th, id_, start, frame_count, chunk_size, write);
 	}
 private:
+	explicit chain(chain_id id) : id_{id} {}
 	auto erase() -> void {
 		if (id_) {
 			adrian::erase(ez::nort, id_);
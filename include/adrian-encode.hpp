@@ -0,0 +1,138 @@
+#pragma once
+
+#include <ads-mipmap.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define ADRIAN_ENCODE_SSE2
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#	include <arm_neon.h>
+#endif
+
+// Vectorized version of ads::encode<uint8_t>, used to quantize blocks of
+// samples for the mipmaps. [-1, 1] is mapped onto [0, 255] and rounded
+// half away from zero, the same as ads::encode, so the results match it
+// exactly. The conversion instructions either truncate or round half to
+// even, so each kernel truncates and then adds one wherever the part
+// which was cut off is at least a half. The scaled value is never
+// negative and the subtraction is exact, so this is the same as
+// std::round().
+namespace adrian::detail::encode {
+
+static constexpr auto SCALE = 127.5f;
+static constexpr auto HALF  = 0.5f;
+
+inline
+auto to_uint8_scalar(const float* src, uint8_t* dest, size_t count) -> void {
+	for (size_t i = 0; i < count; i++) {
+		dest[i] = ads::encode<uint8_t>(src[i]);
+	}
+}
+
+#if defined(__AVX2__)
+
+static constexpr auto KERNEL = std::string_view{"avx2"};
+
+inline
+auto to_uint8(const float* src, uint8_t* dest, size_t count) -> void {
+	const auto lo    = _mm256_set1_ps(-1.0f);
+	const auto hi    = _mm256_set1_ps(1.0f);
+	const auto scale = _mm256_set1_ps(SCALE);
+	const auto half  = _mm256_set1_ps(HALF);
+	// packs work within 128 bit lanes so the result needs shuffling back into order.
+	const auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	auto quantize = [&](const float* p) {
+		const auto v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(p), lo), hi);
+		const auto x = _mm256_mul_ps(_mm256_add_ps(v, hi), scale);
+		const auto t = _mm256_cvttps_epi32(x);
+		// The comparison mask is all ones (-1) where it rounds up.
+		const auto up = _mm256_castps_si256(_mm256_cmp_ps(_mm256_sub_ps(x, _mm256_cvtepi32_ps(t)), half, _CMP_GE_OQ));
+		return _mm256_sub_epi32(t, up);
+	};
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		const auto a  = quantize(src + i);
+		const auto b  = quantize(src + i + 8);
+		const auto c  = quantize(src + i + 16);
+		const auto d  = quantize(src + i + 24);
+		const auto ab = _mm256_packs_epi32(a, b);
+		const auto cd = _mm256_packs_epi32(c, d);
+		const auto x  = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), order);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), x);
+	}
+	to_uint8_scalar(src + i, dest + i, count - i);
+}
+
+#elif defined(ADRIAN_ENCODE_SSE2)
+
+static constexpr auto KERNEL = std::string_view{"sse2"};
+
+inline
+auto to_uint8(const float* src, uint8_t* dest, size_t count) -> void {
+	const auto lo    = _mm_set1_ps(-1.0f);
+	const auto hi    = _mm_set1_ps(1.0f);
+	const auto scale = _mm_set1_ps(SCALE);
+	const auto half  = _mm_set1_ps(HALF);
+	auto quantize = [&](const float* p) {
+		const auto v  = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), lo), hi);
+		const auto x  = _mm_mul_ps(_mm_add_ps(v, hi), scale);
+		const auto t  = _mm_cvttps_epi32(x);
+		const auto up = _mm_castps_si128(_mm_cmpge_ps(_mm_sub_ps(x, _mm_cvtepi32_ps(t)), half));
+		return _mm_sub_epi32(t, up);
+	};
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const auto a  = quantize(src + i);
+		const auto b  = quantize(src + i + 4);
+		const auto c  = quantize(src + i + 8);
+		const auto d  = quantize(src + i + 12);
+		const auto ab = _mm_packs_epi32(a, b);
+		const auto cd = _mm_packs_epi32(c, d);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_packus_epi16(ab, cd));
+	}
+	to_uint8_scalar(src + i, dest + i, count - i);
+}
+
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+
+static constexpr auto KERNEL = std::string_view{"neon"};
+
+inline
+auto to_uint8(const float* src, uint8_t* dest, size_t count) -> void {
+	const auto lo    = vdupq_n_f32(-1.0f);
+	const auto hi    = vdupq_n_f32(1.0f);
+	const auto scale = vdupq_n_f32(SCALE);
+	const auto half  = vdupq_n_f32(HALF);
+	auto quantize = [&](const float* p) {
+		const auto v  = vminq_f32(vmaxq_f32(vld1q_f32(p), lo), hi);
+		const auto x  = vmulq_f32(vaddq_f32(v, hi), scale);
+		const auto t  = vcvtq_u32_f32(x);
+		const auto up = vcgeq_f32(vsubq_f32(x, vcvtq_f32_u32(t)), half);
+		return vmovn_u32(vsubq_u32(t, up));
+	};
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const auto ab = vcombine_u16(quantize(src + i), quantize(src + i + 4));
+		const auto cd = vcombine_u16(quantize(src + i + 8), quantize(src + i + 12));
+		vst1q_u8(dest + i, vcombine_u8(vqmovn_u16(ab), vqmovn_u16(cd)));
+	}
+	to_uint8_scalar(src + i, dest + i, count - i);
+}
+
+#else
+
+static constexpr auto KERNEL = std::string_view{"scalar"};
+
+inline
+auto to_uint8(const float* src, uint8_t* dest, size_t count) -> void {
+	to_uint8_scalar(src, dest, count);
+}
+
+#endif
+
+} // adrian::detail::encode
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "adrian-peak-gate.hpp"
+#include <ads.hpp>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace adrian {
+
+enum class gate_detector {
+	peak, // The absolute peak, which decays over the release time.
+	rms,  // The RMS, smoothed over the attack and release times.
+};
+
+struct gate_options {
+	gate_detector detector = gate_detector::peak;
+	float attack           = 0.0f;                         // In frames. Only for the RMS detector.
+	float release          = kFloatsPerDSPVector * 128.0f; // In frames.
+	// Once open the gate stays open until the level drops below the threshold
+	// multiplied by this, so a level hovering around the threshold doesn't make
+	// it chatter. 1 means no hysteresis.
+	float close_ratio      = 1.0f;
+	// The gate sees the input this far ahead of what's being recorded, so it
+	// opens this much before the input goes over the threshold and stays open
+	// for this much after it drops back under. The recorded audio is delayed
+	// by the same amount. Rounded up to a whole number of DSP vectors.
+	ads::frame_count look_ahead;
+};
+
+} // adrian
+
+// The catch buffer's record gate. The level of each DSP vector is measured
+// by the chosen detector and the gate decision is made from the loudest
+// channel, followed by the hysteresis and then the look-ahead hold.
+namespace adrian::gate {
+
+struct model {
+	adrian::gate_options options;
+	ads::channel_count   channel_count;
+	peak_gate::model     peak;
+	std::vector<float>   mean_squares; // One per channel.
+	float                attack_coef  = 1.0f;
+	float                release_coef = 1.0f;
+	bool                 open         = false;
+	// How many more vectors the gate is held open for by the look-ahead.
+	uint64_t             hold         = 0;
+	// The last look_ahead + 1 vectors of input, one vector per channel each.
+	std::vector<float>   delay;
+	uint64_t             delay_vectors = 0;
+	uint64_t             delay_pos     = 0;
+};
+
+using ptr = std::shared_ptr<model>;
+
+// The coefficient of a one-pole smoother which is run once per vector.
+[[nodiscard]] inline
+auto get_coef(float time_in_frames) -> float {
+	if (time_in_frames <= kFloatsPerDSPVector) {
+		return 1.0f;
+	}
+	return 1.0f - std::exp(-float(kFloatsPerDSPVector) / time_in_frames);
+}
+
+[[nodiscard]] inline
+auto make(ads::channel_count channel_count, const adrian::gate_options& options) -> ptr {
+	auto g = std::make_shared<model>();
+	g->options       = options;
+	g->channel_count = channel_count;
+	peak_gate::init(&g->peak, channel_count, options.release);
+	g->mean_squares.resize(channel_count.value, 0.0f);
+	g->attack_coef   = get_coef(options.attack);
+	g->release_coef  = get_coef(options.release);
+	g->delay_vectors = (options.look_ahead.value + kFloatsPerDSPVector - 1) / kFloatsPerDSPVector;
+	if (g->delay_vectors > 0) {
+		g->delay.resize((g->delay_vectors + 1) * channel_count.value * kFloatsPerDSPVector, 0.0f);
+	}
+	return g;
+}
+
+[[nodiscard]] inline
+auto get_level(model* g, size_t ch, const ml::DSPVector& in) -> float {
+	switch (g->options.detector) {
+		case gate_detector::peak: {
+			auto& c = g->peak.channels[ch];
+			std::ignore = peak_gate::process(&c, in, 0.0f);
+			return c.peak;
+		}
+		case gate_detector::rms: {
+			const auto mean_square = ml::sum(in * in) / float(kFloatsPerDSPVector);
+			auto& env = g->mean_squares[ch];
+			env += (mean_square - env) * (mean_square > env ? g->attack_coef : g->release_coef);
+			return std::sqrt(env);
+		}
+	}
+	return 0.0f;
+}
+
+[[nodiscard]] inline
+auto decide(model* g, float level, float threshold) -> bool {
+	g->open = level > (g->open ? threshold * g->options.close_ratio : threshold);
+	if (g->open) {
+		g->hold = g->delay_vectors;
+		return true;
+	}
+	if (g->hold > 0) {
+		g->hold--;
+		return true;
+	}
+	return false;
+}
+
+template <int N> [[nodiscard]]
+auto process(model* g, const ml::DSPVectorArray<N>& in, float threshold) -> bool {
+	assert (g->channel_count.value == N);
+	auto level = 0.0f;
+	for (int i = 0; i < N; i++) {
+		level = std::max(level, get_level(g, static_cast<size_t>(i), in.constRow(i)));
+	}
+	return decide(g, level, threshold);
+}
+
+// For when the channel count is only known at runtime. `in` holds one
+// vector of frames per channel, one after the other.
+[[nodiscard]] inline
+auto process(model* g, const float* in, float threshold) -> bool {
+	auto level = 0.0f;
+	auto v     = ml::DSPVector{};
+	for (size_t i = 0; i < g->channel_count.value; i++) {
+		std::copy(in + (i * kFloatsPerDSPVector), in + ((i + 1) * kFloatsPerDSPVector), v.getBuffer());
+		level = std::max(level, get_level(g, i, v));
+	}
+	return decide(g, level, threshold);
+}
+
+// Push a vector of input (one vector per channel) into the look-ahead delay
+// and return the one which should be recorded now, i.e. the input from
+// look_ahead vectors ago.
+[[nodiscard]] inline
+auto delay(model* g, const float* in) -> const float* {
+	if (g->delay_vectors == 0) {
+		return in;
+	}
+	const auto size = g->channel_count.value * kFloatsPerDSPVector;
+	std::copy(in, in + size, g->delay.data() + (g->delay_pos * size));
+	g->delay_pos = (g->delay_pos + 1) % (g->delay_vectors + 1);
+	return g->delay.data() + (g->delay_pos * size);
+}
+
+} // adrian::gate
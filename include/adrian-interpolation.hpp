@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+
+namespace adrian {
+
+enum class playback_interpolation {
+	linear,
+	cubic, // 4-point Catmull-Rom.
+	sinc,  // 16-point Blackman windowed sinc. The most expensive.
+};
+
+} // adrian
+
+// Interpolated reads from a block of frames which was already read from
+// the chain in one go. `x` points at the frame before the read position
+// and `t` is how far past it the read position is, in [0, 1). Each kernel
+// needs taps_before frames before `x` and taps_after frames after it.
+namespace adrian::detail::interpolation {
+
+static constexpr auto SINC_HALF_WIDTH = 8;
+static constexpr auto SINC_PHASES     = 256;
+
+struct taps { int64_t before; int64_t after; };
+
+[[nodiscard]] constexpr
+auto get_taps(playback_interpolation interpolation) -> taps {
+	switch (interpolation) {
+		case playback_interpolation::linear: { return {0, 1}; }
+		case playback_interpolation::cubic:  { return {1, 2}; }
+		case playback_interpolation::sinc:   { return {SINC_HALF_WIDTH - 1, SINC_HALF_WIDTH}; }
+	}
+	return {0, 0};
+}
+
+// One row of kernel values per phase, plus one more so that adjacent
+// phases can be blended without a bounds check. Row p is the kernel for
+// t == p / SINC_PHASES, tap k being the weight of x[k - (SINC_HALF_WIDTH - 1)].
+using sinc_table = std::array<std::array<float, SINC_HALF_WIDTH * 2>, SINC_PHASES + 1>;
+
+[[nodiscard]] inline
+auto make_sinc_table() -> sinc_table {
+	static constexpr auto pi = std::numbers::pi;
+	sinc_table table;
+	for (int phase = 0; phase <= SINC_PHASES; phase++) {
+		const auto t = double(phase) / SINC_PHASES;
+		for (int k = 0; k < SINC_HALF_WIDTH * 2; k++) {
+			const auto d      = double(k - (SINC_HALF_WIDTH - 1)) - t;
+			const auto sinc   = d == 0.0 ? 1.0 : std::sin(pi * d) / (pi * d);
+			const auto w      = d / SINC_HALF_WIDTH;
+			const auto window = std::abs(w) >= 1.0 ? 0.0 : 0.42 + (0.5 * std::cos(pi * w)) + (0.08 * std::cos(2.0 * pi * w));
+			table[phase][k] = static_cast<float>(sinc * window);
+		}
+	}
+	return table;
+}
+
+// Built during static initialization so that the audio thread never does it.
+inline const auto SINC_TABLE = make_sinc_table();
+
+[[nodiscard]] inline
+auto linear(const float* x, float t) -> float {
+	return x[0] + ((x[1] - x[0]) * t);
+}
+
+[[nodiscard]] inline
+auto cubic(const float* x, float t) -> float {
+	const auto c0 = x[0];
+	const auto c1 = 0.5f * (x[1] - x[-1]);
+	const auto c2 = x[-1] - (2.5f * x[0]) + (2.0f * x[1]) - (0.5f * x[2]);
+	const auto c3 = (0.5f * (x[2] - x[-1])) + (1.5f * (x[0] - x[1]));
+	return (((((c3 * t) + c2) * t) + c1) * t) + c0;
+}
+
+// The kernel isn't widened for rates above 1, so speeding up
+// with it doesn't filter out what would alias.
+[[nodiscard]] inline
+auto sinc(const float* x, float t) -> float {
+	const auto pos   = t * SINC_PHASES;
+	// t rounds up to 1 when the read position is just short of a whole
+	// frame, in which case the last row is blended in fully.
+	const auto phase = std::min(static_cast<int>(pos), SINC_PHASES - 1);
+	const auto blend = pos - float(phase);
+	const auto& a    = SINC_TABLE[phase];
+	const auto& b    = SINC_TABLE[phase + 1];
+	const auto first = x - (SINC_HALF_WIDTH - 1);
+	auto sum_a = 0.0f;
+	auto sum_b = 0.0f;
+	for (int k = 0; k < SINC_HALF_WIDTH * 2; k++) {
+		sum_a += first[k] * a[k];
+		sum_b += first[k] * b[k];
+	}
+	return sum_a + ((sum_b - sum_a) * blend);
+}
+
+} // adrian::detail::interpolation
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#if defined(_WIN32)
+#	if !defined(NOMINMAX)
+#		define NOMINMAX
+#	endif
+#	if !defined(WIN32_LEAN_AND_MEAN)
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+// A file mapped into the address space, used as the backing store for disk-backed chains.
+// Only the allocation thread ever touches the mapped memory. The audio thread works with
+// ordinary pool buffers which are paged in from (and out to) the mapping.
+namespace adrian::detail::mapped_file {
+
+enum class mode {
+	create,        // Create the file, or truncate it if it already exists.
+	open_existing, // Keep the existing contents, growing the file if necessary.
+};
+
+// The open file. It is shared by every mapping of it, so that a chain
+// can be resized by mapping the file again without reopening it.
+struct handle {
+	handle()                         = default;
+	handle(const handle&)            = delete;
+	handle& operator=(const handle&) = delete;
+	~handle();
+	std::filesystem::path path;
+#if defined(_WIN32)
+	HANDLE file = INVALID_HANDLE_VALUE;
+#else
+	int fd = -1;
+#endif
+};
+
+struct model {
+	model()                        = default;
+	model(const model&)            = delete;
+	model& operator=(const model&) = delete;
+	~model();
+	std::shared_ptr<mapped_file::handle> handle;
+	std::filesystem::path path;
+	std::byte* data = nullptr;
+	size_t size     = 0;
+#if defined(_WIN32)
+	HANDLE mapping = nullptr;
+#endif
+};
+
+using ptr = std::shared_ptr<model>;
+
+#if defined(_WIN32)
+
+inline
+handle::~handle() {
+	if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+}
+
+inline
+model::~model() {
+	if (data)    { UnmapViewOfFile(data); }
+	if (mapping) { CloseHandle(mapping); }
+}
+
+[[nodiscard]] inline
+auto open_handle(const std::filesystem::path& path, mode open_mode) -> std::shared_ptr<mapped_file::handle> {
+	auto out = std::make_shared<mapped_file::handle>();
+	out->path = path;
+	const auto disposition = open_mode == mode::create ? CREATE_ALWAYS : OPEN_ALWAYS;
+	out->file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (out->file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error(std::format("failed to open chain backing file '{}'", path.string()));
+	}
+	return out;
+}
+
+// A mapping object which is bigger than the file grows the file, and
+// unlike SetEndOfFile() that works while other views are still mapped.
+// The file is never shrunk. Anything past the end of the view is unused.
+[[nodiscard]] inline
+auto map(std::shared_ptr<mapped_file::handle> handle, size_t size) -> ptr {
+	auto out = std::make_shared<model>();
+	out->path   = handle->path;
+	out->size   = size;
+	out->handle = std::move(handle);
+	if (size == 0) {
+		return out;
+	}
+	const auto size_hi = static_cast<DWORD>(static_cast<uint64_t>(size) >> 32);
+	const auto size_lo = static_cast<DWORD>(static_cast<uint64_t>(size) & 0xFFFFFFFF);
+	out->mapping = CreateFileMappingW(out->handle->file, nullptr, PAGE_READWRITE, size_hi, size_lo, nullptr);
+	if (!out->mapping) {
+		throw std::runtime_error(std::format("failed to map chain backing file '{}' at {} bytes", out->path.string(), size));
+	}
+	out->data = static_cast<std::byte*>(MapViewOfFile(out->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+	if (!out->data) {
+		throw std::runtime_error(std::format("failed to map view of chain backing file '{}'", out->path.string()));
+	}
+	return out;
+}
+
+inline
+auto prefetch(const model& m, size_t offset, size_t size) -> void {
+	auto range = WIN32_MEMORY_RANGE_ENTRY{m.data + offset, size};
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+inline
+auto evict(const model& m, size_t offset, size_t size) -> void {
+	FlushViewOfFile(m.data + offset, size);
+}
+
+#else
+
+inline
+handle::~handle() {
+	if (fd >= 0) { ::close(fd); }
+}
+
+inline
+model::~model() {
+	if (data) { munmap(data, size); }
+}
+
+[[nodiscard]] inline
+auto open_handle(const std::filesystem::path& path, mode open_mode) -> std::shared_ptr<mapped_file::handle> {
+	auto out = std::make_shared<mapped_file::handle>();
+	out->path = path;
+	const auto flags = O_RDWR | O_CREAT | (open_mode == mode::create ? O_TRUNC : 0);
+	out->fd = ::open(path.c_str(), flags, 0644);
+	if (out->fd < 0) {
+		throw std::runtime_error(std::format("failed to open chain backing file '{}'", path.string()));
+	}
+	return out;
+}
+
+// The file is only ever grown, since shrinking it would pull the pages
+// out from under any older mapping which is still alive. Anything past
+// the end of the view is unused.
+[[nodiscard]] inline
+auto map(std::shared_ptr<mapped_file::handle> handle, size_t size) -> ptr {
+	auto out = std::make_shared<model>();
+	out->path   = handle->path;
+	out->size   = size;
+	out->handle = std::move(handle);
+	if (size == 0) {
+		return out;
+	}
+	struct stat st;
+	if (fstat(out->handle->fd, &st) != 0) {
+		throw std::runtime_error(std::format("failed to get size of chain backing file '{}'", out->path.string()));
+	}
+	if (static_cast<size_t>(st.st_size) < size && ftruncate(out->handle->fd, static_cast<off_t>(size)) != 0) {
+		throw std::runtime_error(std::format("failed to resize chain backing file '{}' to {} bytes", out->path.string(), size));
+	}
+	const auto addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, out->handle->fd, 0);
+	if (addr == MAP_FAILED) {
+		throw std::runtime_error(std::format("failed to map chain backing file '{}'", out->path.string()));
+	}
+	out->data = static_cast<std::byte*>(addr);
+	return out;
+}
+
+// madvise() requires a page-aligned address.
+inline
+auto align_to_page(size_t* offset, size_t* size) -> void {
+	static const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const auto beg = *offset - (*offset % page_size);
+	*size  += *offset - beg;
+	*offset = beg;
+}
+
+inline
+auto prefetch(const model& m, size_t offset, size_t size) -> void {
+	align_to_page(&offset, &size);
+	madvise(m.data + offset, size, MADV_WILLNEED);
+}
+
+inline
+auto evict(const model& m, size_t offset, size_t size) -> void {
+	align_to_page(&offset, &size);
+	msync(m.data + offset, size, MS_SYNC);
+	madvise(m.data + offset, size, MADV_DONTNEED);
+}
+
+#endif
+
+[[nodiscard]] inline
+auto open(const std::filesystem::path& path, size_t size, mode open_mode) -> ptr {
+	return map(open_handle(path, open_mode), size);
+}
+
+// Map the same file again at a different size. The old mapping stays
+// valid, and coherent with the new one, for as long as it is alive.
+[[nodiscard]] inline
+auto remap(const model& m, size_t size) -> ptr {
+	return map(m.handle, size);
+}
+
+} // adrian::detail::mapped_file
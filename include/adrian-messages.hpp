@@ -9,7 +9,7 @@ namespace adrian::msg::to_ui::catch_buffer {
 
 struct recording_started  { catch_buffer_id id; ads::frame_idx beg; };
 struct recording_finished { catch_buffer_id id; ads::region region; };
-struct playback_finished  { catch_buffer_id id; };
+struct playback_finished  { catch_buffer_id id; size_t voice; };
 
 } // adrian::msg::to_ui::catch_buffer
 
@@ -46,8 +46,8 @@ auto send(msg_queue* queue, msg m) -> void {
 
 namespace adrian::msg::to_audio::catch_buffer {
 
-struct playback_start { catch_buffer_id id; };
-struct playback_stop  { catch_buffer_id id; };
+struct playback_start { catch_buffer_id id; size_t voice; };
+struct playback_stop  { catch_buffer_id id; size_t voice; };
 
 } // adrian::msg::to_audio::catch_buffer
 
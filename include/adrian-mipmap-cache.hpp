@@ -0,0 +1,213 @@
+#pragma once
+
+#include "adrian-chain.hpp"
+#include <istream>
+#include <ostream>
+
+// MIPMAP CACHE FORMAT ------------------------------------------------------------------------------------
+//
+// All values are written in native byte order.
+//
+//   header
+//   sub-buffer 0: present (uint8)
+//                 [if present] channel 0 mipmap values, channel 1 mipmap values, ...
+//   sub-buffer 1: ...
+//   ...
+//
+// The values are the bottom level of each sub-buffer's mipmap (BUFFER_SIZE
+// uint8s per channel for uint8_minmax, BUFFER_SIZE floats otherwise.) The
+// rest of the levels are rebuilt from them, which is much cheaper than
+// encoding the samples again. Sub-buffers which had no mipmap when the
+// cache was saved aren't present.
+//
+// The key is supplied by the client and identifies the audio which the
+// mipmaps were generated from, e.g. a content hash or a version counter.
+// A cache with a different key, version or shape is considered stale.
+//
+//---------------------------------------------------------------------------------------------------------
+namespace adrian::detail::mipmap_cache {
+
+static constexpr auto MAGIC   = std::array<char, 4>{'A', 'D', 'M', 'C'};
+static constexpr auto VERSION = uint32_t{1};
+
+struct header {
+	std::array<char, 4> magic = MAGIC;
+	uint32_t version          = VERSION;
+	uint32_t format           = 0;
+	uint32_t channel_count    = 0;
+	uint64_t buffer_size      = BUFFER_SIZE;
+	uint64_t buffer_count     = 0;
+	uint64_t key              = 0;
+};
+
+inline
+auto write_bytes(std::ostream& out, const void* data, size_t size) -> void {
+	out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+	if (!out) {
+		throw std::runtime_error("failed to write mipmap cache");
+	}
+}
+
+inline
+auto read_bytes(std::istream& in, void* data, size_t size) -> void {
+	in.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+	if (in.gcount() != static_cast<std::streamsize>(size)) {
+		throw std::runtime_error("unexpected end of mipmap cache");
+	}
+}
+
+[[nodiscard]] inline
+auto get_record_size(ads::channel_count channel_count, mipmap_format format) -> size_t {
+	return channel_count.value * BUFFER_SIZE * (has_float_values(format) ? sizeof(float) : sizeof(uint8_t));
+}
+
+[[nodiscard]] inline
+auto read_header(std::istream& in) -> header {
+	header h;
+	read_bytes(in, &h, sizeof(header));
+	if (h.magic != MAGIC) {
+		throw std::runtime_error("not a mipmap cache");
+	}
+	if (h.format > static_cast<uint32_t>(mipmap_format::float_minmax_rms)) {
+		throw std::runtime_error(std::format("unknown mipmap cache format {}", h.format));
+	}
+	return h;
+}
+
+template <typename T> [[nodiscard]]
+auto get_values(const buffer::mipmap& mipmap) -> const ads::mipmap<T, ads::DYNAMIC_EXTENT, BUFFER_SIZE>& {
+	if constexpr (std::is_same_v<T, float>) { return mipmap.float_lods; }
+	else                                    { return mipmap.lods; }
+}
+
+template <typename T> [[nodiscard]]
+auto get_values(buffer::mipmap* mipmap) -> ads::mipmap<T, ads::DYNAMIC_EXTENT, BUFFER_SIZE>& {
+	if constexpr (std::is_same_v<T, float>) { return mipmap->float_lods; }
+	else                                    { return mipmap->lods; }
+}
+
+// At the bottom level each bin is a single frame so min == max.
+template <typename T>
+auto save_record(std::ostream& out, const buffer::mipmap& mipmap, ads::channel_count channel_count) -> void {
+	auto plane = std::vector<T>(BUFFER_SIZE);
+	const auto& values = get_values<T>(mipmap);
+	for (auto ch = ads::channel_idx{}; ch < channel_count; ch++) {
+		for (size_t i = 0; i < BUFFER_SIZE; i++) {
+			plane[i] = values.read(0.0f, ch, ads::frame_idx{static_cast<int64_t>(i)}).min;
+		}
+		write_bytes(out, plane.data(), plane.size() * sizeof(T));
+	}
+}
+
+// The mipmap isn't visible to any other thread yet.
+template <typename T> [[nodiscard]]
+auto load_record(std::istream& in, ads::channel_count channel_count, mipmap_format format) -> buffer::mipmap_ptr {
+	auto planes = std::vector<T>(channel_count.value * BUFFER_SIZE);
+	read_bytes(in, planes.data(), planes.size() * sizeof(T));
+	auto mipmap = make_mipmap(channel_count, format);
+	auto get_value = [&planes](ads::channel_idx ch, ads::frame_idx fr) {
+		return planes[(ch.value * BUFFER_SIZE) + fr.value];
+	};
+	get_values<T>(mipmap.get()).write(ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, get_value);
+	if constexpr (std::is_same_v<T, float>) {
+		if (has_rms(format)) {
+			std::ranges::transform(planes, mipmap->mean_squares[0].begin(), [](float x) { return x * x; });
+		}
+	}
+	update_lods(mipmap.get(), get_whole_region());
+	return mipmap;
+}
+
+inline
+auto save(ez::ui_t, const model& m, chain_id id, std::ostream& out, uint64_t key) -> void {
+	const auto& chain = m.chains.at(id);
+	if (!chain.buffers) {
+		throw std::runtime_error("can't save the mipmaps of a chain which is still loading");
+	}
+	header h;
+	h.format        = static_cast<uint32_t>(chain.mipmap_format);
+	h.channel_count = static_cast<uint32_t>(chain.channel_count.value);
+	h.buffer_count  = chain.buffers->size();
+	h.key           = key;
+	write_bytes(out, &h, sizeof(header));
+	for (const auto idx : *chain.buffers) {
+		const auto mipmap = idx ? get_mipmap(m, chain.channel_count, idx) : nullptr;
+		// The mipmap may be in the old format if the chain's format was just changed.
+		const auto present = uint8_t{mipmap && mipmap->format == chain.mipmap_format};
+		write_bytes(out, &present, sizeof(present));
+		if (!present) {
+			continue;
+		}
+		if (has_float_values(chain.mipmap_format)) { save_record<float>(out, *mipmap, chain.channel_count); }
+		else                                       { save_record<uint8_t>(out, *mipmap, chain.channel_count); }
+	}
+}
+
+// Build the mipmaps from the cache without holding up the model,
+// then publish them in one go.
+[[nodiscard]] inline
+auto load(ez::nort_t th, service::model* service, chain_id id, std::istream& in, uint64_t key) -> bool {
+	const auto h = read_header(in);
+	if (h.version != VERSION || h.buffer_size != BUFFER_SIZE || h.key != key) {
+		return false;
+	}
+	const auto format = static_cast<mipmap_format>(h.format);
+	const auto m      = service->model.read(th);
+	const auto& chain = m.chains.at(id);
+	if (!chain.buffers || chain.channel_count.value != h.channel_count || chain.buffers->size() != h.buffer_count) {
+		return false;
+	}
+	const auto buffers = *chain.buffers;
+	auto mipmaps = std::vector<buffer::mipmap_ptr>(buffers.size());
+	auto writes  = std::vector<uint64_t>(buffers.size());
+	for (size_t slot = 0; slot < buffers.size(); slot++) {
+		if (const auto idx = buffers[slot]) {
+			writes[slot] = get_mipmap_writes(get_buffer_service(m, chain.channel_count, idx)->critical);
+		}
+	}
+	for (size_t slot = 0; slot < buffers.size(); slot++) {
+		uint8_t present;
+		read_bytes(in, &present, sizeof(present));
+		if (!present) {
+			continue;
+		}
+		if (!buffers[slot]) {
+			// Paged out. It'll be regenerated when it's paged in.
+			in.ignore(static_cast<std::streamsize>(get_record_size(chain.channel_count, format)));
+			continue;
+		}
+		if (has_float_values(format)) { mipmaps[slot] = load_record<float>(in, chain.channel_count, format); }
+		else                          { mipmaps[slot] = load_record<uint8_t>(in, chain.channel_count, format); }
+	}
+	return publish_mipmaps(th, service, id, buffers, format, true, mipmaps, writes);
+}
+
+} // adrian::detail::mipmap_cache
+
+// public interface ----------------------------------------------------------------
+namespace adrian {
+
+// Write the chain's mipmaps to a stream so that they can be loaded
+// with load_mipmap_cache() rather than regenerated from the samples.
+// The key identifies the audio which the mipmaps were generated from,
+// e.g. a content hash or a version counter maintained by the client.
+inline
+auto save_mipmap_cache(ez::ui_t th, chain_id id, std::ostream& out, uint64_t key) -> void {
+	detail::mipmap_cache::save(th, detail::service_.model.read(th), id, out, key);
+}
+
+// Give the chain the mipmaps from a stream written by save_mipmap_cache().
+// - Returns false, leaving the chain alone, if the cache is stale (the key,
+//   the version or the shape of the chain doesn't match.)
+// - Mipmaps are enabled for the chain in the cache's format.
+// - The audio must be what the key says it is. Anything written to the
+//   chain while the cache is being loaded may be missing from the mipmaps.
+// - Sub-buffers which weren't cached, or which are currently paged out,
+//   are regenerated in the usual way.
+// - A single mipmap_changed event is produced for the chain.
+[[nodiscard]] inline
+auto load_mipmap_cache(ez::nort_t th, chain_id id, std::istream& in, uint64_t key) -> bool {
+	return detail::mipmap_cache::load(th, &detail::service_, id, in, key);
+}
+
+} // adrian
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "adrian-encode.hpp"
+#include "adrian-model.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// The sub-buffer mipmaps. Depending on the chain's mipmap_format the values
+// are either quantized to uint8 or stored as floats, in which case there may
+// also be a pyramid of mean squares for the RMS. Either way the UI thread
+// writes the values for the region which the audio thread published and
+// then updates the LODs above it.
+namespace adrian::detail {
+
+[[nodiscard]] inline
+auto grow_dirty_region(ads::mipmap_region region, ads::frame_idx start, ads::frame_idx end) -> ads::mipmap_region {
+	if (start < region.beg) { region.beg = start; }
+	if (end >= region.end)  { region.end = end; }
+	assert (region.beg <= region.end);
+	assert (region.beg <  static_cast<uint64_t>(BUFFER_SIZE));
+	assert (region.end <= static_cast<uint64_t>(BUFFER_SIZE));
+	return region;
+}
+
+[[nodiscard]] inline
+auto get_whole_region() -> ads::mipmap_region {
+	return grow_dirty_region({}, ads::frame_idx{0}, ads::frame_idx{static_cast<int64_t>(BUFFER_SIZE)});
+}
+
+[[nodiscard]] inline
+auto has_float_values(mipmap_format format) -> bool {
+	return format != mipmap_format::uint8_minmax;
+}
+
+[[nodiscard]] inline
+auto has_rms(mipmap_format format) -> bool {
+	return format == mipmap_format::float_minmax_rms;
+}
+
+// A new mipmap says that the sub-buffer is silent.
+[[nodiscard]] inline
+auto make_mipmap(ads::channel_count channel_count, mipmap_format format) -> buffer::mipmap_ptr {
+	auto ptr = std::make_shared<buffer::mipmap>();
+	ptr->format = format;
+	if (has_float_values(format)) {
+		ptr->float_lods = ads::mipmap<float, ads::DYNAMIC_EXTENT, BUFFER_SIZE>{channel_count, {}, {}};
+		ptr->float_lods.write(ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, [](ads::channel_idx, ads::frame_idx) { return 0.0f; });
+		ptr->float_lods.update(get_whole_region());
+	}
+	else {
+		const auto silence = ads::encode<uint8_t>(0.0f);
+		ptr->lods = ads::mipmap<uint8_t, ads::DYNAMIC_EXTENT, BUFFER_SIZE>{channel_count, {}, {}};
+		ptr->lods.write(ads::frame_idx{0}, ads::frame_count{BUFFER_SIZE}, [silence](ads::channel_idx, ads::frame_idx) { return silence; });
+		ptr->lods.update(get_whole_region());
+	}
+	if (has_rms(format)) {
+		for (auto n = BUFFER_SIZE; n > 0; n /= 2) {
+			ptr->mean_squares.emplace_back(channel_count.value * n, 0.0f);
+		}
+	}
+	return ptr;
+}
+
+// Write the values for this region of the storage into the bottom level
+// of the mipmap. The LODs above it still need updating afterwards.
+inline
+auto write_values(buffer::mipmap* mipmap, const buffer::storage& storage, ads::channel_count channel_count, ads::mipmap_region region, mipmap::scratch* scratch) -> void {
+	const auto beg  = region.beg;
+	const auto end  = region.end;
+	assert (beg <= end);
+	const auto size = ads::frame_count{static_cast<uint64_t>((end - beg).value)};
+	if (has_float_values(mipmap->format)) {
+		auto& frames = scratch->frames;
+		frames.resize(channel_count.value * size.value);
+		for (auto ch = ads::channel_idx{0}; ch < channel_count; ch++) {
+			auto copy = [dest = frames.data() + (ch.value * size.value)](const float* buffer, ads::frame_idx, ads::frame_count frame_count) {
+				std::copy(buffer, buffer + frame_count.value, dest);
+				return frame_count;
+			};
+			storage.read(ch, beg, size, copy);
+		}
+		auto get_value = [&frames, beg, size](ads::channel_idx ch, ads::frame_idx fr) {
+			return frames[(ch.value * size.value) + (fr - beg).value];
+		};
+		mipmap->float_lods.write(beg, size, get_value);
+		if (has_rms(mipmap->format)) {
+			for (auto ch = ads::channel_idx{0}; ch < channel_count; ch++) {
+				const auto src  = frames.data() + (ch.value * size.value);
+				const auto dest = mipmap->mean_squares[0].data() + (ch.value * BUFFER_SIZE) + beg.value;
+				std::transform(src, src + size.value, dest, [](float x) { return x * x; });
+			}
+		}
+		return;
+	}
+	auto& encoded = scratch->encoded;
+	encoded.resize(channel_count.value * size.value);
+	for (auto ch = ads::channel_idx{0}; ch < channel_count; ch++) {
+		auto quantize = [dest = encoded.data() + (ch.value * size.value)](const float* buffer, ads::frame_idx, ads::frame_count frame_count) {
+			encode::to_uint8(buffer, dest, frame_count.value);
+			return frame_count;
+		};
+		storage.read(ch, beg, size, quantize);
+	}
+	auto get_value = [&encoded, beg, size](ads::channel_idx ch, ads::frame_idx fr) {
+		return encoded[(ch.value * size.value) + (fr - beg).value];
+	};
+	mipmap->lods.write(beg, size, get_value);
+}
+
+// Encode the samples straight from the storage. This is a scary read, but
+// by the time the record is received the audio thread will usually have
+// moved on, and if it hasn't then it will publish the region again anyway.
+// Returns true if the LODs of this sub-buffer were already up to date.
+inline
+auto encode_mipmap(ez::ui_t, const mipmap::record& record, buffer::mipmap* mipmap, mipmap::scratch* scratch) -> bool {
+	write_values(mipmap, *record.storage, record.channel_count, record.region, scratch);
+	const auto was_clean = mipmap->dirty_region.is_empty();
+	mipmap->dirty_region = grow_dirty_region(mipmap->dirty_region, record.region.beg, record.region.end);
+	return was_clean;
+}
+
+// Only the bins above the dirty region are recalculated.
+inline
+auto update_mean_squares(buffer::mipmap* mipmap, ads::mipmap_region region) -> void {
+	auto& levels = mipmap->mean_squares;
+	const auto channel_count = levels[0].size() / BUFFER_SIZE;
+	for (size_t level = 1; level < levels.size(); level++) {
+		const auto n_below = BUFFER_SIZE >> (level - 1);
+		const auto n       = BUFFER_SIZE >> level;
+		const auto beg     = static_cast<size_t>(region.beg.value) >> level;
+		const auto end     = static_cast<size_t>(region.end.value - 1) >> level;
+		for (size_t ch = 0; ch < channel_count; ch++) {
+			const auto below = levels[level - 1].data() + (ch * n_below);
+			const auto dest  = levels[level].data() + (ch * n);
+			for (auto i = beg; i <= end; i++) {
+				dest[i] = (below[i * 2] + below[(i * 2) + 1]) * 0.5f;
+			}
+		}
+	}
+}
+
+inline
+auto update_lods(buffer::mipmap* mipmap, ads::mipmap_region region) -> void {
+	if (has_float_values(mipmap->format)) { mipmap->float_lods.update(region); }
+	else                                  { mipmap->lods.update(region); }
+	if (has_rms(mipmap->format)) {
+		update_mean_squares(mipmap, region);
+	}
+}
+
+inline
+auto update_mipmap(ez::ui_t, buffer::mipmap* mipmap) -> void {
+	if (mipmap->dirty_region.is_empty()) {
+		return;
+	}
+	update_lods(mipmap, mipmap->dirty_region);
+	mipmap->dirty_region = {};
+}
+
+// A complete mipmap for the whole sub-buffer, for when it isn't visible
+// to the UI thread yet. This is a scary read of the storage.
+[[nodiscard]] inline
+auto build_mipmap(const buffer::storage& storage, ads::channel_count channel_count, mipmap_format format, mipmap::scratch* scratch) -> buffer::mipmap_ptr {
+	auto mipmap = make_mipmap(channel_count, format);
+	write_values(mipmap.get(), storage, channel_count, get_whole_region(), scratch);
+	update_lods(mipmap.get(), get_whole_region());
+	return mipmap;
+}
+
+inline
+auto clear_mipmap(buffer::mipmap* mipmap) -> void {
+	mipmap->lods.clear();
+	mipmap->float_lods.clear();
+	for (auto& level : mipmap->mean_squares) {
+		std::ranges::fill(level, 0.0f);
+	}
+}
+
+[[nodiscard]] inline
+auto bin_size_to_lod(const buffer::mipmap& mipmap, double bin_size) -> float {
+	return has_float_values(mipmap.format) ? mipmap.float_lods.bin_size_to_lod(bin_size) : mipmap.lods.bin_size_to_lod(bin_size);
+}
+
+// Float values are quantized on the way out.
+[[nodiscard]] inline
+auto read_minmax(const buffer::mipmap& mipmap, float lod, ads::channel_idx ch, ads::frame_idx fr) -> ads::mipmap_minmax<uint8_t> {
+	if (!has_float_values(mipmap.format)) {
+		return mipmap.lods.read(lod, ch, fr);
+	}
+	const auto value = mipmap.float_lods.read(lod, ch, fr);
+	return {ads::encode<uint8_t>(value.min), ads::encode<uint8_t>(value.max)};
+}
+
+[[nodiscard]] inline
+auto read_mean_square(const buffer::mipmap& mipmap, float lod, ads::channel_idx ch, ads::frame_idx fr) -> float {
+	if (!has_rms(mipmap.format)) {
+		return 0.0f;
+	}
+	const auto& levels = mipmap.mean_squares;
+	const auto level   = std::clamp(static_cast<size_t>(std::max(0L, std::lround(lod))), size_t{0}, levels.size() - 1);
+	const auto n       = BUFFER_SIZE >> level;
+	return levels[level][(ch.value * n) + (static_cast<size_t>(fr.value) >> level)];
+}
+
+[[nodiscard]] inline
+auto read_rms(const buffer::mipmap& mipmap, float lod, ads::channel_idx ch, ads::frame_idx fr) -> float {
+	return std::sqrt(read_mean_square(mipmap, lod, ch, fr));
+}
+
+// uint8 values are decoded on the way out.
+[[nodiscard]] inline
+auto read_value(const buffer::mipmap& mipmap, float lod, ads::channel_idx ch, ads::frame_idx fr) -> mipmap_value {
+	auto out = mipmap_value{};
+	if (has_float_values(mipmap.format)) {
+		const auto value = mipmap.float_lods.read(lod, ch, fr);
+		out.min = value.min;
+		out.max = value.max;
+	}
+	else {
+		const auto value = mipmap.lods.read(lod, ch, fr);
+		out.min = ads::decode(value.min);
+		out.max = ads::decode(value.max);
+	}
+	out.rms = read_rms(mipmap, lod, ch, fr);
+	return out;
+}
+
+} // adrian::detail
@@ -1,17 +1,25 @@
 #pragma once
 
+#include "adrian-gate.hpp"
+#include "adrian-interpolation.hpp"
+#include "adrian-mapped-file.hpp"
 #include "adrian-messages.hpp"
-#include "adrian-peak-gate.hpp"
+#include "adrian-mpmc-queue.hpp"
 #include "adrian-pp.hpp"
 #include "adrian-ui-events.hpp"
+#include "adrian-worker-pool.hpp"
 #include <ads-mipmap.hpp>
 #include <ads.hpp>
 #include <any>
+#include <array>
+#include <atomic>
 #include <condition_variable>
-#include <ez-beach.hpp>
 #include <ez.hpp>
 #include <jthread.hpp>
 #include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
 #pragma warning(push, 0)
 #include <immer/map.hpp>
 #include <immer/table.hpp>
@@ -20,10 +28,78 @@
 
 namespace adrian {
 
+// What the mipmap stores for each bin.
+enum class mipmap_format {
+	uint8_minmax,     // Min/max quantized to 256 steps. The smallest, but quiet material bands visibly.
+	float_minmax,     // Full precision min/max. Four times the memory.
+	float_minmax_rms, // As above, plus the RMS of each bin.
+};
+
+// How a catch buffer lays out its ring.
+enum class catch_buffer_layout {
+	// Twice the memory of the captured duration. The chain is split into two
+	// halves and readers always read from the half the writer isn't in.
+	two_partitions,
+	// A single ring of the captured duration, plus a guard zone ahead of the
+	// write marker which gives slow readers of the oldest frames time to get
+	// out of the writer's way.
+	single_ring,
+};
+
+// The outcome of a validated read of a catch buffer.
+enum class catch_buffer_read_status {
+	ok,
+	// The writer got to some of the frames while they were being read,
+	// so they may be a mix of old and new audio.
+	torn,
+	// The read was consistent, but some of the frames were written after
+	// the generation which the caller said it was interested in.
+	overwritten,
+};
+
+// How a catch buffer playback voice plays its region.
+struct playback_options {
+	// Play the region over and over until the voice is stopped.
+	bool loop = false;
+	// 1 is the recorded speed. Must be greater than 0 and no more than 8.
+	double rate = 1.0;
+	// Only used when the voice is looping or the rate isn't 1.
+	playback_interpolation interpolation = playback_interpolation::cubic;
+};
+
+// A mipmap bin as returned by read_mipmap_value.
+struct mipmap_value {
+	float min = 0.0f;
+	float max = 0.0f;
+	float rms = 0.0f; // Only for float_minmax_rms.
+};
+
 struct chain_options {
 	bool allocate_now   = false; // Immediately allocate the entire chain (blocks the thread until done.)
 	bool enable_mipmaps = false;
+	adrian::mipmap_format mipmap_format = adrian::mipmap_format::uint8_minmax;
 	bool silent         = false; // If true, don't produce any UI events.
+	// If not empty, the chain is backed by this file instead of living entirely in
+	// memory. Only the sub-buffers around the chain's hot regions are kept resident.
+	std::filesystem::path backing_file;
+};
+
+// One catch buffer's share of a batch process() call. There is one input
+// pointer per channel of the catch buffer and any number of outputs.
+struct catch_buffer_job {
+	catch_buffer_id id;
+	std::span<const float* const> in;
+	std::span<float* const> out;
+	float threshold        = 0.0f;
+	float gain             = 1.0f;
+	bool disable_recording = false;
+};
+
+// A region of a disk-backed chain which is about to be read or written.
+struct hot_region {
+	ADRIAN_DEFAULT_EQUALITY(hot_region);
+	ads::frame_idx beg;
+	ads::frame_count frame_count;
 };
 
 } // adrian
@@ -41,6 +117,21 @@ namespace adrian::detail {
 static_assert (BUFFER_SIZE > 0);
 static_assert (is_power_of_two(BUFFER_SIZE));
 
+// How many regions of a catch buffer can be played back at once.
+#if defined(ADRIAN_OVERRIDE_CATCH_BUFFER_VOICE_COUNT)
+    static constexpr size_t CATCH_BUFFER_VOICE_COUNT = ADRIAN_OVERRIDE_CATCH_BUFFER_VOICE_COUNT;
+#else
+    static constexpr size_t CATCH_BUFFER_VOICE_COUNT = 8;
+#endif
+
+static_assert (CATCH_BUFFER_VOICE_COUNT > 0);
+
+// Limits how many frames one vector of varispeed playback reads.
+static constexpr auto MAX_PLAYBACK_RATE = 8.0;
+
+// How many sub-buffers either side of a hot region of a disk-backed chain are kept resident.
+static constexpr size_t PAGING_READAHEAD = 2;
+
 struct buffer_idx { ADRIAN_DEFAULT_EQUALITY(buffer_idx); int32_t value = -1; explicit operator bool() const { return value >= 0; } };
 
 // thread annotations --------------------------------------------------------------
@@ -52,6 +143,54 @@ static constexpr auto alloc = ez::nort;
 } // th
 
 // buffer --------------------------------------------------------------------------
+namespace buffer {
+
+// Sub-buffer storage is reference counted so that chains can share
+// it. A shared storage is copied before it is written to. The model
+// owns the references (see buffer::info) so a storage lives for as
+// long as any snapshot of the model which refers to it.
+using storage     = ads::data<float, ads::DYNAMIC_EXTENT, BUFFER_SIZE>;
+using storage_ptr = std::shared_ptr<storage>;
+
+// Spare storage which a writer can take when it needs to copy a shared
+// sub-buffer before writing to it. It is kept topped up by the allocation
+// thread. Writers can be on more than one realtime thread so the spares
+// are taken through an MPMC queue. Writers never give up a reference
+// themselves: the copy is handed over through the sub-buffer's incoming
+// slot and the index goes into the settle queue, so that the UI thread
+// can move it into the model. References given up by non-realtime
+// threads go into the retired list, which the UI thread empties once it
+// is done with any mipmap records which might still point at them.
+struct reserve {
+	static constexpr auto SIZE = 16;
+	detail::mpmc_queue<storage_ptr> spare = detail::mpmc_queue<storage_ptr>{SIZE};
+	detail::mpmc_queue<buffer_idx> settle = detail::mpmc_queue<buffer_idx>{SIZE * 2};
+	std::atomic<bool> settle_overflowed   = false;
+	std::atomic<uint64_t> underruns       = 0;
+	std::mutex mut_retired;
+	std::vector<storage_ptr> retired;
+};
+
+// Only sub-buffers of chains which generate mipmaps have one of these.
+// They are created and released by the allocation thread as mipmaps are
+// enabled and disabled, but the contents belong to the UI thread.
+struct mipmap {
+	adrian::mipmap_format format;
+	// Only one of these is used, depending on the format.
+	ads::mipmap<uint8_t, ads::DYNAMIC_EXTENT, BUFFER_SIZE> lods;
+	ads::mipmap<float, ads::DYNAMIC_EXTENT, BUFFER_SIZE> float_lods;
+	// For float_minmax_rms. Level N holds the mean square of each bin of
+	// 2^N frames, one channel after another.
+	std::vector<std::vector<float>> mean_squares;
+	// Encoded values have been written to this region
+	// of the mipmap but the LODs haven't been updated yet.
+	ads::mipmap_region dirty_region;
+};
+
+using mipmap_ptr = std::shared_ptr<mipmap>;
+
+} // buffer
+
 namespace buffer::service {
 
 struct audio {
@@ -59,34 +198,131 @@ struct audio {
 };
 
 struct critical {
-	ads::data<float, ads::DYNAMIC_EXTENT, BUFFER_SIZE> storage;
-	ads::data<uint8_t, ads::DYNAMIC_EXTENT, BUFFER_SIZE> mipmap_staging_buffer;
-	ads::mipmap_region mipmap_dirty_region;
-};
-
-struct ui {
-	ads::mipmap<uint8_t, ads::DYNAMIC_EXTENT, BUFFER_SIZE> mipmap;
+	// The storage which is read and written. It is only ever changed by
+	// a non-realtime thread while nobody can be writing to the sub-buffer,
+	// or by the writer when it swaps in its own copy of a shared storage.
+	std::atomic<buffer::storage*> storage = nullptr;
+	// Set when another sub-buffer might be referring to the same storage.
+	// Cleared by the writer once it has its own copy.
+	std::atomic<bool> shared = false;
+	// The writer's own copy, waiting for the UI thread to move it into
+	// the model. Only touched by the writer while incoming_full is false
+	// and by the UI thread while it is true.
+	buffer::storage_ptr incoming;
+	std::atomic<bool> incoming_full = false;
+	// For sub-buffers of disk-backed chains. Writers register themselves
+	// while they write so that the allocation thread can wait for them
+	// before paging the sub-buffer out. Writes after that are dropped.
+	std::atomic<bool> evicted = false;
+	std::atomic<int> writers  = 0;
+	// Set when a mipmap was just created for the sub-buffer. The audio
+	// thread marks the whole sub-buffer dirty the next time it looks.
+	std::atomic<bool> mipmap_invalid = false;
+	// Bumped by the writer after each write which dirties the mipmap.
+	std::atomic<uint64_t> mipmap_writes = 0;
+	// Set to mipmap_writes + 1, as it was before the storage was read,
+	// when the sub-buffer's mipmap was just built in bulk or loaded from
+	// a cache. The next time the audio thread looks it forgets its dirty
+	// region, unless there were more writes since then, in which case the
+	// region is kept and encoded in the usual way.
+	std::atomic<uint64_t> mipmap_cached = 0;
 };
 
 struct model {
 	service::audio audio;
 	service::critical critical;
-	service::ui ui;
 };
 
 using ptr = std::shared_ptr<model>;
 
 } // buffer::service
 
+// mipmap --------------------------------------------------------------------------
+namespace mipmap {
+
+// A sub-buffer of a chain which has been written to since
+// its dirty region was last published.
+struct dirty_buffer {
+	chain_id chain;
+	buffer_idx buffer;
+	size_t slot; // Position of the sub-buffer in the chain.
+};
+
+// Fed by the writer whenever a sub-buffer's dirty region goes from empty
+// to non-empty, and by the non-realtime threads for the sub-buffers which
+// they page in, clone, edit or give new mipmaps, so that the audio thread
+// only has to look at the sub-buffers which actually changed. If it ever
+// fills up the audio thread falls back to scanning every mipmapped chain
+// once. Writes can
+// come from any thread (the audio thread recording into a catch buffer
+// and other threads writing to chains) so the queue has to take more
+// than one producer.
+struct dirty_list {
+	static constexpr auto SIZE = 4096;
+	using queue_type = detail::mpmc_queue<dirty_buffer>;
+	queue_type v                 = queue_type{SIZE};
+	std::atomic<bool> overflowed = false;
+};
+
+// The audio thread publishes one of these when it has written to a region
+// of a sub-buffer. The encoding is done by the UI thread, straight from the
+// storage.
+struct record {
+	chain_id chain;
+	ads::channel_count channel_count;
+	buffer_idx buffer;
+	size_t slot;
+	const buffer::storage* storage = nullptr;
+	ads::mipmap_region region;
+};
+
+// The only thing shared between the audio and UI threads for the mipmap
+// handoff. A record is one sub-buffer region, so this only needs to be as
+// big as the number of sub-buffers which are expected to be written to in
+// between two UI updates. If it fills up, the audio thread leaves the
+// regions dirty and publishes them again once the UI has caught up.
+struct record_queue {
+#if defined(ADRIAN_OVERRIDE_MIPMAP_RECORD_QUEUE_SIZE)
+	static constexpr auto SIZE = ADRIAN_OVERRIDE_MIPMAP_RECORD_QUEUE_SIZE;
+#else
+	static constexpr auto SIZE = 4096;
+#endif
+	using queue_type = moodycamel::ReaderWriterQueue<record>;
+	queue_type v = queue_type{SIZE};
+};
+
+// Reused by the UI thread when encoding records.
+struct scratch {
+	std::vector<uint8_t> encoded;
+	std::vector<float> frames;
+};
+
+// A sub-buffer whose LODs need updating by the UI thread.
+struct touched_buffer {
+	chain_id chain;
+	size_t slot;
+	buffer::mipmap_ptr mipmap;
+};
+
+} // mipmap
+
 namespace buffer {
 
 struct info {
 	bool in_use = false;
+	buffer::mipmap_ptr mipmap;
+	// Owns the sub-buffer's storage. This is what service::critical::storage
+	// points at, except for the short time between a writer swapping in
+	// its own copy and the UI thread settling it.
+	buffer::storage_ptr storage;
 };
 
 struct table {
 	immer::vector<buffer::info> info;
 	immer::vector<service::ptr> service;
+	// Only created once a chain with this channel count has been cloned.
+	std::shared_ptr<buffer::reserve> reserve;
+	std::shared_ptr<detail::mipmap::dirty_list> mipmap_dirty = std::make_shared<detail::mipmap::dirty_list>();
 };
 
 } // buffer
@@ -100,10 +336,19 @@ struct flags {
 		loading          = 1 << 1,
 		generate_mipmaps = 1 << 2,
 		silent           = 1 << 3,
+		disk_backed      = 1 << 4,
 	};
 	int value = 0;
 };
 
+// Shared by every snapshot of a disk-backed chain.
+struct disk_stats {
+	// Writes to sub-buffers which weren't paged in. They are dropped.
+	std::atomic<uint64_t> dropped_writes = 0;
+	// Only touched by the UI thread.
+	uint64_t reported_dropped_writes = 0;
+};
+
 struct model {
 	chain_id id;
 	chain::flags flags;
@@ -111,8 +356,37 @@ struct model {
 	ads::channel_count channel_count;
 	ads::frame_count actual_frame_count;
 	ads::frame_count requested_frame_count;
+	// For disk-backed chains, sub-buffers which are currently paged
+	// out have an invalid index.
 	std::optional<immer::vector<buffer_idx>> buffers;
+	adrian::mipmap_format mipmap_format = adrian::mipmap_format::uint8_minmax;
+	// Bumped when the chain's mipmaps are replaced wholesale
+	// rather than being encoded in the usual way.
+	uint64_t mipmap_version = 0;
 	std::any client_data;
+	mapped_file::ptr file;
+	std::shared_ptr<chain::disk_stats> disk_stats;
+	immer::vector<hot_region> hot_regions;
+};
+
+// One cell of the overview. uint8 chains are decoded to floats so that
+// every mipmap_format is summarized the same way. The mean square is
+// zero unless the chain's mipmap_format has RMS.
+struct overview_value {
+	float min         = 0.0f;
+	float max         = 0.0f;
+	float mean_square = 0.0f;
+};
+
+// A summary of the whole chain which sits above the per-sub-buffer
+// mipmaps. Only the UI thread touches these.
+struct overview {
+	// The sub-buffers which this was built from.
+	immer::vector<buffer_idx> buffers;
+	uint64_t mipmap_version = 0;
+	// Level 0 has one value per sub-buffer, each level above it has
+	// half as many. The values are stored one channel after another.
+	std::vector<std::vector<overview_value>> levels;
 };
 
 inline
@@ -122,7 +396,11 @@ auto operator==(const model& a, const model& b) -> bool {
 		   a.channel_count         == b.channel_count &&
 		   a.actual_frame_count    == b.actual_frame_count &&
 		   a.requested_frame_count == b.requested_frame_count &&
-		   a.buffers               == b.buffers;
+		   a.buffers               == b.buffers &&
+		   a.mipmap_format         == b.mipmap_format &&
+		   a.mipmap_version        == b.mipmap_version &&
+		   a.file                  == b.file &&
+		   a.hot_regions           == b.hot_regions;
 }
 
 } // chain
@@ -141,18 +419,51 @@ namespace catch_buffer::service {
 
 struct critical {
 	std::atomic<uint64_t> write_marker      = 0;
-	std::atomic<uint64_t> playback_progress = 0;
+	// How many frames have ever been written. Unlike the write marker this
+	// never wraps, so readers can tell whether the writer lapped them.
+	std::atomic<uint64_t> write_generation  = 0;
 	std::atomic<bool>     record_active     = false;
+	// One per playback voice.
+	std::array<std::atomic<uint64_t>, CATCH_BUFFER_VOICE_COUNT> playback_progress = {};
+	// A new gate from set_gate_options, waiting for the audio thread to swap
+	// it in. Only touched by the UI thread while incoming_gate_full is false
+	// and by the audio thread while it is true.
+	gate::ptr             incoming_gate;
+	std::atomic<bool>     incoming_gate_full = false;
+	// The gate which the audio thread swapped out, waiting for the UI thread
+	// to free it. Only touched by the audio thread while retired_gate_full
+	// is false and by the UI thread while it is true.
+	gate::ptr             retired_gate;
+	std::atomic<bool>     retired_gate_full  = false;
 };
 
 struct audio {
-	peak_gate::model peak_gate;
+	// Only the audio thread touches the detector state.
+	gate::ptr        gate;
 	ads::frame_idx   record_start;
-	bool             playback_active = false;
+	// How many frames have been written while the gate was closed since
+	// the ring started being written continuously or the last recording
+	// ended. The pre-roll doesn't reach back further than this.
+	uint64_t         pre_roll_history = 0;
+	std::array<bool, CATCH_BUFFER_VOICE_COUNT> playback_active = {};
+	// How far into its region each voice is. The progress in the critical
+	// state is only the whole frames of this, for the UI.
+	std::array<double, CATCH_BUFFER_VOICE_COUNT> playback_position = {};
+	// Input at the end of a block which didn't fill a whole DSP vector.
+	// It's recorded once the rest of the vector arrives.
+	// One vector per channel.
+	std::vector<float> pending_input;
+	uint64_t           pending_frames = 0;
+	// Voices whose playback just ended. The UI is told about them once
+	// playback is done, which for a batch process() is after the workers
+	// have finished.
+	std::array<bool, CATCH_BUFFER_VOICE_COUNT> playback_finished = {};
 };
 
 struct ui {
-	bool playback_active = false;
+	std::array<bool, CATCH_BUFFER_VOICE_COUNT> playback_active = {};
+	// A gate which is waiting for the audio thread to take the last one.
+	gate::ptr pending_gate;
 };
 
 struct model {
@@ -167,18 +478,52 @@ using ptr = std::shared_ptr<model>;
 
 namespace catch_buffer {
 
+struct playback_region {
+	ads::frame_idx           start;
+	ads::frame_count         length;
+	adrian::playback_options options;
+};
+
 struct model {
 	catch_buffer_id       id;
 	chain_id              chain;
 	adrian::chain_options chain_options;
 	std::any              client_data;
 	service::ptr          service;
-	ads::frame_idx        playback_start;
-	ads::frame_count      playback_length;
+	// One per playback voice.
+	std::array<playback_region, CATCH_BUFFER_VOICE_COUNT> playback;
+	catch_buffer_layout   layout = catch_buffer_layout::two_partitions;
+	// Only for the single ring layout.
+	ads::frame_count      guard;
+	// How much of the audio from before the gate opened to include in
+	// a recording. If this is non-zero the ring is written continuously.
+	ads::frame_count      pre_roll;
+	// The gate itself lives in the service, since only the
+	// audio thread may touch the detector state.
+	adrian::gate_options  gate;
 };
 
 } // catch_buffer
 
+// paging --------------------------------------------------------------------------
+// Copying one sub-buffer of a disk-backed chain in from
+// its backing file, or out to it.
+struct page_op {
+	ADRIAN_DEFAULT_EQUALITY(page_op);
+	chain_id chain;
+	size_t slot;
+	bool page_in;
+};
+
+// The allocation thread's paging work, worked through from the back.
+// Paging in takes priority over paging out. It is worked out again
+// for a chain whenever its hot regions or size change, so nobody has
+// to scan the chains to find out if there is anything to do.
+struct paging {
+	immer::vector<page_op> ins;
+	immer::vector<page_op> outs;
+};
+
 // model ---------------------------------------------------------------------------
 // Buffers are grouped by channel count
 using buffers        = immer::map<uint64_t, detail::buffer::table>;
@@ -191,39 +536,50 @@ struct model {
 	detail::catch_buffers  catch_buffers;
 	detail::chains         chains;
 	detail::loading_chains loading_chains;
+	detail::paging         paging;
 	int32_t next_id = 0;
 };
 
 namespace service {
 
-static constexpr auto MIPMAP_AUDIO_CATCHER = ez::catcher{0};
-static constexpr auto MIPMAP_UI_CATCHER     = ez::catcher{1};
-using mipmap_beach_ball   = ez::beach_ball<ez::player_count{2}>;
-using mipmap_player_audio = mipmap_beach_ball::player<MIPMAP_AUDIO_CATCHER.v>;
-using mipmap_player_ui    = mipmap_beach_ball::player<MIPMAP_UI_CATCHER.v>;
-
-struct beach {
-	mipmap_beach_ball ball    = {MIPMAP_AUDIO_CATCHER};
-	mipmap_player_audio audio = ball.make_player<MIPMAP_AUDIO_CATCHER.v>();
-	mipmap_player_ui ui       = ball.make_player<MIPMAP_UI_CATCHER.v>();
-};
-
 struct critical {
 	std::condition_variable cv_allocation_thread_wait;
 	std::mutex mut_allocation_thread_wait;
 	msg::to_ui::msg_queue msgs_to_ui;
 	msg::to_audio::msg_queue msgs_to_audio;
+	mipmap::record_queue mipmap_records;
+	// Set when a chain's mipmaps were enabled or disabled.
+	std::atomic<bool> mipmaps_need_maintenance = false;
+	// Chains whose mipmaps the allocation thread is rebuilding in the
+	// worker pool. They're left alone until the rebuild is published.
+	std::mutex mut_mipmap_rebuilds;
+	std::condition_variable cv_mipmap_rebuilds;
+	std::vector<chain_id> mipmap_rebuilds;
+	// Catch buffer services which were replaced by a reconfigure or whose
+	// catch buffer was erased. Older models still refer to them, and the
+	// audio thread may be the last to let go of one of those, so they're
+	// kept here until the UI thread is the only one left holding them.
+	std::mutex mut_retired_catch_buffers;
+	std::vector<catch_buffer::service::ptr> retired_catch_buffers;
 };
 
 struct ui {
 	detail::model prev_frame;
+	uint64_t cow_underruns = 0;
+	std::vector<mipmap::record> mipmap_records;
+	mipmap::scratch mipmap_scratch;
+	std::vector<mipmap::touched_buffer> mipmap_touched;
+	// Created the first time a chain is read zoomed out
+	// further than one sub-buffer per bin.
+	std::unordered_map<chain_id, chain::overview> chain_overviews;
 };
 
 struct model {
-	service::beach beach;
 	service::critical critical;
 	service::ui ui;
 	ez::sync<detail::model> model;
+	// Last, so that it is stopped before anything its jobs might touch.
+	worker_pool workers;
 };
 
 } // service
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+// A bounded lock-free queue which any number of threads can push to and pop
+// from, for the handoffs which have more than one producer or consumer. It's
+// Dmitry Vyukov's bounded MPMC queue: each cell has a sequence number which
+// says whose turn it is, so a push or pop is one compare-exchange on the
+// position plus a store to the cell, and never allocates. The interface
+// matches moodycamel::ReaderWriterQueue's try_ functions so the two can be
+// swapped.
+namespace adrian::detail {
+
+template <typename T>
+struct mpmc_queue {
+	explicit mpmc_queue(size_t size)
+		: mask_{std::bit_ceil(std::max(size, size_t{2})) - 1}
+		, cells_{std::make_unique<cell[]>(mask_ + 1)}
+	{
+		for (size_t i = 0; i <= mask_; i++) {
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+	mpmc_queue(const mpmc_queue&)            = delete;
+	mpmc_queue& operator=(const mpmc_queue&) = delete;
+	// The value is only moved from if there was room for it.
+	[[nodiscard]] auto try_enqueue(T&& value) -> bool {
+		auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+		for (;;) {
+			auto& c        = cells_[pos & mask_];
+			const auto seq = c.sequence.load(std::memory_order_acquire);
+			const auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (dif == 0) {
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					c.value = std::move(value);
+					c.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (dif < 0) { return false; }
+			else              { pos = enqueue_pos_.load(std::memory_order_relaxed); }
+		}
+	}
+	[[nodiscard]] auto try_enqueue(const T& value) -> bool {
+		auto copy = value;
+		return try_enqueue(std::move(copy));
+	}
+	[[nodiscard]] auto try_dequeue(T& out) -> bool {
+		auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+		for (;;) {
+			auto& c        = cells_[pos & mask_];
+			const auto seq = c.sequence.load(std::memory_order_acquire);
+			const auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+			if (dif == 0) {
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					out = std::move(c.value);
+					c.value = T{};
+					c.sequence.store(pos + mask_ + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (dif < 0) { return false; }
+			else              { pos = dequeue_pos_.load(std::memory_order_relaxed); }
+		}
+	}
+	[[nodiscard]] auto size_approx() const -> size_t {
+		const auto enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+		const auto dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+		return enqueued > dequeued ? enqueued - dequeued : 0;
+	}
+	[[nodiscard]] auto max_capacity() const -> size_t { return mask_ + 1; }
+private:
+	struct cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+	size_t mask_;
+	std::unique_ptr<cell[]> cells_;
+	alignas(64) std::atomic<size_t> enqueue_pos_ = 0;
+	alignas(64) std::atomic<size_t> dequeue_pos_ = 0;
+};
+
+} // adrian::detail
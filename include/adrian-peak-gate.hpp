@@ -3,6 +3,93 @@
 #pragma warning(push, 0)
 #include <DSP/MLDSPGens.h>
 #pragma warning(pop)
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define ADRIAN_PEAK_GATE_SSE2
+#	include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#	define ADRIAN_PEAK_GATE_NEON
+#	include <arm_neon.h>
+#endif
+
+// Finding the exact frame at which the input first went over the threshold.
+// The gate itself only makes a decision once per vector.
+namespace adrian::peak_gate::onset {
+
+[[nodiscard]] inline
+auto find_scalar(const float* src, size_t count, float threshold) -> size_t {
+	for (size_t i = 0; i < count; i++) {
+		if (std::abs(src[i]) > threshold) {
+			return i;
+		}
+	}
+	return count;
+}
+
+#if defined(__AVX2__)
+
+[[nodiscard]] inline
+auto find(const float* src, size_t count, float threshold) -> size_t {
+	const auto t    = _mm256_set1_ps(threshold);
+	const auto sign = _mm256_set1_ps(-0.0f);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const auto v    = _mm256_andnot_ps(sign, _mm256_loadu_ps(src + i));
+		const auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(v, t, _CMP_GT_OQ)));
+		if (mask) {
+			return i + std::countr_zero(mask);
+		}
+	}
+	return i + find_scalar(src + i, count - i, threshold);
+}
+
+#elif defined(ADRIAN_PEAK_GATE_SSE2)
+
+[[nodiscard]] inline
+auto find(const float* src, size_t count, float threshold) -> size_t {
+	const auto t    = _mm_set1_ps(threshold);
+	const auto sign = _mm_set1_ps(-0.0f);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const auto v    = _mm_andnot_ps(sign, _mm_loadu_ps(src + i));
+		const auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_cmpgt_ps(v, t)));
+		if (mask) {
+			return i + std::countr_zero(mask);
+		}
+	}
+	return i + find_scalar(src + i, count - i, threshold);
+}
+
+#elif defined(ADRIAN_PEAK_GATE_NEON)
+
+[[nodiscard]] inline
+auto find(const float* src, size_t count, float threshold) -> size_t {
+	const auto t = vdupq_n_f32(threshold);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		// There's no movemask so just find out whether any lane is over.
+		if (vmaxvq_u32(vcagtq_f32(vld1q_f32(src + i), t))) {
+			return i + find_scalar(src + i, 4, threshold);
+		}
+	}
+	return i + find_scalar(src + i, count - i, threshold);
+}
+
+#else
+
+[[nodiscard]] inline
+auto find(const float* src, size_t count, float threshold) -> size_t {
+	return find_scalar(src, count, threshold);
+}
+
+#endif
+
+} // adrian::peak_gate::onset
 
 namespace adrian::peak_gate {
 
@@ -49,15 +136,25 @@ auto process(model* m, const ml::DSPVector& in, float threshold) -> bool {
 	return process(m, ads::channel_idx{0}, in, threshold);
 }
 
+// The first frame of the vector at which any of the channels went over
+// the threshold, or the start of the vector if none of them did.
+template <int N> [[nodiscard]]
+auto find_onset(const ml::DSPVectorArray<N>& in, float threshold) -> uint64_t {
+	auto first = size_t{kFloatsPerDSPVector};
+	for (int i = 0; i < N; i++) {
+		first = std::min(first, onset::find(in.constRow(i).getConstBuffer(), first, threshold));
+	}
+	return first < kFloatsPerDSPVector ? first : 0;
+}
+
+// `in` holds one vector of frames per channel, one after the other.
 [[nodiscard]] inline
-auto process(model* m, const ml::DSPVectorArray<2>& in, float threshold) -> bool {
-	assert (m->channels.size() == 2);
-	for (uint64_t i = 0; i < 2; i++) {
-		if (process(m, ads::channel_idx{i}, in.constRow(static_cast<int>(i)), threshold)) {
-			return true;
-		}
+auto find_onset(const float* in, ads::channel_count channel_count, float threshold) -> uint64_t {
+	auto first = size_t{kFloatsPerDSPVector};
+	for (size_t i = 0; i < channel_count.value; i++) {
+		first = std::min(first, onset::find(in + (i * kFloatsPerDSPVector), first, threshold));
 	}
-	return false;
+	return first < kFloatsPerDSPVector ? first : 0;
 }
 
 } // adrian::peak_gate
\ No newline at end of file
@@ -9,7 +9,7 @@ namespace adrian::ui::events::catch_buffer {
 
 struct recording_started  { catch_buffer_id id; ads::frame_idx beg; std::any client_data; };
 struct recording_finished { catch_buffer_id id; ads::region region; std::any client_data; };
-struct playback_finished  { catch_buffer_id id; std::any client_data; };
+struct playback_finished  { catch_buffer_id id; size_t voice; std::any client_data; };
 
 } // adrian::ui::events::catch_buffer
 
@@ -19,12 +19,17 @@ struct load_begin     { chain_id id; std::any client_data; };
 struct load_end       { chain_id id; std::any client_data; };
 struct load_progress  { chain_id id; float progress; std::any client_data; };
 struct mipmap_changed { chain_id id; std::any client_data; };
+// Writes to sub-buffers of a disk-backed chain which weren't paged in were
+// dropped. The count is the total since the chain was created.
+struct warn_paged_out_write { chain_id id; uint64_t count; std::any client_data; };
 
 } // adrian::ui::events::chain
 
 namespace adrian::ui::events {
 
 struct warn_queue_full { size_t size_approx; };
+// The copy-on-write reserve ran dry and writes to shared sub-buffers were dropped.
+struct warn_cow_reserve_underrun { uint64_t count; };
 
 } // adrian::ui::events
 
@@ -38,7 +43,9 @@ using event = std::variant<
 	ui::events::chain::load_end,
 	ui::events::chain::load_progress,
 	ui::events::chain::mipmap_changed,
-	ui::events::warn_queue_full
+	ui::events::chain::warn_paged_out_write,
+	ui::events::warn_queue_full,
+	ui::events::warn_cow_reserve_underrun
 >;
 
 } // adrian::ui
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <jthread.hpp>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads for the bulk mipmap work (rebuilds, snapshots). They're started
+// the first time a job is submitted and then kept around, so a rebuild
+// doesn't pay for spawning a thread per core every time.
+namespace adrian::detail {
+
+struct worker_pool {
+	worker_pool() = default;
+	worker_pool(const worker_pool&)            = delete;
+	worker_pool& operator=(const worker_pool&) = delete;
+	~worker_pool() { stop(); }
+	auto submit(std::function<void()> job) -> void {
+		{
+			auto lock = std::lock_guard{mut_};
+			if (threads_.empty()) {
+				start();
+			}
+			jobs_.push_back(std::move(job));
+		}
+		cv_.notify_one();
+	}
+	// Jobs which were already submitted are finished first.
+	auto stop() -> void {
+		auto threads = std::vector<std::jthread>{};
+		{
+			auto lock = std::lock_guard{mut_};
+			stopping_ = true;
+			threads   = std::move(threads_);
+		}
+		cv_.notify_all();
+		threads.clear();
+		auto lock = std::lock_guard{mut_};
+		stopping_ = false;
+	}
+private:
+	auto start() -> void {
+		const auto count = std::max(std::thread::hardware_concurrency(), 1U);
+		for (unsigned i = 0; i < count; i++) {
+			threads_.emplace_back([this] { run(); });
+		}
+	}
+	auto run() -> void {
+		for (;;) {
+			auto job = std::function<void()>{};
+			{
+				auto lock = std::unique_lock{mut_};
+				cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+				if (jobs_.empty()) {
+					return;
+				}
+				job = std::move(jobs_.front());
+				jobs_.pop_front();
+			}
+			job();
+		}
+	}
+	std::mutex mut_;
+	std::condition_variable cv_;
+	std::deque<std::function<void()>> jobs_;
+	std::vector<std::jthread> threads_;
+	bool stopping_ = false;
+};
+
+[[nodiscard]] inline
+auto get_worker_count(size_t job_count) -> size_t {
+	return std::clamp(size_t{std::thread::hardware_concurrency()}, size_t{1}, std::max(job_count, size_t{1}));
+}
+
+// Call fn(worker, job) for every job in [0, job_count) across the pool.
+// The calling thread is worker 0 and keeps taking jobs until there are
+// none left, so this finishes even if every pool thread is busy. Helpers
+// which only get to run after that find nothing to do and never touch fn.
+inline
+auto parallel_for(worker_pool* pool, size_t job_count, auto fn) -> void {
+	struct state {
+		std::atomic<size_t> next = 0;
+		size_t done = 0;
+		std::mutex mut;
+		std::condition_variable cv;
+	};
+	if (job_count == 0) {
+		return;
+	}
+	auto s = std::make_shared<state>();
+	auto work = [s, job_count, &fn](size_t worker) {
+		for (auto job = s->next++; job < job_count; job = s->next++) {
+			fn(worker, job);
+			auto lock = std::lock_guard{s->mut};
+			if (++s->done == job_count) {
+				s->cv.notify_all();
+			}
+		}
+	};
+	for (size_t worker = 1; worker < get_worker_count(job_count); worker++) {
+		pool->submit([work, worker] { work(worker); });
+	}
+	work(0);
+	auto lock = std::unique_lock{s->mut};
+	s->cv.wait(lock, [&s, job_count] { return s->done == job_count; });
+}
+
+} // adrian::detail
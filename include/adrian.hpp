@@ -2,40 +2,107 @@
 
 #include "adrian-allocation-thread.hpp"
 #include "adrian-chain.hpp"
+#include "adrian-chain-edit.hpp"
+#include "adrian-chain-snapshot.hpp"
+#include "adrian-mipmap-cache.hpp"
 #include "adrian-catch-buffer.hpp"
+#include <algorithm>
 
 namespace adrian::detail {
 
 inline
-auto update_mipmaps(ez::ui_t thread, const model& m, concepts::push_ui_event auto push_ui_event) -> void {
-	detail::service_.beach.ui.with_ball<detail::service::MIPMAP_AUDIO_CATCHER>([thread, m, push_ui_event]{
-		for (const auto& c : m.chains) {
-			if (update_mipmap(thread, m, c)) {
-				push_ui_event(ui::events::chain::mipmap_changed{c.id, c.client_data});
-			}
+auto receive_mipmap_records(ez::ui_t thread, service::model* service) -> void {
+	mipmap::record record;
+	while (service->critical.mipmap_records.v.try_dequeue(record)) {
+		service->ui.mipmap_records.push_back(record);
+	}
+}
+
+inline
+auto encode_mipmap_records(ez::ui_t thread, service::model* service, const model& m) -> void {
+	for (const auto& record : service->ui.mipmap_records) {
+		const auto mipmap = get_mipmap(m, record.channel_count, record.buffer);
+		if (!mipmap) {
+			// The chain doesn't generate mipmaps (anymore.)
+			continue;
+		}
+		if (encode_mipmap(thread, record, mipmap.get(), &service->ui.mipmap_scratch)) {
+			service->ui.mipmap_touched.push_back({record.chain, record.slot, mipmap});
+		}
+	}
+	service->ui.mipmap_records.clear();
+}
+
+inline
+auto update_mipmaps(ez::ui_t thread, concepts::push_ui_event auto push_ui_event) -> void {
+	const auto graveyard_marks = mark_graveyards(thread, detail::service_.model.read(thread));
+	// Storage which writers have swapped out is retired after the marks
+	// are taken, so it outlives any mipmap record which points at it.
+	if (storage_needs_settling(detail::service_.model.read(thread))) {
+		detail::service_.model.update_publish(thread, [thread](model m) { return settle_storage(thread, std::move(m)); });
+	}
+	receive_mipmap_records(thread, &detail::service_);
+	// The model is read after receiving the records so that it is at
+	// least as recent as the one which the audio thread was working
+	// with when it published them.
+	const auto m = detail::service_.model.read(thread);
+	encode_mipmap_records(thread, &detail::service_, m);
+	empty_graveyards(thread, graveyard_marks);
+	auto& touched = detail::service_.ui.mipmap_touched;
+	for (const auto& t : touched) {
+		update_mipmap(thread, t.mipmap.get());
+		overview::update(thread, &detail::service_, m, t);
+	}
+	auto by_chain = [](const mipmap::touched_buffer& a, const mipmap::touched_buffer& b) { return a.chain.value < b.chain.value; };
+	std::ranges::sort(touched, by_chain);
+	for (auto i = touched.begin(); i != touched.end(); i = std::upper_bound(i, touched.end(), *i, by_chain)) {
+		if (const auto c = m.chains.find(i->chain)) {
+			push_ui_event(ui::events::chain::mipmap_changed{c->id, c->client_data});
+		}
+	}
+	touched.clear();
+	overview::prune(thread, &detail::service_, m);
+}
+
+inline
+auto report_paged_out_writes(ez::ui_t, const model& m, concepts::push_ui_event auto push_ui_event) -> void {
+	for (const auto& c : m.chains) {
+		if (!c.disk_stats) {
+			continue;
 		}
-	});
+		if (const auto count = c.disk_stats->dropped_writes.load(std::memory_order_relaxed); count != c.disk_stats->reported_dropped_writes) {
+			push_ui_event(ui::events::chain::warn_paged_out_write{c.id, count, c.client_data});
+			c.disk_stats->reported_dropped_writes = count;
+		}
+	}
 }
 
 inline
 auto update(ez::ui_t thread, const model& was, const model& now, concepts::push_ui_event auto push_ui_event) -> void {
 	diff(thread, was.chains, now.chains, push_ui_event);
-	if (was.loading_chains != now.loading_chains) {
-		// A loading chain may have been created so awaken the allocation thread.
+	if (was.loading_chains != now.loading_chains || reserves_need_maintenance(now)) {
+		// A loading chain may have been created, or the audio thread may
+		// have used up some of the copy-on-write reserve, so awaken the
+		// allocation thread.
 		detail::service_.critical.cv_allocation_thread_wait.notify_one();
 	}
-	detail::update_mipmaps(thread, now, push_ui_event);
+	if (const auto underruns = get_cow_underruns(now); underruns != detail::service_.ui.cow_underruns) {
+		push_ui_event(ui::events::warn_cow_reserve_underrun{underruns});
+		detail::service_.ui.cow_underruns = underruns;
+	}
+	report_paged_out_writes(thread, now, push_ui_event);
+	detail::update_mipmaps(thread, push_ui_event);
 }
 
 // audio thread receives messages from ui ------------------------------------------
 inline
 auto receive_(ez::audio_t thread, const model& m, msg::to_audio::catch_buffer::playback_start msg) -> void {
-	playback_start(thread, msg.id);
+	playback_start(thread, msg.id, msg.voice);
 }
 
 inline
 auto receive_(ez::audio_t thread, const model& m, msg::to_audio::catch_buffer::playback_stop msg) -> void {
-	playback_stop(thread, m, msg.id);
+	playback_stop(thread, m, msg.id, msg.voice);
 }
 
 inline
@@ -52,26 +119,30 @@ auto receive_msgs_from_ui(ez::audio_t thread, service::model* service, const mod
 }
 
 // ui thread receives messages from audio ------------------------------------------
+// The catch buffer may have been erased since the message was sent.
 inline
 auto receive_(ez::ui_t thread, const model& m, msg::to_ui::catch_buffer::playback_finished msg, concepts::push_ui_event auto push_ui_event) -> void {
 	const auto cbuf_id = msg.id;
-	const auto& cbuf   = m.catch_buffers.at(cbuf_id);
-	cbuf.service->ui.playback_active = false;
-	push_ui_event(ui::events::catch_buffer::playback_finished{cbuf_id, cbuf.client_data});
+	const auto cbuf    = m.catch_buffers.find(cbuf_id);
+	if (!cbuf) { return; }
+	cbuf->service->ui.playback_active[msg.voice] = false;
+	push_ui_event(ui::events::catch_buffer::playback_finished{cbuf_id, msg.voice, cbuf->client_data});
 }
 
 inline
 auto receive_(ez::ui_t thread, const model& m, msg::to_ui::catch_buffer::recording_finished msg, concepts::push_ui_event auto push_ui_event) -> void {
 	const auto cbuf_id = msg.id;
-	const auto& cbuf   = m.catch_buffers.at(cbuf_id);
-	push_ui_event(ui::events::catch_buffer::recording_finished{cbuf_id, msg.region, cbuf.client_data});
+	const auto cbuf    = m.catch_buffers.find(cbuf_id);
+	if (!cbuf) { return; }
+	push_ui_event(ui::events::catch_buffer::recording_finished{cbuf_id, msg.region, cbuf->client_data});
 }
 
 inline
 auto receive_(ez::ui_t thread, const model& m, msg::to_ui::catch_buffer::recording_started msg, concepts::push_ui_event auto push_ui_event) -> void {
 	const auto cbuf_id = msg.id;
-	const auto& cbuf   = m.catch_buffers.at(cbuf_id);
-	push_ui_event(ui::events::catch_buffer::recording_started{cbuf_id, msg.beg, cbuf.client_data});
+	const auto cbuf    = m.catch_buffers.find(cbuf_id);
+	if (!cbuf) { return; }
+	push_ui_event(ui::events::catch_buffer::recording_started{cbuf_id, msg.beg, cbuf->client_data});
 }
 
 inline
@@ -92,15 +163,62 @@ auto receive_msgs_from_audio(ez::ui_t thread, service::model* service, const mod
 	}
 }
 
+// Publish every dirty sub-buffer of every mipmapped chain with this channel
+// count. Only done when a dirty list overflows. Returns false if the record
+// queue filled up.
+[[nodiscard]] inline
+auto rescan_mipmaps(ez::audio_t thread, const model& m, ads::channel_count channel_count, const buffer::table& table) -> bool {
+	for (const auto& c : m.chains) {
+		if (c.channel_count != channel_count || !c.buffers || !should_generate_mipmaps(c)) {
+			continue;
+		}
+		for (size_t slot = 0; slot < c.buffers->size(); slot++) {
+			const auto idx = (*c.buffers)[slot];
+			if (!idx) {
+				continue;
+			}
+			const auto dirty = mipmap::dirty_buffer{c.id, idx, slot};
+			if (!publish_mipmap_record(thread, &detail::service_.critical.mipmap_records, channel_count, dirty, table.service[idx.value].get())) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Only the sub-buffers in the dirty lists are looked at. Anything already
+// in the list when we start is processed, anything added by the writers
+// from now on waits until the next block.
 inline
 auto update_mipmaps(ez::audio_t thread, const model& m) -> void {
-	detail::service_.beach.audio.with_ball<detail::service::MIPMAP_UI_CATCHER>([thread, m]{
-		for (const auto& [_, table] : m.buffers) {
-			for (const auto& service : table.service) {
-				detail::update_mipmap(thread, service.get());
+	for (const auto& [channel_count, table] : m.buffers) {
+		auto& list = *table.mipmap_dirty;
+		const auto cc = ads::channel_count{channel_count};
+		if (list.overflowed.exchange(false)) {
+			// The rescan covers everything in the list too.
+			mipmap::dirty_buffer dirty;
+			while (list.v.try_dequeue(dirty)) {}
+			if (!rescan_mipmaps(thread, m, cc, table)) {
+				list.overflowed = true;
 			}
+			continue;
 		}
-	});
+		auto count = list.v.size_approx();
+		mipmap::dirty_buffer dirty;
+		while (count-- > 0 && list.v.try_dequeue(dirty)) {
+			if (static_cast<size_t>(dirty.buffer.value) >= table.service.size()) {
+				// The buffer was created in a more recent model.
+				list.overflowed = true;
+				continue;
+			}
+			if (!publish_mipmap_record(thread, &detail::service_.critical.mipmap_records, cc, dirty, table.service[dirty.buffer.value].get())) {
+				// The record queue is full. Whatever is left in the dirty
+				// list will be picked up by a rescan instead.
+				list.overflowed = true;
+				break;
+			}
+		}
+	}
 }
 
 } // adrian::detail
@@ -120,6 +238,8 @@ auto shutdown(ez::ui_t thread) -> void {
 		detail::service_.critical.cv_allocation_thread_wait.notify_one();
 		detail::allocation_thread_.join();
 	}
+	// Any mipmap rebuilds which were started are finished first.
+	detail::service_.workers.stop();
 }
 
 inline
@@ -135,7 +255,9 @@ auto update(ez::ui_t thread, concepts::push_ui_event auto push_ui_event) -> void
 	auto this_frame = detail::service_.model.read(thread);
 	detail::update(thread, prev_frame, this_frame, push_ui_event);
 	detail::receive_msgs_from_audio(thread, &detail::service_, this_frame, push_ui_event);
+	detail::hand_over_gates(thread, this_frame);
 	detail::service_.ui.prev_frame = this_frame;
+	detail::free_retired_catch_buffers(thread, &detail::service_);
 }
 
 } // adrian
\ No newline at end of file
@@ -2,6 +2,14 @@
 #define ADRIAN_OVERRIDE_BUFFER_SIZE 64
 #include "adrian.hpp"
 #include "doctest.h"
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
 TEST_CASE("basic catch buffer wraparound sanity") {
@@ -122,3 +130,1560 @@ TEST_CASE("catch buffer overflowing playback region") {
 	adrian::update(ez::audio);
 	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{}, 0.0f, 1.0f, true);
 }
+
+TEST_CASE("catch buffer playback from an unaligned start") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf   = adrian::catch_buffer{{1}, {256}, options, {}};
+	auto input  = std::vector<float>(256);
+	auto left   = std::vector<float>(256);
+	auto right  = std::vector<float>(256);
+	const float* in[] = {input.data()};
+	float* out[]      = {left.data(), right.data()};
+	for (int i = 0; i < 256; i++) {
+		input[i] = float(i + 1);
+	}
+	adrian::process(ez::audio, cbuf.id(), in, out, {256}, 0.0f, 1.0f);
+	// The first chunk only goes up to the next vector boundary, and the
+	// region spans several vectors after that.
+	cbuf.playback_start(ez::ui, {100}, {150});
+	adrian::update(ez::audio);
+	adrian::process(ez::audio, cbuf.id(), in, out, {200}, 0.0f, 1.0f, true);
+	for (int i = 0; i < 200; i++) {
+		REQUIRE (left[i] == (i < 150 ? float(i + 101) : 0.0f));
+	}
+}
+
+TEST_CASE("catch buffer processing with arbitrary block sizes") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf   = adrian::catch_buffer{{1}, {256}, options, {}};
+	auto input  = std::vector<float>(100);
+	auto left   = std::vector<float>(100);
+	auto right  = std::vector<float>(100);
+	const float* in[] = {input.data()};
+	float* out[]      = {left.data(), right.data()};
+	for (int block = 0; block < 3; block++) {
+		for (int i = 0; i < 100; i++) {
+			input[i] = float((block * 100) + i + 1);
+		}
+		adrian::process(ez::audio, cbuf.id(), in, out, {100}, 0.0f, 1.0f);
+	}
+	// The last 44 frames don't make up a whole vector so they're not recorded yet.
+	auto recorded = ads::data<float, 1, 256>{};
+	REQUIRE (cbuf.copy(ez::nort, {0}, &recorded, {0}, {256}) == 256);
+	for (int i = 0; i < 256; i++) {
+		REQUIRE (recorded.at(ads::frame_idx{i}) == float(i + 1));
+	}
+	cbuf.playback_start(ez::ui, {0}, {150});
+	adrian::update(ez::audio);
+	adrian::process(ez::audio, cbuf.id(), in, out, {100}, 0.0f, 1.0f, true);
+	for (int i = 0; i < 100; i++) {
+		REQUIRE (left[i]  == float(i + 1));
+		REQUIRE (right[i] == float(i + 1));
+	}
+	adrian::process(ez::audio, cbuf.id(), in, out, {100}, 0.0f, 1.0f, true);
+	for (int i = 0; i < 100; i++) {
+		REQUIRE (left[i] == (i < 50 ? float(i + 101) : 0.0f));
+	}
+}
+
+TEST_CASE("catch buffer pre-roll") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = false;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}};
+	auto started = std::optional<ads::frame_idx>{};
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (const auto event = std::get_if<adrian::ui::events::catch_buffer::recording_started>(&e); event && event->id == cbuf.id()) {
+			started = event->beg;
+		}
+	};
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE_THROWS (cbuf.set_pre_roll(ez::ui, {256}));
+	cbuf.set_pre_roll(ez::ui, {64});
+	// The ring is written to while the gate is closed.
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{0.25f}, 0.5f, 1.0f);
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{0.25f}, 0.5f, 1.0f);
+	REQUIRE (cbuf.get_write_marker(ez::ui) == ads::frame_idx{128});
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (!started);
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{1.0f}, 0.5f, 1.0f);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (started == ads::frame_idx{64});
+	auto recorded = ads::data<float, 1, 256>{};
+	REQUIRE (cbuf.copy(ez::nort, {0}, &recorded, {0}, {256}) == 256);
+	REQUIRE (recorded.at(ads::frame_idx{64})  == 0.25f);
+	REQUIRE (recorded.at(ads::frame_idx{127}) == 0.25f);
+	REQUIRE (recorded.at(ads::frame_idx{128}) == 1.0f);
+}
+
+TEST_CASE("catch buffer pre-roll is clamped to the valid history") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = false;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}};
+	auto started = std::optional<ads::frame_idx>{};
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (const auto event = std::get_if<adrian::ui::events::catch_buffer::recording_started>(&e); event && event->id == cbuf.id()) {
+			started = event->beg;
+		}
+	};
+	adrian::update(ez::ui, push_ui_event);
+	auto gate = adrian::gate_options{};
+	gate.detector = adrian::gate_detector::rms;
+	gate.release  = 0.0f;
+	cbuf.set_gate_options(ez::ui, gate);
+	cbuf.set_pre_roll(ez::ui, {192});
+	// Only one vector has been written since the pre-roll was set.
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{0.25f}, 0.5f, 1.0f);
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{1.0f}, 0.5f, 1.0f);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (started == ads::frame_idx{0});
+	// The first recording ended at frame 128, so the next one's pre-roll
+	// doesn't reach back any further than that.
+	started.reset();
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{0.0f}, 0.5f, 1.0f);
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{1.0f}, 0.5f, 1.0f);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (started == ads::frame_idx{128});
+}
+
+TEST_CASE("catch buffer playback voices") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}};
+	for (int i = 0; i < 4; i++) {
+		std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{float(i + 1)}, 0.0f, 1.0f);
+	}
+	auto finished = std::vector<size_t>{};
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (const auto event = std::get_if<adrian::ui::events::catch_buffer::playback_finished>(&e); event && event->id == cbuf.id()) {
+			finished.push_back(event->voice);
+		}
+	};
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE_THROWS (cbuf.playback_start(ez::ui, {0}, {64}, adrian::detail::CATCH_BUFFER_VOICE_COUNT));
+	// The voices overlap and are mixed together.
+	cbuf.playback_start(ez::ui, {0}, {128}, 0);
+	cbuf.playback_start(ez::ui, {64}, {64}, 1);
+	adrian::update(ez::audio);
+	auto out = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{}, 0.0f, 1.0f, true);
+	REQUIRE (out.constRow(0)[0] == 3.0f);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (finished == std::vector<size_t>{1});
+	REQUIRE (cbuf.is_playback_active(ez::ui, 0));
+	REQUIRE (!cbuf.is_playback_active(ez::ui, 1));
+	REQUIRE (cbuf.get_playback_marker(ez::ui, 0) == ads::frame_idx{64});
+	out = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{}, 0.0f, 1.0f, true);
+	REQUIRE (out.constRow(0)[0] == 2.0f);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (finished == std::vector<size_t>{1, 0});
+	// Whole blocks stop each voice exactly at the end of its region.
+	cbuf.playback_start(ez::ui, {0}, {100}, 0);
+	cbuf.playback_start(ez::ui, {50}, {20}, 1);
+	adrian::update(ez::audio);
+	auto input  = std::vector<float>(100);
+	auto output = std::vector<float>(100);
+	const float* in[] = {input.data()};
+	float* outs[]     = {output.data()};
+	adrian::process(ez::audio, cbuf.id(), in, outs, {100}, 0.0f, 1.0f, true);
+	for (int i = 0; i < 100; i++) {
+		REQUIRE (output[i] == float((i / 64) + 1) + (i < 20 ? float(((50 + i) / 64) + 1) : 0.0f));
+	}
+}
+
+TEST_CASE("catch buffer looping and varispeed playback") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}};
+	// A ramp, so that linear and cubic interpolation are exact.
+	auto input = ml::DSPVector{};
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 64; j++) {
+			input[j] = float((i * 64) + j);
+		}
+		std::ignore = adrian::process(ez::audio, cbuf.id(), input, 0.0f, 1.0f);
+	}
+	auto finished = 0;
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (std::holds_alternative<adrian::ui::events::catch_buffer::playback_finished>(e)) {
+			finished++;
+		}
+	};
+	adrian::update(ez::ui, push_ui_event);
+	auto output = std::vector<float>(200);
+	const float* in[] = {output.data()};
+	float* out[]      = {output.data()};
+	auto play = [&](ads::frame_idx start, ads::frame_count frs, adrian::playback_options playback_options) {
+		cbuf.playback_start(ez::ui, start, frs, 0, playback_options);
+		adrian::update(ez::audio);
+		adrian::process(ez::audio, cbuf.id(), in, out, {200}, 0.0f, 1.0f, true);
+	};
+	REQUIRE_THROWS (cbuf.playback_start(ez::ui, {0}, {64}, 0, {.rate = 0.0}));
+	REQUIRE_THROWS (cbuf.playback_start(ez::ui, {0}, {0}, 0, {.loop = true}));
+	SUBCASE("looping") {
+		for (const auto interpolation : {adrian::playback_interpolation::linear, adrian::playback_interpolation::cubic, adrian::playback_interpolation::sinc}) {
+			play({100}, {70}, {.loop = true, .interpolation = interpolation});
+			for (int i = 0; i < 200; i++) {
+				REQUIRE (output[i] == doctest::Approx(float(100 + (i % 70))).epsilon(1e-4));
+			}
+			REQUIRE (cbuf.is_playback_active(ez::ui));
+		}
+	}
+	SUBCASE("half speed") {
+		for (const auto interpolation : {adrian::playback_interpolation::linear, adrian::playback_interpolation::cubic}) {
+			play({10}, {200}, {.rate = 0.5, .interpolation = interpolation});
+			for (int i = 0; i < 200; i++) {
+				REQUIRE (output[i] == doctest::Approx(10.0f + (float(i) * 0.5f)));
+			}
+			REQUIRE (cbuf.get_playback_marker(ez::ui) == ads::frame_idx{110});
+		}
+	}
+	SUBCASE("double speed stops at the end of the region") {
+		play({0}, {150}, {.rate = 2.0, .interpolation = adrian::playback_interpolation::linear});
+		for (int i = 0; i < 200; i++) {
+			REQUIRE (output[i] == (i < 75 ? float(i * 2) : 0.0f));
+		}
+		adrian::update(ez::ui, push_ui_event);
+		REQUIRE (finished == 1);
+	}
+}
+
+TEST_CASE("interpolation kernels at fractional positions") {
+	namespace interpolation = adrian::detail::interpolation;
+	// A slow sine, which all of the kernels should follow closely.
+	auto frames = std::array<float, 32>{};
+	for (size_t i = 0; i < frames.size(); i++) {
+		frames[i] = std::sin(float(i) * 0.2f);
+	}
+	const auto x = frames.data() + 16;
+	for (const auto t : {0.0f, 0.1f, 0.25f, 0.5f, 0.73f, std::nextafter(1.0f, 0.0f), 1.0f}) {
+		const auto expected = std::sin((16.0f + t) * 0.2f);
+		REQUIRE (interpolation::linear(x, t) == doctest::Approx(expected).epsilon(0.01));
+		REQUIRE (interpolation::cubic(x, t) == doctest::Approx(expected).epsilon(0.001));
+		REQUIRE (interpolation::sinc(x, t) == doctest::Approx(expected).epsilon(0.001));
+	}
+}
+
+TEST_CASE("single ring catch buffer") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}, adrian::catch_buffer_layout::single_ring};
+	REQUIRE (cbuf.get_actual_frame_count(ez::ui) == ads::frame_count{256});
+	REQUIRE (cbuf.get_requested_frame_count(ez::ui) == ads::frame_count{256});
+	// The ring is 256 frames plus a 64 frame guard zone, so the sixth
+	// vector wraps around to the start.
+	for (int i = 0; i < 6; i++) {
+		std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{float(i + 1)}, 0.0f, 1.0f);
+	}
+	REQUIRE (cbuf.get_write_marker(ez::ui) == ads::frame_idx{64});
+	// The guard zone is where the writer goes next, so copying it is torn.
+	auto recorded = ads::data<float, 1, 320>{};
+	REQUIRE_THROWS (std::ignore = cbuf.copy(ez::nort, {0}, &recorded, {0}, {320}));
+	REQUIRE_THROWS (std::ignore = cbuf.copy(ez::nort, {96}, &recorded, {0}, {32}));
+	REQUIRE (cbuf.copy(ez::nort, {128}, &recorded, {0}, {256}) == 256);
+	for (int i = 0; i < 256; i++) {
+		REQUIRE (recorded.at(ads::frame_idx{i}) == float(((i + 128) % 320) / 64 + 1 + (i >= 192 ? 5 : 0)));
+	}
+	REQUIRE_THROWS (std::ignore = cbuf.linearize(ez::nort, {0}, {320}, options, {}));
+	const auto chain_id = cbuf.linearize(ez::nort, {192}, {192}, options, {});
+	adrian::detail::maintain_reserves(ez::nort, adrian::detail::service_.model.read(ez::nort));
+	auto read_fn = [&](const float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+		for (uint64_t i = 0; i < frame_count.value; i++) {
+			REQUIRE (buffer[i] == float(((start.value + static_cast<int64_t>(i)) / 64) + 4));
+		}
+		return frame_count;
+	};
+	std::ignore = adrian::detail::scary_read<64>(adrian::detail::service_.model.read(ez::nort), chain_id, {0}, {0}, {192}, read_fn);
+	adrian::erase(ez::nort, chain_id);
+	// Playback wraps around the end of the ring.
+	cbuf.playback_start(ez::ui, {288}, {64});
+	adrian::update(ez::audio);
+	const auto out = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{}, 0.0f, 1.0f, true);
+	for (int i = 0; i < 64; i++) {
+		REQUIRE (out.constRow(0)[i] == (i < 32 ? 5.0f : 6.0f));
+	}
+}
+
+TEST_CASE("single ring catch buffer guard") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	// The guard is rounded up to whole vectors.
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}, adrian::catch_buffer_layout::single_ring, {100}};
+	REQUIRE (cbuf.get_requested_frame_count(ez::ui) == ads::frame_count{256});
+	REQUIRE (cbuf.get_actual_frame_count(ez::ui) == ads::frame_count{256});
+	for (int i = 0; i < 5; i++) {
+		std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{float(i + 1)}, 0.0f, 1.0f);
+	}
+	auto recorded = ads::data<float, 1, 256>{};
+	// The ring is 384 frames and the writer is about to write [320, 384).
+	REQUIRE_THROWS (std::ignore = cbuf.copy(ez::nort, {320}, &recorded, {0}, {64}));
+	REQUIRE (cbuf.copy(ez::nort, {64}, &recorded, {0}, {256}) == 256);
+	REQUIRE (recorded.at(ads::frame_idx{0}) == 2.0f);
+	REQUIRE (recorded.at(ads::frame_idx{255}) == 5.0f);
+	// Even without a guard the writer may be part way through the next vector.
+	auto unguarded = adrian::catch_buffer{{1}, {256}, options, {}, adrian::catch_buffer_layout::single_ring, {0}};
+	REQUIRE (unguarded.get_actual_frame_count(ez::ui) == ads::frame_count{256});
+	// The writer gets to the frames part way through a read.
+	auto lapped = false;
+	auto lap = [&](const float*, ads::frame_idx, ads::frame_count frame_count) {
+		if (!lapped) {
+			lapped = true;
+			std::ignore = adrian::process(ez::audio, unguarded.id(), ml::DSPVector{1.0f}, 0.0f, 1.0f);
+		}
+		return frame_count;
+	};
+	REQUIRE (unguarded.read(ez::nort, ads::channel_idx{0}, {128}, {64}, lap) == ads::frame_count{64});
+	lapped = false;
+	REQUIRE_THROWS (std::ignore = unguarded.read(ez::nort, ads::channel_idx{0}, {128}, {64}, lap));
+	REQUIRE (unguarded.read(ez::nort, ads::channel_idx{0}, {192}, {64}, lap) == ads::frame_count{64});
+}
+
+TEST_CASE("validated catch buffer reads") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}, adrian::catch_buffer_layout::single_ring};
+	auto record = [&](int vectors) {
+		for (int i = 0; i < vectors; i++) {
+			const auto value = float(cbuf.get_write_generation(ez::nort) / 64) + 1.0f;
+			std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{value}, 0.0f, 1.0f);
+		}
+	};
+	record(2);
+	const auto since = cbuf.get_write_generation(ez::nort);
+	REQUIRE (since == 128);
+	auto frames = std::vector<float>(128);
+	auto copy = [&](const float* buffer, ads::channel_idx, ads::frame_idx start, ads::frame_count frame_count) {
+		std::copy(buffer, buffer + frame_count.value, frames.begin() + start.value);
+		return frame_count;
+	};
+	REQUIRE (cbuf.read_validated(ez::nort, {0}, {128}, since, 1, copy) == adrian::catch_buffer_read_status::ok);
+	for (int i = 0; i < 128; i++) {
+		REQUIRE (frames[i] == float((i / 64) + 1));
+	}
+	// The ring is 320 frames, and the frames which the writer may be in the
+	// middle of writing over count as torn.
+	record(2);
+	REQUIRE (cbuf.read_validated(ez::nort, {0}, {128}, since, 1, copy) == adrian::catch_buffer_read_status::ok);
+	record(2);
+	REQUIRE (cbuf.read_validated(ez::nort, {64}, {64}, since, 1, copy) == adrian::catch_buffer_read_status::torn);
+	REQUIRE (cbuf.read_validated(ez::nort, {0}, {64}, since, 1, copy) == adrian::catch_buffer_read_status::overwritten);
+	REQUIRE (frames[0] == 6.0f);
+	// The writer laps the reader part way through.
+	auto lapped = false;
+	auto lap = [&](const float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+		if (!lapped) {
+			lapped = true;
+			record(5);
+		}
+		return copy(buffer, ch, start, frame_count);
+	};
+	REQUIRE (cbuf.read_validated(ez::nort, {0}, {64}, cbuf.get_write_generation(ez::nort), 1, lap) == adrian::catch_buffer_read_status::torn);
+	lapped = false;
+	const auto status = cbuf.read_validated(ez::nort, {0}, {64}, cbuf.get_write_generation(ez::nort) + 320, 2, lap);
+	REQUIRE (status == adrian::catch_buffer_read_status::ok);
+	REQUIRE (frames[0] == 16.0f);
+	REQUIRE_THROWS (std::ignore = cbuf.read_validated(ez::nort, {0}, {257}, since, 1, copy));
+}
+
+TEST_CASE("validated reads of a two partition catch buffer") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}};
+	auto record = [&](int vectors) {
+		for (int i = 0; i < vectors; i++) {
+			const auto value = float(cbuf.get_write_generation(ez::nort) / 64) + 1.0f;
+			std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{value}, 0.0f, 1.0f);
+		}
+	};
+	auto frames = std::vector<float>(256);
+	auto copy = [&](const float* buffer, ads::channel_idx, ads::frame_idx start, ads::frame_count frame_count) {
+		std::copy(buffer, buffer + frame_count.value, frames.begin() + start.value);
+		return frame_count;
+	};
+	record(2);
+	const auto since = cbuf.get_write_generation(ez::nort);
+	REQUIRE (cbuf.read_validated(ez::nort, {0}, {128}, since, 1, copy) == adrian::catch_buffer_read_status::ok);
+	REQUIRE (frames[0] == 1.0f);
+	REQUIRE (frames[64] == 2.0f);
+	// The writer has moved on to the second partition. The first two
+	// vectors of the window were just written there, the rest of it is
+	// still in the first partition.
+	record(4);
+	REQUIRE (cbuf.read_validated(ez::nort, {0}, {128}, since, 1, copy) == adrian::catch_buffer_read_status::overwritten);
+	REQUIRE (cbuf.read_validated(ez::nort, {0}, {256}, cbuf.get_write_generation(ez::nort), 1, copy) == adrian::catch_buffer_read_status::ok);
+	for (int i = 0; i < 256; i++) {
+		REQUIRE (frames[i] == float((i / 64) + (i < 128 ? 5 : 1)));
+	}
+	// Frames are only written over when the writer comes back around to
+	// the same partition, a whole chain later.
+	auto lapped = false;
+	auto lap = [&](const float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+		if (!lapped) {
+			lapped = true;
+			record(5);
+		}
+		return copy(buffer, ch, start, frame_count);
+	};
+	REQUIRE (cbuf.read_validated(ez::nort, {0}, {64}, cbuf.get_write_generation(ez::nort), 1, lap) == adrian::catch_buffer_read_status::ok);
+	lapped = false;
+	REQUIRE (cbuf.read_validated(ez::nort, {192}, {64}, cbuf.get_write_generation(ez::nort), 1, lap) == adrian::catch_buffer_read_status::torn);
+}
+
+TEST_CASE("recordings start at the first frame over the threshold") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = false;
+	auto cbuf = adrian::catch_buffer{{2}, {256}, options, {}};
+	auto started = std::optional<ads::frame_idx>{};
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (const auto event = std::get_if<adrian::ui::events::catch_buffer::recording_started>(&e); event && event->id == cbuf.id()) {
+			started = event->beg;
+		}
+	};
+	adrian::update(ez::ui, push_ui_event);
+	auto input = ml::DSPVectorArray<2>{};
+	input.row(0).getBuffer()[41] = 0.9f;
+	input.row(1).getBuffer()[37] = -0.9f;
+	std::ignore = adrian::process(ez::audio, cbuf.id(), input, 0.5f, 1.0f);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (started == ads::frame_idx{37});
+}
+
+TEST_CASE("vectorized onset search matches the scalar search") {
+	auto frames = std::vector<float>(1000);
+	for (size_t i = 0; i < frames.size(); i++) {
+		frames[i] = std::sin(float(i) * 0.37f) * (float(i) / 1000.0f);
+	}
+	for (const auto threshold : {0.0f, 0.1f, 0.5f, 0.99f, 2.0f}) {
+		for (const auto count : {size_t{0}, size_t{3}, size_t{64}, size_t{1000}}) {
+			REQUIRE (adrian::peak_gate::onset::find(frames.data(), count, threshold) == adrian::peak_gate::onset::find_scalar(frames.data(), count, threshold));
+		}
+	}
+}
+
+TEST_CASE("gate hysteresis and look-ahead") {
+	auto options = adrian::gate_options{};
+	options.detector    = adrian::gate_detector::rms;
+	options.release     = 0.0f;
+	options.close_ratio = 0.5f;
+	auto hysteresis = adrian::gate::make({1}, options);
+	auto decide = [](adrian::gate::model* g, float level) {
+		return adrian::gate::process(g, ml::DSPVector{level}, 0.5f);
+	};
+	REQUIRE (decide(hysteresis.get(), 0.6f));
+	REQUIRE (decide(hysteresis.get(), 0.4f));
+	REQUIRE (!decide(hysteresis.get(), 0.2f));
+	REQUIRE (!decide(hysteresis.get(), 0.4f));
+	options.close_ratio = 1.0f;
+	options.look_ahead  = {128};
+	auto look_ahead = adrian::gate::make({1}, options);
+	const auto levels   = std::vector<float>{0.0f, 1.0f, 0.0f, 0.0f, 0.0f};
+	const auto expected = std::vector<bool>{false, true, true, true, false};
+	for (size_t i = 0; i < levels.size(); i++) {
+		const auto in = ml::DSPVector{levels[i]};
+		REQUIRE (decide(look_ahead.get(), levels[i]) == expected[i]);
+		const auto delayed = adrian::gate::delay(look_ahead.get(), in.getConstBuffer());
+		REQUIRE (*delayed == (i >= 2 ? levels[i - 2] : 0.0f));
+	}
+}
+
+TEST_CASE("catch buffer gate look-ahead") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = false;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}};
+	auto region = std::optional<ads::region>{};
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (const auto event = std::get_if<adrian::ui::events::catch_buffer::recording_finished>(&e); event && event->id == cbuf.id()) {
+			region = event->region;
+		}
+	};
+	adrian::update(ez::ui, push_ui_event);
+	auto gate = adrian::gate_options{};
+	gate.detector   = adrian::gate_detector::rms;
+	gate.release    = 0.0f;
+	gate.look_ahead = {64};
+	cbuf.set_gate_options(ez::ui, gate);
+	auto input = ml::DSPVector{};
+	std::fill(input.getBuffer() + 10, input.getBuffer() + 64, 1.0f);
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{}, 0.5f, 1.0f);
+	std::ignore = adrian::process(ez::audio, cbuf.id(), input, 0.5f, 1.0f);
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{}, 0.5f, 1.0f);
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{}, 0.5f, 1.0f);
+	adrian::update(ez::ui, push_ui_event);
+	// The recording starts a vector ahead of the onset, which was delayed by a vector.
+	REQUIRE (region);
+	REQUIRE (region->beg == ads::frame_idx{10});
+	REQUIRE (region->end == ads::frame_idx{128});
+	auto recorded = ads::data<float, 1, 256>{};
+	REQUIRE (cbuf.copy(ez::nort, {0}, &recorded, {0}, {256}) == 256);
+	REQUIRE (recorded.at(ads::frame_idx{73}) == 0.0f);
+	REQUIRE (recorded.at(ads::frame_idx{74}) == 1.0f);
+}
+
+TEST_CASE("replaced gates are freed on the UI thread") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}};
+	const auto service = adrian::detail::service_.model.read(ez::ui).catch_buffers.at(cbuf.id()).service;
+	const auto first   = std::weak_ptr{service->audio.gate};
+	auto gate = adrian::gate_options{};
+	gate.close_ratio = 0.5f;
+	cbuf.set_gate_options(ez::ui, gate);
+	// Waits until the audio thread has taken the first one.
+	gate.close_ratio = 0.25f;
+	cbuf.set_gate_options(ez::ui, gate);
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{}, 0.5f, 1.0f);
+	REQUIRE (service->audio.gate->options.close_ratio == 0.5f);
+	// The audio thread swapped the first gate out but didn't free it.
+	REQUIRE (!first.expired());
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	REQUIRE (first.expired());
+	std::ignore = adrian::process(ez::audio, cbuf.id(), ml::DSPVector{}, 0.5f, 1.0f);
+	REQUIRE (service->audio.gate->options.close_ratio == 0.25f);
+}
+
+TEST_CASE("replaced catch buffer state is freed on the UI thread") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf = adrian::catch_buffer{{1}, {256}, options, {}};
+	auto update_ui = [] { adrian::update(ez::ui, [](adrian::ui::event) {}); };
+	update_ui();
+	// The audio thread is still holding a model with the old state in it.
+	auto audio_model = std::optional{adrian::detail::service_.model.read(ez::ui)};
+	const auto old   = std::weak_ptr{audio_model->catch_buffers.at(cbuf.id()).service};
+	cbuf.reconfigure(ez::nort, {2}, {256});
+	update_ui();
+	update_ui();
+	REQUIRE (!old.expired());
+	// Letting go of it doesn't free the old state.
+	audio_model.reset();
+	REQUIRE (!old.expired());
+	update_ui();
+	REQUIRE (old.expired());
+	// Nor does erasing the catch buffer.
+	audio_model.emplace(adrian::detail::service_.model.read(ez::ui));
+	const auto erased = std::weak_ptr{audio_model->catch_buffers.at(cbuf.id()).service};
+	cbuf = {};
+	update_ui();
+	audio_model.reset();
+	REQUIRE (!erased.expired());
+	update_ui();
+	REQUIRE (erased.expired());
+}
+
+TEST_CASE("catch buffer with more than two channels") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf  = adrian::catch_buffer{{4}, {64}, options, {}};
+	auto input = ml::DSPVectorArray<4>{};
+	for (int ch = 0; ch < 4; ch++) {
+		std::fill(input.row(ch).getBuffer(), input.row(ch).getBuffer() + 64, float(ch + 1));
+	}
+	std::ignore = adrian::process(ez::audio, cbuf.id(), input, 0.0f, 1.0f);
+	cbuf.playback_start(ez::ui, {0}, {64});
+	adrian::update(ez::audio);
+	const auto output = adrian::process(ez::audio, cbuf.id(), ml::DSPVectorArray<4>{}, 0.0f, 1.0f, true);
+	for (int ch = 0; ch < 4; ch++) {
+		REQUIRE (output.constRow(ch) == input.constRow(ch));
+	}
+}
+
+TEST_CASE("batch catch buffer processing") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbufs   = std::vector<adrian::catch_buffer>{};
+	auto inputs  = std::vector<std::vector<float>>(3);
+	auto outputs = std::vector<std::vector<float>>(3);
+	auto in      = std::vector<const float*>(3);
+	auto out     = std::vector<float*>(3);
+	auto jobs    = std::vector<adrian::catch_buffer_job>{};
+	for (size_t i = 0; i < 3; i++) {
+		cbufs.emplace_back(ads::channel_count{1}, ads::frame_count{256}, options, std::any{});
+		inputs[i]  = std::vector<float>(64, float(i + 1));
+		outputs[i] = std::vector<float>(64);
+		in[i]      = inputs[i].data();
+		out[i]     = outputs[i].data();
+		jobs.push_back({cbufs[i].id(), {&in[i], 1}, {&out[i], 1}});
+	}
+	auto run = [](auto fn) {
+		auto worker = std::jthread{[fn] { fn(1); }};
+		fn(0);
+	};
+	for (int i = 0; i < 4; i++) {
+		adrian::process(ez::audio, jobs, {64}, 2, run);
+	}
+	for (size_t i = 0; i < 3; i++) {
+		cbufs[i].playback_start(ez::ui, {0}, {64});
+		jobs[i].disable_recording = true;
+	}
+	adrian::update(ez::audio);
+	adrian::process(ez::audio, jobs, {64}, 2, run);
+	for (size_t i = 0; i < 3; i++) {
+		for (const auto value : outputs[i]) {
+			REQUIRE (value == float(i + 1));
+		}
+	}
+	// Two workers would play the same catch buffer back at once.
+	REQUIRE (adrian::detail::has_unique_ids(jobs));
+	jobs[2].id = jobs[0].id;
+	REQUIRE (!adrian::detail::has_unique_ids(jobs));
+}
+
+TEST_CASE("chain snapshot round trip") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto src = adrian::chain{{2}, {100}, options, {}};
+	auto write_fn = [](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+		std::fill(buffer, buffer + frame_count.value, static_cast<float>(ch.value + 1));
+		return frame_count;
+	};
+	const auto model = adrian::detail::service_.model.read(ez::ui);
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(model, src.id(), {0}, {64}, write_fn);
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(model, src.id(), {64}, {36}, write_fn);
+	auto stream = std::stringstream{};
+	adrian::save(ez::nort, src.id(), stream, {true});
+	const auto dest_id = adrian::load_chain(ez::nort, stream, options, {});
+	REQUIRE (adrian::get_requested_frame_count(ez::ui, dest_id) == ads::frame_count{100});
+	const auto loaded = adrian::detail::service_.model.read(ez::ui);
+	auto read_fn = [](const float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+		for (uint64_t i = 0; i < frame_count.value; i++) {
+			REQUIRE (buffer[i] == static_cast<float>(ch.value + 1));
+		}
+		return frame_count;
+	};
+	std::ignore = adrian::detail::scary_read<64>(loaded, dest_id, {0}, {100}, read_fn);
+	adrian::erase(ez::nort, dest_id);
+}
+
+TEST_CASE("chain snapshot round trip restores the saved mipmaps") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.silent         = true;
+	auto src = adrian::chain{{2}, {128}, options, {}};
+	// Channel 0 ramps up and channel 1 ramps down.
+	auto sample = [](ads::channel_idx ch, int64_t fr) {
+		const auto v = static_cast<float>(fr) / 128.0f;
+		return ch.value == 0 ? v : -v;
+	};
+	auto write_fn = [&](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+		for (uint64_t i = 0; i < frame_count.value; i++) {
+			buffer[i] = sample(ch, start.value + static_cast<int64_t>(i));
+		}
+		return frame_count;
+	};
+	const auto model = adrian::detail::service_.model.read(ez::ui);
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(model, src.id(), {0}, {64}, [&](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+		return write_fn(buffer, ch, start, frame_count);
+	});
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(model, src.id(), {64}, {64}, [&](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+		return write_fn(buffer, ch, ads::frame_idx{start.value + 64}, frame_count);
+	});
+	auto saved = std::stringstream{};
+	adrian::save(ez::nort, src.id(), saved, {true});
+	// The mipmap planes come last. Overwrite the one for the second
+	// sub-buffer of channel 1 so that it's obvious where the loaded
+	// values came from.
+	auto bytes = saved.str();
+	std::fill(bytes.end() - 64, bytes.end(), char(200));
+	auto stream = std::stringstream{bytes};
+	const auto dest_id = adrian::load_chain(ez::nort, stream, options, {});
+	for (int64_t fr = 0; fr < 64; fr++) {
+		for (auto ch = ads::channel_idx{0}; ch < ads::channel_idx{2}; ch++) {
+			const auto expected = ads::encode<uint8_t>(sample(ch, fr));
+			const auto value    = adrian::read_mipmap(ez::ui, dest_id, 1.0, ch, static_cast<double>(fr));
+			REQUIRE (value.min == expected);
+			REQUIRE (value.max == expected);
+		}
+		const auto up = adrian::read_mipmap(ez::ui, dest_id, 1.0, {0}, static_cast<double>(fr + 64));
+		REQUIRE (up.max == ads::encode<uint8_t>(sample({0}, fr + 64)));
+		const auto tampered = adrian::read_mipmap(ez::ui, dest_id, 1.0, {1}, static_cast<double>(fr + 64));
+		REQUIRE (tampered.min == 200);
+		REQUIRE (tampered.max == 200);
+	}
+	// The upper levels are rebuilt from the loaded values.
+	for (int64_t fr = 0; fr < 64; fr += 4) {
+		const auto up   = adrian::read_mipmap(ez::ui, dest_id, 4.0, {0}, static_cast<double>(fr));
+		const auto down = adrian::read_mipmap(ez::ui, dest_id, 4.0, {1}, static_cast<double>(fr));
+		REQUIRE (up.min == ads::encode<uint8_t>(sample({0}, fr)));
+		REQUIRE (up.max == ads::encode<uint8_t>(sample({0}, fr + 3)));
+		REQUIRE (down.min == ads::encode<uint8_t>(sample({1}, fr + 3)));
+		REQUIRE (down.max == ads::encode<uint8_t>(sample({1}, fr)));
+	}
+	// The samples themselves weren't touched.
+	auto read_fn = [&](const float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+		for (uint64_t i = 0; i < frame_count.value; i++) {
+			REQUIRE (buffer[i] == sample(ch, 64 + static_cast<int64_t>(i)));
+		}
+		return frame_count;
+	};
+	std::ignore = adrian::detail::scary_read<64>(adrian::detail::service_.model.read(ez::ui), dest_id, {64}, {64}, read_fn);
+	adrian::erase(ez::nort, dest_id);
+}
+
+TEST_CASE("writing to a cloned chain doesn't affect the original") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto src = adrian::chain{{1}, {64}, options, {}};
+	auto fill_with = [](float value) {
+		return [value](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+			std::fill(buffer, buffer + frame_count.value, value);
+			return frame_count;
+		};
+	};
+	auto expect = [](float value) {
+		return [value](const float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+			for (uint64_t i = 0; i < frame_count.value; i++) {
+				REQUIRE (buffer[i] == value);
+			}
+			return frame_count;
+		};
+	};
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), src.id(), {0}, {64}, fill_with(1.0f));
+	const auto copy = src.clone(ez::nort, {});
+	// This is normally done by the allocation thread.
+	adrian::detail::maintain_reserves(ez::nort, adrian::detail::service_.model.read(ez::nort));
+	const auto model = adrian::detail::service_.model.read(ez::ui);
+	std::ignore = adrian::detail::scary_read<64>(model, copy.id(), {0}, {64}, expect(1.0f));
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(model, copy.id(), {0}, {64}, fill_with(2.0f));
+	std::ignore = adrian::detail::scary_read<64>(model, src.id(), {0}, {64}, expect(1.0f));
+	std::ignore = adrian::detail::scary_read<64>(model, copy.id(), {0}, {64}, expect(2.0f));
+	REQUIRE (adrian::detail::get_cow_underruns(model) == 0);
+}
+
+TEST_CASE("copy-on-write storage is handed over to the ui thread") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto src = adrian::chain{{1}, {64}, options, {}};
+	auto fill_with = [](float value) {
+		return [value](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+			std::fill(buffer, buffer + frame_count.value, value);
+			return frame_count;
+		};
+	};
+	auto expect = [](float value) {
+		return [value](const float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+			for (uint64_t i = 0; i < frame_count.value; i++) {
+				REQUIRE (buffer[i] == value);
+			}
+			return frame_count;
+		};
+	};
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), src.id(), {0}, {64}, fill_with(1.0f));
+	const auto copy = src.clone(ez::nort, {});
+	adrian::detail::maintain_reserves(ez::nort, adrian::detail::service_.model.read(ez::nort));
+	const auto before   = adrian::detail::service_.model.read(ez::ui);
+	const auto src_idx  = (*before.chains.at(src.id()).buffers)[0];
+	const auto copy_idx = (*before.chains.at(copy.id()).buffers)[0];
+	const auto shared   = adrian::detail::get_storage_ptr(before, {1}, copy_idx);
+	REQUIRE (shared == adrian::detail::get_storage_ptr(before, {1}, src_idx));
+	// Write from another thread, the way the audio thread would.
+	std::thread{[&] {
+		const auto m = adrian::detail::service_.model.read(ez::audio);
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(*m, copy.id(), {0}, {32}, fill_with(2.0f));
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(*m, copy.id(), {32}, {32}, fill_with(3.0f));
+	}}.join();
+	const auto service = adrian::detail::get_buffer_service(before, ads::channel_count{1}, copy_idx);
+	REQUIRE (adrian::detail::get_storage(service->critical) != shared.get());
+	REQUIRE (service->critical.incoming_full);
+	// Only one copy was made for the two writes.
+	REQUIRE (before.buffers.at(1).reserve->spare.size_approx() == adrian::detail::buffer::reserve::SIZE - 1);
+	auto push_ui_event = [](adrian::ui::event e) {};
+	adrian::update(ez::ui, push_ui_event);
+	const auto after = adrian::detail::service_.model.read(ez::ui);
+	REQUIRE (!service->critical.incoming_full);
+	REQUIRE (adrian::detail::get_storage_ptr(after, {1}, copy_idx).get() == adrian::detail::get_storage(service->critical));
+	REQUIRE (adrian::detail::get_storage_ptr(after, {1}, src_idx) == shared);
+	std::ignore = adrian::detail::scary_read<64>(after, src.id(), {0}, {64}, expect(1.0f));
+	std::ignore = adrian::detail::scary_read<64>(after, copy.id(), {0}, {32}, expect(2.0f));
+	std::ignore = adrian::detail::scary_read<64>(after, copy.id(), {32}, {32}, expect(3.0f));
+	REQUIRE (adrian::detail::get_cow_underruns(after) == 0);
+}
+
+TEST_CASE("disk-backed chains") {
+	namespace at = adrian::detail::allocation_thread;
+	auto options = adrian::chain_options{};
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	options.backing_file   = std::filesystem::temp_directory_path() / "adrian-test-disk-backed.bin";
+	auto c = adrian::chain{{1}, {256}, options, {}};
+	auto fill_with = [](float value) {
+		return [value](float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+			std::fill(buffer, buffer + frame_count.value, value);
+			return frame_count;
+		};
+	};
+	auto expect = [](float value) {
+		return [value](const float* buffer, ads::channel_idx ch, ads::frame_idx start, ads::frame_count frame_count) {
+			for (uint64_t i = 0; i < frame_count.value; i++) {
+				REQUIRE (buffer[i] == value);
+			}
+			return frame_count;
+		};
+	};
+	auto write = [&](ads::frame_idx start, float value) {
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), c.id(), start, {64}, fill_with(value));
+	};
+	auto read = [&](ads::frame_idx start, float value) {
+		std::ignore = adrian::detail::scary_read<64>(adrian::detail::service_.model.read(ez::ui), c.id(), start, {64}, expect(value));
+	};
+	auto resident = [&](size_t slot) {
+		const auto m = adrian::detail::service_.model.read(ez::ui);
+		return adrian::detail::is_resident(m.chains.at(c.id()), slot);
+	};
+	auto file_value = [&](size_t slot) {
+		const auto m = adrian::detail::service_.model.read(ez::ui);
+		const auto& chain = m.chains.at(c.id());
+		return reinterpret_cast<const float*>(chain.file->data + adrian::detail::get_backing_file_offset(chain.channel_count, slot))[0];
+	};
+	auto do_paging = [] {
+		while (at::do_one_page_op(adrian::detail::th::alloc, &adrian::detail::service_)) {}
+		REQUIRE (!at::has_paging_work(adrian::detail::service_.model.read(ez::ui)));
+	};
+	auto dropped_writes = uint64_t{0};
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (const auto warn = std::get_if<adrian::ui::events::chain::warn_paged_out_write>(&e)) {
+			REQUIRE (warn->id == c.id());
+			dropped_writes = warn->count;
+		}
+	};
+	SUBCASE("writes to sub-buffers which aren't paged in are reported") {
+		write({0}, 1.0f);
+		adrian::update(ez::ui, push_ui_event);
+		REQUIRE (dropped_writes == 1);
+		read({0}, 0.0f);
+	}
+	SUBCASE("paging in and out") {
+		// Slots 0-2 are hot (slot 0 plus the readahead.)
+		c.set_hot_regions(ez::nort, {{{0}, {64}}});
+		do_paging();
+		REQUIRE (resident(0));
+		REQUIRE (resident(2));
+		REQUIRE (!resident(3));
+		write({0}, 1.0f);
+		write({192}, 2.0f);
+		adrian::update(ez::ui, push_ui_event);
+		REQUIRE (dropped_writes == 1);
+		read({0}, 1.0f);
+		// Slot 0 goes cold and is written back to the file.
+		c.set_hot_regions(ez::nort, {{{192}, {64}}});
+		do_paging();
+		REQUIRE (!resident(0));
+		REQUIRE (resident(3));
+		REQUIRE (file_value(0) == 1.0f);
+		read({0}, 0.0f);
+		write({192}, 2.0f);
+		c.set_hot_regions(ez::nort, {{{0}, {64}}});
+		do_paging();
+		REQUIRE (!resident(3));
+		REQUIRE (file_value(3) == 2.0f);
+		read({0}, 1.0f);
+	}
+	SUBCASE("a page out waits for writers") {
+		c.set_hot_regions(ez::nort, {{{0}, {64}}});
+		do_paging();
+		const auto old = adrian::detail::service_.model.read(ez::ui);
+		c.set_hot_regions(ez::nort, {});
+		do_paging();
+		// A writer still holding a snapshot in which the sub-buffer was
+		// resident doesn't write to it once it has been paged out.
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(old, c.id(), {0}, {64}, fill_with(3.0f));
+		adrian::update(ez::ui, push_ui_event);
+		REQUIRE (dropped_writes == 1);
+		REQUIRE (file_value(0) == 0.0f);
+	}
+	SUBCASE("a loaded disk-backed chain reports dropped writes") {
+		auto snapshot = std::stringstream{};
+		adrian::save(ez::nort, c.id(), snapshot);
+		auto loaded_options = options;
+		loaded_options.backing_file = std::filesystem::temp_directory_path() / "adrian-test-disk-backed-loaded.bin";
+		const auto loaded = adrian::load_chain(ez::nort, snapshot, loaded_options, {});
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), loaded, {0}, {64}, fill_with(1.0f));
+		auto loaded_dropped_writes = uint64_t{0};
+		adrian::update(ez::ui, [&](adrian::ui::event e) {
+			if (const auto warn = std::get_if<adrian::ui::events::chain::warn_paged_out_write>(&e)) {
+				REQUIRE (warn->id == loaded);
+				loaded_dropped_writes = warn->count;
+			}
+		});
+		REQUIRE (loaded_dropped_writes == 1);
+		adrian::erase(ez::nort, loaded);
+		std::filesystem::remove(loaded_options.backing_file);
+	}
+	SUBCASE("resizing") {
+		c.set_hot_regions(ez::nort, {{{0}, {64}}});
+		do_paging();
+		write({0}, 1.0f);
+		c.set_hot_regions(ez::nort, {});
+		do_paging();
+		const auto old = adrian::detail::service_.model.read(ez::ui);
+		c.resize(ez::nort, {512});
+		// The old mapping is still valid and sees the same file.
+		const auto& old_file = *old.chains.at(c.id()).file;
+		REQUIRE (reinterpret_cast<const float*>(old_file.data)[0] == 1.0f);
+		REQUIRE (file_value(0) == 1.0f);
+		c.set_hot_regions(ez::nort, {{{448}, {64}}});
+		do_paging();
+		REQUIRE (resident(7));
+		write({448}, 4.0f);
+		c.set_hot_regions(ez::nort, {});
+		do_paging();
+		REQUIRE (file_value(7) == 4.0f);
+		c.resize(ez::nort, {128});
+		c.set_hot_regions(ez::nort, {{{0}, {64}}});
+		do_paging();
+		read({0}, 1.0f);
+	}
+	c = {};
+	std::filesystem::remove(options.backing_file);
+}
+
+TEST_CASE("chain editing") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto a = adrian::chain{{1}, {256}, options, {}};
+	auto b = adrian::chain{{1}, {128}, options, {}};
+	auto fill_with_frame_index = [](float offset) {
+		return [offset](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+			for (uint64_t i = 0; i < frame_count.value; i++) {
+				buffer[i] = offset + static_cast<float>(start.value + i);
+			}
+			return frame_count;
+		};
+	};
+	auto m = adrian::detail::service_.model.read(ez::ui);
+	std::ignore = adrian::detail::scary_write<64>(m, a.id(), {0}, {0}, {256}, fill_with_frame_index(0.0f));
+	std::ignore = adrian::detail::scary_write<64>(m, b.id(), {0}, {0}, {128}, fill_with_frame_index(1000.0f));
+	auto read_all = [](adrian::chain_id id) {
+		const auto m      = adrian::detail::service_.model.read(ez::ui);
+		const auto& chain = m.chains.at(id);
+		auto out = std::vector<float>(chain.requested_frame_count.value);
+		auto read_fn = [&out](const float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+			std::copy(buffer, buffer + frame_count.value, out.begin() + start.value);
+			return frame_count;
+		};
+		std::ignore = adrian::detail::scary_read<64>(m, chain, {0}, {0}, chain.requested_frame_count, read_fn);
+		return out;
+	};
+	// Aligned erase just drops the second sub-buffer
+	const auto third_sub_buffer = m.chains.at(a.id()).buffers->at(2);
+	adrian::erase_frames(ez::nort, a.id(), {64}, {64});
+	m = adrian::detail::service_.model.read(ez::ui);
+	REQUIRE (m.chains.at(a.id()).requested_frame_count == ads::frame_count{192});
+	REQUIRE (m.chains.at(a.id()).buffers->at(1) == third_sub_buffer);
+	auto expected = std::vector<float>{};
+	for (int i = 0; i < 64; i++)   { expected.push_back(float(i)); }
+	for (int i = 128; i < 256; i++) { expected.push_back(float(i)); }
+	REQUIRE (read_all(a.id()) == expected);
+	// Unaligned insert
+	adrian::insert_silence(ez::nort, a.id(), {10}, {5});
+	expected.insert(expected.begin() + 10, 5, 0.0f);
+	REQUIRE (read_all(a.id()) == expected);
+	// Splice part of another chain
+	adrian::splice(ez::nort, a.id(), {20}, b.id(), {30}, {70});
+	for (int i = 99; i >= 30; i--) { expected.insert(expected.begin() + 20, 1000.0f + float(i)); }
+	REQUIRE (read_all(a.id()) == expected);
+	REQUIRE (read_all(b.id()).size() == 128);
+}
+
+TEST_CASE("catch buffer linearize") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto cbuf  = adrian::catch_buffer{{1}, {256}, options, {}};
+	auto input = ml::DSPVector{};
+	for (int i = 0; i < 5; ++i) {
+		std::fill(input.getBuffer(), input.getBuffer() + 64, float(i + 1));
+		std::ignore = adrian::process(ez::audio, cbuf.id(), input, 0.0f, 1.0f);
+	}
+	auto expected = ads::data<float, 1, 256>{};
+	REQUIRE (cbuf.copy(ez::nort, {0}, &expected, {0}, {256}) == 256);
+	const auto chain_id = cbuf.linearize(ez::nort, {64}, {150}, options, {});
+	// This is normally done by the allocation thread.
+	adrian::detail::maintain_reserves(ez::nort, adrian::detail::service_.model.read(ez::nort));
+	auto check = [&] {
+		auto read_fn = [&](const float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+			for (uint64_t i = 0; i < frame_count.value; i++) {
+				REQUIRE (buffer[i] == expected.at(ads::frame_idx{64 + start.value + static_cast<int64_t>(i)}));
+			}
+			return frame_count;
+		};
+		std::ignore = adrian::detail::scary_read<64>(adrian::detail::service_.model.read(ez::nort), chain_id, {0}, {0}, {150}, read_fn);
+	};
+	REQUIRE (adrian::get_requested_frame_count(ez::ui, chain_id) == ads::frame_count{150});
+	check();
+	// Recording over the catch buffer shouldn't affect the chain
+	std::fill(input.getBuffer(), input.getBuffer() + 64, 99.0f);
+	for (int i = 0; i < 8; ++i) {
+		std::ignore = adrian::process(ez::audio, cbuf.id(), input, 0.0f, 1.0f);
+	}
+	check();
+	adrian::erase(ez::nort, chain_id);
+}
+
+TEST_CASE("mipmaps are encoded by the ui thread") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.silent         = true;
+	auto c = adrian::chain{{1}, {128}, options, {}};
+	auto write_fn = [](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+		std::fill(buffer, buffer + frame_count.value, 1.0f);
+		return frame_count;
+	};
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), c.id(), {64}, {64}, write_fn);
+	auto mipmap_changed = false;
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (const auto changed = std::get_if<adrian::ui::events::chain::mipmap_changed>(&e)) {
+			mipmap_changed |= changed->id == c.id();
+		}
+	};
+	REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, 70.0).max == ads::encode<uint8_t>(0.0f));
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (mipmap_changed);
+	REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, 70.0).max == ads::encode<uint8_t>(1.0f));
+	REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, 10.0).max == ads::encode<uint8_t>(0.0f));
+}
+
+TEST_CASE("only sub-buffers which were written to are re-encoded") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.silent         = true;
+	auto a = adrian::chain{{1}, {256}, options, {}};
+	auto b = adrian::chain{{1}, {256}, options, {}};
+	auto write_fn = [](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+		std::fill(buffer, buffer + frame_count.value, 1.0f);
+		return frame_count;
+	};
+	auto changed = std::vector<adrian::chain_id>{};
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (const auto x = std::get_if<adrian::ui::events::chain::mipmap_changed>(&e)) {
+			changed.push_back(x->id);
+		}
+	};
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, push_ui_event);
+	changed.clear();
+	for (int i = 0; i < 4; i++) {
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), a.id(), {128 + (i * 16)}, {16}, write_fn);
+	}
+	REQUIRE (adrian::detail::service_.model.read(ez::ui).buffers.at(1).mipmap_dirty->v.size_approx() == 1);
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (changed == std::vector{a.id()});
+	REQUIRE (a.read_mipmap(ez::ui, 1.0, {0}, 150.0).max == ads::encode<uint8_t>(1.0f));
+	// If the dirty list overflows everything is picked up by a rescan.
+	changed.clear();
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), b.id(), {0}, {16}, write_fn);
+	auto& list = *adrian::detail::service_.model.read(ez::ui).buffers.at(1).mipmap_dirty;
+	auto dropped = adrian::detail::mipmap::dirty_buffer{};
+	REQUIRE (list.v.try_dequeue(dropped));
+	list.overflowed = true;
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (changed == std::vector{b.id()});
+	REQUIRE (b.read_mipmap(ez::ui, 1.0, {0}, 10.0).max == ads::encode<uint8_t>(1.0f));
+	// Non-realtime threads push only the sub-buffers which they touched
+	// rather than making the audio thread scan every chain.
+	changed.clear();
+	auto copy = a.clone(ez::nort, {});
+	REQUIRE (list.v.size_approx() == 4);
+	REQUIRE (!list.overflowed);
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (changed == std::vector{copy.id()});
+	REQUIRE (copy.read_mipmap(ez::ui, 1.0, {0}, 150.0).max == ads::encode<uint8_t>(1.0f));
+}
+
+TEST_CASE("mpmc queue with several producers") {
+	static constexpr auto PRODUCERS = 4;
+	static constexpr auto COUNT     = 10000;
+	auto queue    = adrian::detail::mpmc_queue<int>{64};
+	auto received = std::vector<int>(PRODUCERS * COUNT, 0);
+	{
+		auto producers = std::vector<std::jthread>{};
+		for (int p = 0; p < PRODUCERS; p++) {
+			producers.emplace_back([&queue, p] {
+				for (int i = 0; i < COUNT; i++) {
+					while (!queue.try_enqueue((p * COUNT) + i)) { std::this_thread::yield(); }
+				}
+			});
+		}
+		for (int n = 0; n < PRODUCERS * COUNT;) {
+			int value;
+			if (queue.try_dequeue(value)) { received[value]++; n++; }
+		}
+	}
+	REQUIRE (std::ranges::all_of(received, [](int x) { return x == 1; }));
+	int value;
+	REQUIRE_FALSE (queue.try_dequeue(value));
+}
+
+TEST_CASE("mipmap regions stay dirty when the record queue is full") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.silent         = true;
+	auto c = adrian::chain{{1}, {128}, options, {}};
+	auto write_fn = [](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+		std::fill(buffer, buffer + frame_count.value, 1.0f);
+		return frame_count;
+	};
+	auto& records = adrian::detail::service_.critical.mipmap_records.v;
+	while (records.try_enqueue({})) {}
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), c.id(), {64}, {16}, write_fn);
+	adrian::update(ez::audio);
+	auto record = adrian::detail::mipmap::record{};
+	while (records.try_dequeue(record)) {}
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, 70.0).max == ads::encode<uint8_t>(0.0f));
+	// Published again now that there's room.
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, 70.0).max == ads::encode<uint8_t>(1.0f));
+}
+
+TEST_CASE("zoomed out mipmap reads span sub-buffers") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.silent         = true;
+	auto c = adrian::chain{{1}, {64 * 8}, options, {}};
+	auto write = [&](ads::frame_idx start, float value) {
+		auto write_fn = [value](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+			std::fill(buffer, buffer + frame_count.value, value);
+			return frame_count;
+		};
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), c.id(), start, {8}, write_fn);
+		adrian::update(ez::audio);
+		adrian::update(ez::ui, [](adrian::ui::event) {});
+	};
+	write({(64 * 5) + 10}, 1.0f);
+	// 4 sub-buffers per bin
+	REQUIRE (c.read_mipmap(ez::ui, 256.0, {0}, 0.0).max == ads::encode<uint8_t>(0.0f));
+	REQUIRE (c.read_mipmap(ez::ui, 256.0, {0}, 64.0 * 4).max == ads::encode<uint8_t>(1.0f));
+	REQUIRE (c.read_mipmap(ez::ui, 256.0, {0}, 64.0 * 7).min == ads::encode<uint8_t>(0.0f));
+	// The overview is now built so this is an incremental update.
+	write({64}, -1.0f);
+	REQUIRE (c.read_mipmap(ez::ui, 256.0, {0}, 0.0).min == ads::encode<uint8_t>(-1.0f));
+	const auto whole = c.read_mipmap(ez::ui, 512.0, {0}, 0.0);
+	REQUIRE (whole.min == ads::encode<uint8_t>(-1.0f));
+	REQUIRE (whole.max == ads::encode<uint8_t>(1.0f));
+	// Bins wider than the chain read the top level.
+	REQUIRE (c.read_mipmap(ez::ui, 4096.0, {0}, 64.0 * 7).max == ads::encode<uint8_t>(1.0f));
+}
+
+TEST_CASE("mipmap rows") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.silent         = true;
+	auto c = adrian::chain{{1}, {64 * 8}, options, {}};
+	auto write = [&](ads::frame_idx start, float value) {
+		auto write_fn = [value](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+			std::fill(buffer, buffer + frame_count.value, value);
+			return frame_count;
+		};
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), c.id(), start, {8}, write_fn);
+	};
+	write({70}, 1.0f);
+	write({200}, -1.0f);
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	const auto silence = ads::encode<uint8_t>(0.0f);
+	auto row = std::vector<ads::mipmap_minmax<uint8_t>>(32);
+	c.read_mipmap_row(ez::ui, {0}, {0}, 16.0, row);
+	REQUIRE (row[0].min == silence);
+	REQUIRE (row[0].max == silence);
+	REQUIRE (row[4].max == ads::encode<uint8_t>(1.0f));
+	REQUIRE (row[4].min == silence);
+	REQUIRE (row[12].min == ads::encode<uint8_t>(-1.0f));
+	REQUIRE (row[13].min == silence);
+	// Bins which are wider than a sub-buffer
+	row.resize(4);
+	c.read_mipmap_row(ez::ui, {0}, {0}, 128.0, row);
+	REQUIRE (row[0].max == ads::encode<uint8_t>(1.0f));
+	REQUIRE (row[1].min == ads::encode<uint8_t>(-1.0f));
+	REQUIRE (row[2].max == silence);
+	// Bins outside the chain are left empty
+	c.read_mipmap_row(ez::ui, {0}, {-256}, 128.0, row);
+	REQUIRE (row[0].max == 0);
+	REQUIRE (row[2].max == ads::encode<uint8_t>(1.0f));
+}
+
+TEST_CASE("mipmap storage is only allocated for chains which generate mipmaps") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	options.silent         = true;
+	auto c = adrian::chain{{1}, {128}, options, {}};
+	auto has_mipmaps = [&] {
+		const auto m = adrian::detail::service_.model.read(ez::ui);
+		for (const auto idx : *m.chains.at(c.id()).buffers) {
+			if (!adrian::detail::get_mipmap(m, {1}, idx)) { return false; }
+		}
+		return true;
+	};
+	auto write_fn = [](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+		std::fill(buffer, buffer + frame_count.value, 1.0f);
+		return frame_count;
+	};
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), c.id(), {64}, {16}, write_fn);
+	REQUIRE (!has_mipmaps());
+	c.set_mipmaps_enabled(ez::nort, true);
+	// This is normally done by the allocation thread.
+	adrian::detail::allocation_thread::maintain_mipmaps(ez::nort, &adrian::detail::service_);
+	adrian::detail::allocation_thread::wait_for_mipmap_rebuilds(ez::nort, &adrian::detail::service_);
+	REQUIRE (has_mipmaps());
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, 70.0).max == ads::encode<uint8_t>(1.0f));
+	REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, 10.0).max == ads::encode<uint8_t>(0.0f));
+	c.set_mipmaps_enabled(ez::nort, false);
+	adrian::detail::allocation_thread::maintain_mipmaps(ez::nort, &adrian::detail::service_);
+	REQUIRE (!has_mipmaps());
+}
+
+TEST_CASE("bulk mipmap rebuild") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = false;
+	auto c = adrian::chain{{1}, {64 * 8}, options, {}};
+	auto write_fn = [](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+		std::fill(buffer, buffer + frame_count.value, 1.0f);
+		return frame_count;
+	};
+	for (int i = 0; i < 8; i++) {
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), c.id(), {(i * 64) + 32}, {8}, write_fn);
+	}
+	auto changed = 0;
+	auto push_ui_event = [&](adrian::ui::event e) {
+		if (const auto x = std::get_if<adrian::ui::events::chain::mipmap_changed>(&e)) {
+			changed += x->id == c.id() ? 1 : 0;
+		}
+	};
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (!c.rebuild_mipmaps(ez::nort));
+	c.set_mipmaps_enabled(ez::nort, true);
+	// This is normally done by the allocation thread.
+	adrian::detail::allocation_thread::maintain_mipmaps(ez::nort, &adrian::detail::service_);
+	adrian::detail::allocation_thread::wait_for_mipmap_rebuilds(ez::nort, &adrian::detail::service_);
+	// The dirty regions left by the writes are dropped rather than re-encoded.
+	adrian::update(ez::audio);
+	REQUIRE (adrian::detail::service_.critical.mipmap_records.v.size_approx() == 0);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (changed == 1);
+	for (int i = 0; i < 8; i++) {
+		REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, (i * 64) + 35.0).max == ads::encode<uint8_t>(1.0f));
+		REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, (i * 64) + 10.0).max == ads::encode<uint8_t>(0.0f));
+	}
+	REQUIRE (c.read_mipmap(ez::ui, 512.0, {0}, 0.0).max == ads::encode<uint8_t>(1.0f));
+	REQUIRE (c.rebuild_mipmaps(ez::nort));
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, push_ui_event);
+	REQUIRE (changed == 2);
+}
+
+TEST_CASE("worker pool") {
+	auto pool = adrian::detail::worker_pool{};
+	auto run = [&pool](std::set<std::thread::id>* threads) {
+		auto mut  = std::mutex{};
+		auto runs = std::vector<int>(1000);
+		adrian::detail::parallel_for(&pool, runs.size(), [&](size_t, size_t job) {
+			runs[job]++;
+			auto lock = std::lock_guard{mut};
+			threads->insert(std::this_thread::get_id());
+		});
+		REQUIRE (std::ranges::all_of(runs, [](int n) { return n == 1; }));
+	};
+	auto first  = std::set<std::thread::id>{std::this_thread::get_id()};
+	auto second = std::set<std::thread::id>{};
+	run(&first);
+	run(&second);
+	// The second call doesn't start any new threads.
+	REQUIRE (std::ranges::includes(first, second));
+}
+
+TEST_CASE("writes made during a bulk mipmap rebuild are kept") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.silent         = true;
+	auto c = adrian::chain{{1}, {64 * 2}, options, {}};
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	// The rebuild reads the storage...
+	const auto m       = adrian::detail::service_.model.read(ez::ui);
+	const auto buffers = *m.chains.at(c.id()).buffers;
+	auto mipmaps = std::vector<adrian::detail::buffer::mipmap_ptr>(buffers.size());
+	auto writes  = std::vector<uint64_t>(buffers.size());
+	auto scratch = adrian::detail::mipmap::scratch{};
+	for (size_t slot = 0; slot < buffers.size(); slot++) {
+		const auto& critical = adrian::detail::get_buffer_service(m, ads::channel_count{1}, buffers[slot])->critical;
+		writes[slot]  = adrian::detail::get_mipmap_writes(critical);
+		mipmaps[slot] = adrian::detail::build_mipmap(*adrian::detail::get_storage(critical), {1}, adrian::mipmap_format::uint8_minmax, &scratch);
+	}
+	// ...then the audio is written to before the rebuild is published.
+	auto write_fn = [](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+		std::fill(buffer, buffer + frame_count.value, 1.0f);
+		return frame_count;
+	};
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(m, c.id(), {70}, {8}, write_fn);
+	REQUIRE (adrian::detail::publish_mipmaps(ez::nort, &adrian::detail::service_, c.id(), buffers, adrian::mipmap_format::uint8_minmax, false, mipmaps, writes));
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	REQUIRE (c.read_mipmap(ez::ui, 1.0, {0}, 72.0).max == ads::encode<uint8_t>(1.0f));
+}
+
+TEST_CASE("float mipmap formats") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.mipmap_format  = adrian::mipmap_format::float_minmax_rms;
+	options.silent         = true;
+	auto c = adrian::chain{{1}, {128}, options, {}};
+	auto write_fn = [](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+		std::fill(buffer, buffer + frame_count.value, 0.5f);
+		return frame_count;
+	};
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), c.id(), {64}, {16}, write_fn);
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	const auto a = c.read_mipmap_value(ez::ui, 16.0, {0}, 70.0);
+	REQUIRE (a.min == 0.5f);
+	REQUIRE (a.max == 0.5f);
+	REQUIRE (a.rms == doctest::Approx(0.5f));
+	const auto b = c.read_mipmap_value(ez::ui, 32.0, {0}, 64.0);
+	REQUIRE (b.min == 0.0f);
+	REQUIRE (b.max == 0.5f);
+	REQUIRE (b.rms == doctest::Approx(std::sqrt(0.125f)));
+	// One sub-buffer per bin
+	REQUIRE (c.read_mipmap_value(ez::ui, 64.0, {0}, 64.0).rms == doctest::Approx(0.25f));
+	REQUIRE (c.read_mipmap(ez::ui, 16.0, {0}, 70.0).max == ads::encode<uint8_t>(0.5f));
+	// Switching format regenerates the mipmaps.
+	c.set_mipmap_format(ez::nort, adrian::mipmap_format::uint8_minmax);
+	adrian::detail::allocation_thread::maintain_mipmaps(ez::nort, &adrian::detail::service_);
+	adrian::detail::allocation_thread::wait_for_mipmap_rebuilds(ez::nort, &adrian::detail::service_);
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	REQUIRE (c.read_mipmap(ez::ui, 16.0, {0}, 70.0).max == ads::encode<uint8_t>(0.5f));
+	REQUIRE (c.read_mipmap_value(ez::ui, 16.0, {0}, 70.0).rms == 0.0f);
+}
+
+TEST_CASE("zoomed out float mipmaps") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.mipmap_format  = adrian::mipmap_format::float_minmax_rms;
+	options.silent         = true;
+	auto c = adrian::chain{{1}, {64 * 4}, options, {}};
+	auto write = [&](ads::frame_idx start, float value) {
+		auto write_fn = [value](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+			std::fill(buffer, buffer + frame_count.value, value);
+			return frame_count;
+		};
+		std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), c.id(), start, {64}, write_fn);
+	};
+	write({0}, 0.3f);
+	write({64}, 0.1f);
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	// Not rounded to uint8, and the RMS covers both sub-buffers.
+	const auto a = c.read_mipmap_value(ez::ui, 128.0, {0}, 0.0);
+	REQUIRE (a.min == 0.1f);
+	REQUIRE (a.max == 0.3f);
+	REQUIRE (a.rms == doctest::Approx(std::sqrt((0.09f + 0.01f) / 2.0f)));
+	const auto b = c.read_mipmap_value(ez::ui, 256.0, {0}, 0.0);
+	REQUIRE (b.min == 0.0f);
+	REQUIRE (b.max == 0.3f);
+	REQUIRE (b.rms == doctest::Approx(std::sqrt((0.09f + 0.01f) / 4.0f)));
+	REQUIRE (c.read_mipmap(ez::ui, 128.0, {0}, 0.0).max == ads::encode<uint8_t>(0.3f));
+	auto row = std::vector<adrian::mipmap_value>(2);
+	c.read_mipmap_row(ez::ui, {0}, {0}, 128.0, row);
+	REQUIRE (row[0].max == 0.3f);
+	REQUIRE (row[0].rms == doctest::Approx(a.rms));
+	REQUIRE (row[1].max == 0.0f);
+	REQUIRE (row[1].rms == 0.0f);
+	// A bin which straddles two level 1 cells gets both of them.
+	c.read_mipmap_row(ez::ui, {0}, {64}, 128.0, row);
+	REQUIRE (row[0].min == 0.0f);
+	REQUIRE (row[0].max == 0.3f);
+	REQUIRE (row[0].rms == doctest::Approx(std::sqrt((0.09f + 0.01f) / 4.0f)));
+	// Narrower than a sub-buffer
+	row.resize(4);
+	c.read_mipmap_row(ez::ui, {0}, {32}, 16.0, row);
+	REQUIRE (row[0].max == 0.3f);
+	REQUIRE (row[0].rms == doctest::Approx(0.3f));
+	REQUIRE (row[2].min == 0.1f);
+	// Wider than a cell but narrower than a sub-buffer
+	row.resize(1);
+	c.read_mipmap_row(ez::ui, {0}, {32}, 64.0, row);
+	REQUIRE (row[0].min == 0.1f);
+	REQUIRE (row[0].max == 0.3f);
+	REQUIRE (row[0].rms == doctest::Approx(std::sqrt((0.09f + 0.01f) / 2.0f)));
+}
+
+TEST_CASE("mipmap cache round trip") {
+	auto options = adrian::chain_options{};
+	options.allocate_now   = true;
+	options.enable_mipmaps = true;
+	options.mipmap_format  = adrian::mipmap_format::float_minmax_rms;
+	options.silent         = true;
+	auto write_fn = [](float* buffer, ads::frame_idx start, ads::frame_count frame_count) {
+		std::fill(buffer, buffer + frame_count.value, 0.5f);
+		return frame_count;
+	};
+	auto src = adrian::chain{{1}, {128}, options, {}};
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), src.id(), {64}, {16}, write_fn);
+	adrian::update(ez::audio);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	auto stream = std::stringstream{};
+	adrian::save_mipmap_cache(ez::ui, src.id(), stream, 42);
+	options.enable_mipmaps = false;
+	auto dest = adrian::chain{{1}, {128}, options, {}};
+	std::ignore = adrian::detail::scary_write_one_valid_sub_buffer_region(adrian::detail::service_.model.read(ez::ui), dest.id(), {64}, {16}, write_fn);
+	REQUIRE (!adrian::load_mipmap_cache(ez::nort, dest.id(), stream, 41));
+	stream.seekg(0);
+	REQUIRE (adrian::load_mipmap_cache(ez::nort, dest.id(), stream, 42));
+	// Nothing is re-encoded.
+	adrian::update(ez::audio);
+	REQUIRE (adrian::detail::service_.critical.mipmap_records.v.size_approx() == 0);
+	adrian::update(ez::ui, [](adrian::ui::event) {});
+	const auto value = dest.read_mipmap_value(ez::ui, 16.0, {0}, 70.0);
+	REQUIRE (value.max == 0.5f);
+	REQUIRE (value.rms == doctest::Approx(0.5f));
+	REQUIRE (dest.read_mipmap_value(ez::ui, 64.0, {0}, 64.0).rms == doctest::Approx(0.25f));
+	REQUIRE (dest.read_mipmap(ez::ui, 128.0, {0}, 0.0).max == ads::encode<uint8_t>(0.5f));
+}
+
+TEST_CASE("vectorized mipmap encoding matches ads::encode") {
+	INFO("kernel: " << adrian::detail::encode::KERNEL);
+#if defined(__aarch64__) || defined(_M_ARM64)
+	// Make sure that the ARM build really is testing the NEON kernel.
+	REQUIRE (adrian::detail::encode::KERNEL == "neon");
+#endif
+	auto src  = std::vector<float>(adrian::detail::BUFFER_SIZE + 13);
+	auto dest = std::vector<uint8_t>(src.size());
+	for (size_t i = 0; i < src.size(); i++) {
+		// Sweep a bit beyond [-1, 1] to check the clamping.
+		src[i] = -1.5f + (3.0f * static_cast<float>(i) / static_cast<float>(src.size() - 1));
+	}
+	adrian::detail::encode::to_uint8(src.data(), dest.data(), src.size());
+	for (size_t i = 0; i < src.size(); i++) {
+		REQUIRE (dest[i] == ads::encode<uint8_t>(src[i]));
+	}
+	REQUIRE (dest.front() == ads::encode<uint8_t>(-1.0f));
+	REQUIRE (dest.back()  == ads::encode<uint8_t>(1.0f));
+	// The values either side of every rounding boundary.
+	auto boundaries = std::vector<float>{};
+	for (int step = 0; step < 255; step++) {
+		const auto boundary = ((static_cast<float>(step) + 0.5f) / 127.5f) - 1.0f;
+		auto below = boundary;
+		auto above = boundary;
+		for (int i = 0; i < 4; i++) {
+			below = std::nextafter(below, -2.0f);
+			above = std::nextafter(above, 2.0f);
+			boundaries.push_back(below);
+			boundaries.push_back(above);
+		}
+		boundaries.push_back(boundary);
+	}
+	dest.resize(boundaries.size());
+	adrian::detail::encode::to_uint8(boundaries.data(), dest.data(), boundaries.size());
+	for (size_t i = 0; i < boundaries.size(); i++) {
+		INFO("value: " << boundaries[i]);
+		REQUIRE (dest[i] == ads::encode<uint8_t>(boundaries[i]));
+	}
+}
+
+TEST_CASE("benchmark gate detectors" * doctest::skip()) {
+	static constexpr auto VECTORS = 100000;
+	auto input = ml::DSPVectorArray<2>{};
+	for (int i = 0; i < kFloatsPerDSPVector * 2; i++) {
+		input.getBuffer()[i] = std::sin(static_cast<float>(i) * 0.01f);
+	}
+	auto run = [&](std::string name, adrian::gate_options options) {
+		auto g = adrian::gate::make({2}, options);
+		// Printed so the loop can't be optimized away.
+		auto open = 0;
+		const auto beg = std::chrono::steady_clock::now();
+		for (int i = 0; i < VECTORS; i++) {
+			open += adrian::gate::process(g.get(), input, 0.5f) ? 1 : 0;
+			open += *adrian::gate::delay(g.get(), input.getConstBuffer()) > 0.0f ? 1 : 0;
+		}
+		MESSAGE(name << ": " << std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - beg).count() / VECTORS << "ns per stereo vector (" << open << ")");
+	};
+	auto options = adrian::gate_options{};
+	run("peak", options);
+	options.close_ratio = 0.5f;
+	run("peak with hysteresis", options);
+	options.look_ahead = {256};
+	run("peak with hysteresis and look-ahead", options);
+	options = {};
+	options.detector = adrian::gate_detector::rms;
+	run("rms", options);
+}
+
+TEST_CASE("benchmark mipmap encoding" * doctest::skip()) {
+	static constexpr auto BLOCKS = 10000;
+	auto src  = std::vector<float>(adrian::detail::BUFFER_SIZE);
+	auto dest = std::vector<uint8_t>(src.size());
+	for (size_t i = 0; i < src.size(); i++) {
+		src[i] = std::sin(static_cast<float>(i) * 0.01f);
+	}
+	volatile uint8_t sink = 0;
+	auto run = [&](auto fn) {
+		const auto beg = std::chrono::steady_clock::now();
+		for (int i = 0; i < BLOCKS; i++) {
+			fn(src.data(), dest.data(), src.size());
+			sink = sink + dest[i % dest.size()];
+		}
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - beg).count() / BLOCKS;
+	};
+	const auto scalar = run(adrian::detail::encode::to_uint8_scalar);
+	const auto vector = run(adrian::detail::encode::to_uint8);
+	MESSAGE("scalar: " << scalar << "us per block");
+	MESSAGE(adrian::detail::encode::KERNEL << ": " << vector << "us per block");
+}
@@ -0,0 +1,9 @@
+# Cross compile for 64 bit ARM so that the NEON kernels get built and tested.
+# ctest runs the tests under qemu-user, e.g.
+#   cmake -S . -B _bld-aarch64 --toolchain toolchain-linux-aarch64.cmake
+#   cmake --build _bld-aarch64 && ctest --test-dir _bld-aarch64
+set(CMAKE_SYSTEM_NAME             Linux)
+set(CMAKE_SYSTEM_PROCESSOR        aarch64)
+set(CMAKE_C_COMPILER              aarch64-linux-gnu-gcc)
+set(CMAKE_CXX_COMPILER            aarch64-linux-gnu-g++)
+set(CMAKE_CROSSCOMPILING_EMULATOR qemu-aarch64;-L;/usr/aarch64-linux-gnu)